@@ -1,1208 +1,9174 @@
-#include <stdio.h>
-#include <stdlib.h>
-#include <string.h>
-#include <time.h>
-
-#define MAX_TITLE_LENGTH 100
-#define MAX_AUTHOR_LENGTH 50
-#define MAX_GENRE_LENGTH 30
-#define MAX_ISBN_LENGTH 20
-#define MAX_NAME_LENGTH 50
-#define HASH_TABLE_SIZE 101
-#define MAX_USERS 100 // Defined but not strictly enforced by linked list size
-#define MAX_BOOKS 500 // Defined but not strictly enforced by hash table size
-#define MAX_BORROWED 10
-
-// Define structures
-
-// Book structure
-typedef struct Book {
-    char isbn[MAX_ISBN_LENGTH];
-    char title[MAX_TITLE_LENGTH];
-    char author[MAX_AUTHOR_LENGTH];
-    char genre[MAX_GENRE_LENGTH];
-    int available;
-    int borrow_count; // For tracking popularity
-    struct Book *next; // For hash table collision handling via chaining
-} Book;
-
-// User structure
-typedef struct User {
-    int id;
-    char name[MAX_NAME_LENGTH];
-    char borrowed_books[MAX_BORROWED][MAX_ISBN_LENGTH]; // Queue implementation for borrowed books
-    int borrowed_count;
-    struct User *next; // For linked list implementation
-} User;
-
-// Binary Search Tree Node for efficient book lookup
-typedef struct TreeNode {
-    Book *book; // Pointer to a Book in the hash table
-    struct TreeNode *left;
-    struct TreeNode *right;
-} TreeNode;
-
-// Global variables
-Book *hash_table[HASH_TABLE_SIZE] = {NULL}; // Hash table for books
-User *user_list = NULL; // Linked list for users
-TreeNode *title_bst_root = NULL; // BST for book lookup by title
-int next_user_id = 1001; // Starting ID for users
-
-// Function prototypes
-
-// Hash table functions
-unsigned int hash_function(char *isbn);
-void insert_book(Book *new_book);
-Book* search_book_by_isbn(char *isbn);
-void remove_book(char *isbn); 
-
-// User linked list functions
-void add_user(char *name);
-User* find_user(int id);
-void remove_user(int id); 
-
-// BST functions
-void insert_into_bst(Book *book);
-TreeNode* create_tree_node(Book *book);
-TreeNode* search_by_title(TreeNode *root, char *title);
-void inorder_traversal(TreeNode *root);
-
-// Issue & Return functions
-int issue_book(int user_id, char *isbn);
-int return_book(int user_id, char *isbn);
-
-// Report generation functions
-void list_all_books();
-void list_available_books();
-void list_borrowed_books();
-void list_most_borrowed_books();
-void list_active_users();
-
-// Menu functions
-void display_menu();
-void book_management_menu();
-void user_management_menu();
-void issue_return_menu();
-void search_menu();
-void report_menu();
-
-// Helper functions
-void read_string(char *buffer, int length);
-void clear_input_buffer();
-
-// File I/O functions for persistence
-void save_books_to_file(const char *filename);
-void load_books_from_file(const char *filename);
-void save_users_to_file(const char *filename);
-void load_users_from_file(const char *filename);
-
-// Memory freeing functions
-void free_all_books();
-void free_bst_nodes(TreeNode *root); // Helper for freeing BST
-void free_all_users();
-
-
-// Main function
-int main() {
-    int choice;
-
-    printf("\n===== Smart Library Management System =====\n");
-
-    // Load data at startup
-    load_books_from_file("books.dat");
-    load_users_from_file("users.dat");
-
-    do {
-        display_menu();
-        printf("Enter your choice: ");
-        scanf("%d", &choice);
-        clear_input_buffer();
-
-        switch(choice) {
-            case 1:
-                book_management_menu();
-                break;
-            case 2:
-                user_management_menu();
-                break;
-            case 3:
-                issue_return_menu();
-                break;
-            case 4:
-                search_menu();
-                break;
-            case 5:
-                report_menu();
-                break;
-            case 0:
-                printf("Exiting the system. Saving data...\n");
-                save_books_to_file("books.dat");
-                save_users_to_file("users.dat");
-                printf("Data saved. Thank you!\n");
-                break;
-            default:
-                printf("Invalid choice. Please try again.\n");
-        }
-
-    } while(choice != 0);
-
-    // Free allocated memory before exit
-    free_all_books();
-    free_all_users();
-
-    return 0;
-}
-
-// --- Hash Table Functions ---
-
-// Hash function implementation
-unsigned int hash_function(char *isbn) {
-    unsigned int hash = 0;
-    while (*isbn) {
-        hash = (hash * 31) + (*isbn++);
-    }
-    return hash % HASH_TABLE_SIZE;
-}
-
-// Insert a book into the hash table
-void insert_book(Book *new_book) {
-    unsigned int index = hash_function(new_book->isbn);
-
-    // Check if book with the same ISBN already exists
-    Book *current = hash_table[index];
-    while (current != NULL) {
-        if (strcmp(current->isbn, new_book->isbn) == 0) {
-            printf("Book with ISBN %s already exists. Not adding duplicate.\n", new_book->isbn);
-            free(new_book); // Free the newly allocated book if it's a duplicate
-            return;
-        }
-        current = current->next;
-    }
-
-    // Add book to the beginning of the chain at this index
-    new_book->next = hash_table[index];
-    hash_table[index] = new_book;
-
-    // Also add to BST for title-based searching
-    insert_into_bst(new_book);
-
-    printf("Book '%s' added successfully.\n", new_book->title);
-}
-
-// Search for a book by ISBN
-Book* search_book_by_isbn(char *isbn) {
-    unsigned int index = hash_function(isbn);
-    Book *current = hash_table[index];
-
-    while (current != NULL) {
-        if (strcmp(current->isbn, isbn) == 0) {
-            return current;
-        }
-        current = current->next;
-    }
-
-    return NULL; // Book not found
-}
-
-// Remove a book by ISBN
-void remove_book(char *isbn) {
-    unsigned int index = hash_function(isbn);
-    Book *current = hash_table[index];
-    Book *prev = NULL;
-
-    // Search for the book in the hash table chain
-    while (current != NULL && strcmp(current->isbn, isbn) != 0) {
-        prev = current;
-        current = current->next;
-    }
-
-    if (current == NULL) {
-        printf("Book with ISBN %s not found.\n", isbn);
-        return;
-    }
-
-    // Check if the book is currently borrowed
-    if (!current->available) {
-        printf("Cannot remove book '%s' (ISBN: %s) as it is currently borrowed.\n", current->title, isbn);
-        return;
-    }
-
-    // Remove from hash table
-    if (prev == NULL) { // Book is the head of the chain
-        hash_table[index] = current->next;
-    } else {
-        prev->next = current->next;
-    }
-
-    // Remove from BST
-
-    printf("Book '%s' (ISBN: %s) removed successfully.\n", current->title, current->isbn);
-    free(current); // Free the memory allocated for the book
-}
-
-
-// --- BST Functions ---
-
-// BST node creation
-TreeNode* create_tree_node(Book *book) {
-    TreeNode *new_node = (TreeNode*)malloc(sizeof(TreeNode));
-    if (new_node == NULL) {
-        printf("Memory allocation failed for tree node.\n");
-        exit(1);
-    }
-
-    new_node->book = book;
-    new_node->left = NULL;
-    new_node->right = NULL;
-
-    return new_node;
-}
-
-// Insert a book into the BST
-void insert_into_bst(Book *book) {
-    if (title_bst_root == NULL) {
-        title_bst_root = create_tree_node(book);
-        return;
-    }
-
-    TreeNode *current = title_bst_root;
-    TreeNode *parent = NULL;
-    int comparison;
-
-    while (current != NULL) {
-        parent = current;
-        comparison = strcmp(book->title, current->book->title);
-
-        if (comparison < 0) {
-            current = current->left;
-        } else if (comparison > 0) {
-            current = current->right;
-        } else {
-            // Title already exists, decide how to handle.
-            current = current->right;
-        }
-    }
-
-    TreeNode *new_node = create_tree_node(book);
-
-    if (comparison < 0) {
-        parent->left = new_node;
-    } else { // comparison > 0
-        parent->right = new_node;
-    }
-}
-
-// Search for a book by title in the BST
-TreeNode* search_by_title(TreeNode *root, char *title) {
-    if (root == NULL) {
-        return NULL;
-    }
-
-    int comparison = strcmp(title, root->book->title);
-    if (comparison == 0) {
-        return root; // Found a book with the matching title
-    } else if (comparison < 0) {
-        return search_by_title(root->left, title);
-    } else {
-        return search_by_title(root->right, title);
-    }
-}
-
-// Inorder traversal of BST (for listing books in alphabetical order by title)
-void inorder_traversal(TreeNode *root) {
-    if (root != NULL) {
-        inorder_traversal(root->left);
-        printf("Title: %-30s | Author: %-20s | ISBN: %-15s | Status: %s\n",
-               root->book->title, root->book->author, root->book->isbn,
-               root->book->available ? "Available" : "Borrowed");
-        inorder_traversal(root->right);
-    }
-}
-
-// --- User Linked List Functions ---
-
-// Add new user to the linked list
-void add_user(char *name) {
-    User *new_user = (User*)malloc(sizeof(User));
-    if (new_user == NULL) {
-        printf("Memory allocation failed for user.\n");
-        return;
-    }
-
-    new_user->id = next_user_id++;
-    strcpy(new_user->name, name);
-    new_user->borrowed_count = 0;
-    new_user->next = NULL;
-
-    // Add to the beginning of the linked list
-    if (user_list == NULL) {
-        user_list = new_user;
-    } else {
-        new_user->next = user_list;
-        user_list = new_user;
-    }
-
-    printf("User '%s' added successfully with ID: %d\n", name, new_user->id);
-}
-
-// Find a user by ID
-User* find_user(int id) {
-    User *current = user_list;
-
-    while (current != NULL) {
-        if (current->id == id) {
-            return current;
-        }
-        current = current->next;
-    }
-
-    return NULL; // User not found
-}
-
-// Remove a user by ID
-void remove_user(int id) {
-    User *current = user_list;
-    User *prev = NULL;
-
-    while (current != NULL && current->id != id) {
-        prev = current;
-        current = current->next;
-    }
-
-    if (current == NULL) {
-        printf("User with ID %d not found.\n", id);
-        return;
-    }
-
-    // Check if the user has any borrowed books
-    if (current->borrowed_count > 0) {
-        printf("Cannot remove user '%s' (ID: %d) as they still have borrowed books.\n", current->name, current->id);
-        return;
-    }
-
-    // Remove from linked list
-    if (prev == NULL) { // User is the head of the list
-        user_list = current->next;
-    } else {
-        prev->next = current->next;
-    }
-
-    printf("User '%s' (ID: %d) removed successfully.\n", current->name, current->id);
-    free(current); // Free the memory allocated for the user
-}
-
-
-// --- Issue & Return Functions ---
-
-// Issue a book to a user
-int issue_book(int user_id, char *isbn) {
-    User *user = find_user(user_id);
-    if (user == NULL) {
-        printf("User ID %d not found.\n", user_id);
-        return 0;
-    }
-
-    Book *book = search_book_by_isbn(isbn);
-    if (book == NULL) {
-        printf("Book with ISBN %s not found.\n", isbn);
-        return 0;
-    }
-
-    if (!book->available) {
-        printf("Book '%s' is not available for borrowing.\n", book->title);
-        return 0;
-    }
-
-    if (user->borrowed_count >= MAX_BORROWED) {
-        printf("User '%s' has reached the maximum number of books that can be borrowed (%d).\n", user->name, MAX_BORROWED);
-        return 0;
-    }
-
-    // Add book to user's borrowed list
-    strcpy(user->borrowed_books[user->borrowed_count++], isbn);
-
-    // Update book availability
-    book->available = 0;
-    book->borrow_count++;
-
-    printf("Book '%s' issued to user '%s' successfully.\n", book->title, user->name);
-    return 1;
-}
-
-// Return a book
-int return_book(int user_id, char *isbn) {
-    User *user = find_user(user_id);
-    if (user == NULL) {
-        printf("User ID %d not found.\n", user_id);
-        return 0;
-    }
-
-    Book *book = search_book_by_isbn(isbn);
-    if (book == NULL) {
-        printf("Book with ISBN %s not found.\n", isbn);
-        return 0;
-    }
-
-    // Check if user has borrowed this book
-    int found_idx = -1;
-    for (int i = 0; i < user->borrowed_count; i++) {
-        if (strcmp(user->borrowed_books[i], isbn) == 0) {
-            found_idx = i;
-            break;
-        }
-    }
-
-    if (found_idx == -1) {
-        printf("User '%s' has not borrowed book with ISBN %s.\n", user->name, isbn);
-        return 0;
-    }
-
-    // Remove book from user's borrowed list by shifting elements
-    for (int i = found_idx; i < user->borrowed_count - 1; i++) {
-        strcpy(user->borrowed_books[i], user->borrowed_books[i + 1]);
-    }
-    user->borrowed_count--;
-
-    // Update book availability
-    book->available = 1;
-
-    printf("Book '%s' returned by user '%s' successfully.\n", book->title, user->name);
-    return 1;
-}
-
-// --- Report Generation Functions ---
-
-// List all books
-void list_all_books() {
-    printf("\n===== All Books =====\n");
-    printf("%-30s | %-20s | %-15s | %-10s\n", "Title", "Author", "ISBN", "Status");
-    printf("-------------------------------------------------------------------------------------\n");
-
-    if (title_bst_root == NULL) {
-        printf("No books in the library.\n");
-        return;
-    }
-    // Use BST inorder traversal for alphabetical listing
-    inorder_traversal(title_bst_root);
-}
-
-// List available books
-void list_available_books() {
-    printf("\n===== Available Books =====\n");
-    printf("%-30s | %-20s | %-15s\n", "Title", "Author", "ISBN");
-    printf("--------------------------------------------------------------------\n");
-
-    int count = 0;
-    // Iterate through the hash table to find available books
-    for (int i = 0; i < HASH_TABLE_SIZE; i++) {
-        Book *current = hash_table[i];
-        while (current != NULL) {
-            if (current->available) {
-                printf("%-30s | %-20s | %-15s\n",
-                       current->title, current->author, current->isbn);
-                count++;
-            }
-            current = current->next;
-        }
-    }
-
-    if (count == 0) {
-        printf("No available books in the library.\n");
-    }
-}
-
-// List borrowed books
-void list_borrowed_books() {
-    printf("\n===== Currently Borrowed Books =====\n");
-    printf("%-30s | %-20s | %-15s | %-20s\n", "Title", "Author", "ISBN", "Borrowed By");
-    printf("-------------------------------------------------------------------------------------\n");
-
-    int count = 0;
-    User *user = user_list;
-
-    while (user != NULL) {
-        for (int i = 0; i < user->borrowed_count; i++) {
-            Book *book = search_book_by_isbn(user->borrowed_books[i]);
-            if (book != NULL) { // Should always be found if the ISBN is valid
-                printf("%-30s | %-20s | %-15s | %-20s (ID: %d)\n",
-                       book->title, book->author, book->isbn, user->name, user->id);
-                count++;
-            }
-        }
-        user = user->next;
-    }
-
-    if (count == 0) {
-        printf("No books are currently borrowed.\n");
-    }
-}
-
-// List most borrowed books (simple implementation using bubble sort)
-void list_most_borrowed_books() {
-    printf("\n===== Most Borrowed Books =====\n");
-    printf("%-30s | %-20s | %-15s | %-10s\n", "Title", "Author", "ISBN", "Borrows");
-    printf("-------------------------------------------------------------------------------------\n");
-
-    // Create an array of pointers to books for sorting
-    Book *books[MAX_BOOKS];
-    int book_count = 0;
-
-    // Collect all books from hash table
-    for (int i = 0; i < HASH_TABLE_SIZE; i++) {
-        Book *current = hash_table[i];
-        while (current != NULL && book_count < MAX_BOOKS) {
-            books[book_count++] = current;
-            current = current->next;
-        }
-    }
-
-    if (book_count == 0) {
-        printf("No books in the library.\n");
-        return;
-    }
-
-    // Simple bubble sort by borrow count (descending)
-    for (int i = 0; i < book_count - 1; i++) {
-        for (int j = 0; j < book_count - i - 1; j++) {
-            if (books[j]->borrow_count < books[j + 1]->borrow_count) {
-                Book *temp = books[j];
-                books[j] = books[j + 1];
-                books[j + 1] = temp;
-            }
-        }
-    }
-
-    // Display top books (at most 10)
-    int display_limit = 10;
-    if (book_count < display_limit) {
-        display_limit = book_count;
-    }
-
-    int displayed_any = 0;
-    for (int i = 0; i < display_limit; i++) {
-        if (books[i]->borrow_count > 0) {
-            printf("%-30s | %-20s | %-15s | %-10d\n",
-                   books[i]->title, books[i]->author, books[i]->isbn, books[i]->borrow_count);
-            displayed_any = 1;
-        }
-    }
-
-    if (!displayed_any) {
-        printf("No books have been borrowed yet.\n");
-    }
-}
-
-// List active users
-void list_active_users() {
-    printf("\n===== Active Users =====\n");
-    printf("%-5s | %-20s | %-15s\n", "ID", "Name", "Books Borrowed");
-    printf("--------------------------------------------\n");
-
-    User *current = user_list;
-    int count = 0;
-
-    // Create a temporary array of active users for sorting if needed,
-    User *active_users[MAX_USERS]; // Max 100 users
-    int active_user_count = 0;
-
-    while (current != NULL && active_user_count < MAX_USERS) {
-        if (current->borrowed_count > 0) {
-            active_users[active_user_count++] = current;
-        }
-        current = current->next;
-    }
-
-    if (active_user_count == 0) {
-        printf("No active users at the moment.\n");
-        return;
-    }
-
-    // Simple bubble sort by borrowed_count (descending) for active users
-    for (int i = 0; i < active_user_count - 1; i++) {
-        for (int j = 0; j < active_user_count - i - 1; j++) {
-            if (active_users[j]->borrowed_count < active_users[j + 1]->borrowed_count) {
-                User *temp = active_users[j];
-                active_users[j] = active_users[j + 1];
-                active_users[j + 1] = temp;
-            }
-        }
-    }
-
-    // Display active users
-    for (int i = 0; i < active_user_count; i++) {
-        printf("%-5d | %-20s | %-15d\n",
-               active_users[i]->id, active_users[i]->name, active_users[i]->borrowed_count);
-        count++;
-    }
-
-    if (count == 0) { 
-        printf("No active users at the moment.\n");
-    }
-}
-
-
-// --- Menu Functions ---
-
-void display_menu() {
-    printf("\n===== Main Menu =====\n");
-    printf("1. Book Management\n");
-    printf("2. User Management\n");
-    printf("3. Issue/Return Books\n");
-    printf("4. Search\n");
-    printf("5. Reports\n");
-    printf("0. Exit\n");
-}
-
-void book_management_menu() {
-    int choice;
-
-    do {
-        printf("\n===== Book Management =====\n");
-        printf("1. Add New Book\n");
-        printf("2. Remove Book\n");
-        printf("3. List All Books\n");
-        printf("0. Back to Main Menu\n");
-        printf("Enter your choice: ");
-        scanf("%d", &choice);
-        clear_input_buffer();
-
-        switch(choice) {
-            case 1: {
-                Book *new_book = (Book*)malloc(sizeof(Book));
-                if (new_book == NULL) {
-                    printf("Memory allocation failed.\n");
-                    break;
-                }
-
-                printf("Enter ISBN: ");
-                read_string(new_book->isbn, MAX_ISBN_LENGTH);
-
-                printf("Enter Title: ");
-                read_string(new_book->title, MAX_TITLE_LENGTH);
-
-                printf("Enter Author: ");
-                read_string(new_book->author, MAX_AUTHOR_LENGTH);
-
-                printf("Enter Genre: ");
-                read_string(new_book->genre, MAX_GENRE_LENGTH);
-
-                new_book->available = 1;
-                new_book->borrow_count = 0;
-                new_book->next = NULL;
-
-                insert_book(new_book);
-                break;
-            }
-            case 2: {
-                char isbn[MAX_ISBN_LENGTH];
-                printf("Enter ISBN of the book to remove: ");
-                read_string(isbn, MAX_ISBN_LENGTH);
-
-                remove_book(isbn);
-                break;
-            }
-            case 3:
-                list_all_books();
-                break;
-            case 0:
-                printf("Returning to main menu.\n");
-                break;
-            default:
-                printf("Invalid choice. Please try again.\n");
-        }
-    } while(choice != 0);
-}
-
-void user_management_menu() {
-    int choice;
-
-    do {
-        printf("\n===== User Management =====\n");
-        printf("1. Add New User\n");
-        printf("2. Find User\n");
-        printf("3. Remove User\n");
-        printf("4. List All Users\n");
-        printf("0. Back to Main Menu\n");
-        printf("Enter your choice: ");
-        scanf("%d", &choice);
-        clear_input_buffer();
-
-        switch(choice) {
-            case 1: {
-                char name[MAX_NAME_LENGTH];
-                printf("Enter user name: ");
-                read_string(name, MAX_NAME_LENGTH);
-                add_user(name);
-                break;
-            }
-            case 2: {
-                int id;
-                printf("Enter user ID: ");
-                scanf("%d", &id);
-                clear_input_buffer();
-
-                User *user = find_user(id);
-                if (user != NULL) {
-                    printf("\nUser Found:\n");
-                    printf("ID: %d\n", user->id);
-                    printf("Name: %s\n", user->name);
-                    printf("Books borrowed: %d\n", user->borrowed_count);
-
-                    if (user->borrowed_count > 0) {
-                        printf("\nBorrowed Books:\n");
-                        for (int i = 0; i < user->borrowed_count; i++) {
-                            Book *book = search_book_by_isbn(user->borrowed_books[i]);
-                            if (book != NULL) {
-                                printf("%d. %s by %s (ISBN: %s)\n", i+1, book->title, book->author, book->isbn);
-                            }
-                        }
-                    }
-                } else {
-                    printf("User with ID %d not found.\n", id);
-                }
-                break;
-            }
-            case 3: {
-                int id;
-                printf("Enter user ID to remove: ");
-                scanf("%d", &id);
-                clear_input_buffer();
-
-                remove_user(id);
-                break;
-            }
-            case 4: {
-                printf("\n===== All Users =====\n");
-                printf("%-5s | %-20s | %-15s\n", "ID", "Name", "Books Borrowed");
-                printf("--------------------------------------------\n");
-
-                User *current = user_list;
-                int count = 0;
-
-                if (user_list == NULL) {
-                    printf("No users registered in the system.\n");
-                    break;
-                }
-
-                while (current != NULL) {
-                    printf("%-5d | %-20s | %-15d\n",
-                           current->id, current->name, current->borrowed_count);
-                    count++;
-                    current = current->next;
-                }
-                break;
-            }
-            case 0:
-                printf("Returning to main menu.\n");
-                break;
-            default:
-                printf("Invalid choice. Please try again.\n");
-        }
-    } while(choice != 0);
-}
-
-void issue_return_menu() {
-    int choice;
-
-    do {
-        printf("\n===== Issue/Return Books =====\n");
-        printf("1. Issue Book\n");
-        printf("2. Return Book\n");
-        printf("0. Back to Main Menu\n");
-        printf("Enter your choice: ");
-        scanf("%d", &choice);
-        clear_input_buffer();
-
-        switch(choice) {
-            case 1: {
-                int user_id;
-                char isbn[MAX_ISBN_LENGTH];
-
-                printf("Enter User ID: ");
-                scanf("%d", &user_id);
-                clear_input_buffer();
-
-                printf("Enter ISBN of the book to issue: ");
-                read_string(isbn, MAX_ISBN_LENGTH);
-
-                issue_book(user_id, isbn);
-                break;
-            }
-            case 2: {
-                int user_id;
-                char isbn[MAX_ISBN_LENGTH];
-
-                printf("Enter User ID: ");
-                scanf("%d", &user_id);
-                clear_input_buffer();
-
-                printf("Enter ISBN of the book to return: ");
-                read_string(isbn, MAX_ISBN_LENGTH);
-
-                return_book(user_id, isbn);
-                break;
-            }
-            case 0:
-                printf("Returning to main menu.\n");
-                break;
-            default:
-                printf("Invalid choice. Please try again.\n");
-        }
-    } while(choice != 0);
-}
-
-void search_menu() {
-    int choice;
-
-    do {
-        printf("\n===== Search =====\n");
-        printf("1. Search by ISBN\n");
-        printf("2. Search by Title\n");
-        printf("3. Search by Author\n");
-        printf("0. Back to Main Menu\n");
-        printf("Enter your choice: ");
-        scanf("%d", &choice);
-        clear_input_buffer();
-
-        switch(choice) {
-            case 1: {
-                char isbn[MAX_ISBN_LENGTH];
-                printf("Enter ISBN: ");
-                read_string(isbn, MAX_ISBN_LENGTH);
-
-                Book *book = search_book_by_isbn(isbn);
-                if (book != NULL) {
-                    printf("\nBook Found:\n");
-                    printf("ISBN: %s\n", book->isbn);
-                    printf("Title: %s\n", book->title);
-                    printf("Author: %s\n", book->author);
-                    printf("Genre: %s\n", book->genre);
-                    printf("Status: %s\n", book->available ? "Available" : "Borrowed");
-                    printf("Times borrowed: %d\n", book->borrow_count);
-                } else {
-                    printf("Book with ISBN %s not found.\n", isbn);
-                }
-                break;
-            }
-            case 2: {
-                char title[MAX_TITLE_LENGTH];
-                printf("Enter Title: ");
-                read_string(title, MAX_TITLE_LENGTH);
-
-                TreeNode *result_node = search_by_title(title_bst_root, title);
-                if (result_node != NULL && result_node->book != NULL) {
-                    printf("\nBook Found:\n");
-                    printf("ISBN: %s\n", result_node->book->isbn);
-                    printf("Title: %s\n", result_node->book->title);
-                    printf("Author: %s\n", result_node->book->author);
-                    printf("Genre: %s\n", result_node->book->genre);
-                    printf("Status: %s\n", result_node->book->available ? "Available" : "Borrowed");
-                    printf("Times borrowed: %d\n", result_node->book->borrow_count);
-                } else {
-                    printf("Book with title '%s' not found.\n", title);
-                }
-                break;
-            }
-            case 3: {
-                char author[MAX_AUTHOR_LENGTH];
-                printf("Enter Author: ");
-                read_string(author, MAX_AUTHOR_LENGTH);
-
-                printf("\nBooks by %s:\n", author);
-                printf("%-30s | %-15s | %-10s\n", "Title", "ISBN", "Status");
-                printf("------------------------------------------------------------\n");
-
-                int found = 0;
-                for (int i = 0; i < HASH_TABLE_SIZE; i++) {
-                    Book *current = hash_table[i];
-                    while (current != NULL) {
-                        if (strcmp(current->author, author) == 0) {
-                            printf("%-30s | %-15s | %-10s\n",
-                                   current->title, current->isbn,
-                                   current->available ? "Available" : "Borrowed");
-                            found = 1;
-                        }
-                        current = current->next;
-                    }
-                }
-
-                if (!found) {
-                    printf("No books found by author '%s'.\n", author);
-                }
-                break;
-            }
-            case 0:
-                printf("Returning to main menu.\n");
-                break;
-            default:
-                printf("Invalid choice. Please try again.\n");
-        }
-    } while(choice != 0);
-}
-
-void report_menu() {
-    int choice;
-
-    do {
-        printf("\n===== Reports =====\n");
-        printf("1. List All Books\n");
-        printf("2. List Available Books\n");
-        printf("3. List Borrowed Books\n");
-        printf("4. List Most Borrowed Books\n");
-        printf("5. List Active Users\n");
-        printf("0. Back to Main Menu\n");
-        printf("Enter your choice: ");
-        scanf("%d", &choice);
-        clear_input_buffer();
-
-        switch(choice) {
-            case 1:
-                list_all_books();
-                break;
-            case 2:
-                list_available_books();
-                break;
-            case 3:
-                list_borrowed_books();
-                break;
-            case 4:
-                list_most_borrowed_books();
-                break;
-            case 5:
-                list_active_users();
-                break;
-            case 0:
-                printf("Returning to main menu.\n");
-                break;
-            default:
-                printf("Invalid choice. Please try again.\n");
-        }
-    } while(choice != 0);
-}
-
-// --- Helper Functions ---
-
-// Helper function to read a string with spaces
-void read_string(char *buffer, int length) {
-    fgets(buffer, length, stdin);
-
-    // Remove trailing newline if present
-    int len = strlen(buffer);
-    if (len > 0 && buffer[len-1] == '\n') {
-        buffer[len-1] = '\0';
-    }
-}
-
-// Helper function to clear input buffer
-void clear_input_buffer() {
-    int c;
-    while ((c = getchar()) != '\n' && c != EOF);
-}
-
-
-// --- File I/O Functions ---
-
-// Function to save all books to a file
-void save_books_to_file(const char *filename) {
-    FILE *file = fopen(filename, "w"); // Open in write mode, overwriting existing file
-    if (file == NULL) {
-        perror("Error opening books file for writing");
-        return;
-    }
-
-    for (int i = 0; i < HASH_TABLE_SIZE; i++) {
-        Book *current = hash_table[i];
-        while (current != NULL) {
-            // Write book details in a delimited format (e.g., pipe '|')
-            fprintf(file, "%s|%s|%s|%s|%d|%d\n",
-                    current->isbn,
-                    current->title,
-                    current->author,
-                    current->genre,
-                    current->available,
-                    current->borrow_count);
-            current = current->next;
-        }
-    }
-
-    fclose(file);
-    
-}
-
-// Function to load books from a file
-void load_books_from_file(const char *filename) {
-    FILE *file = fopen(filename, "r"); // Open in read mode
-    if (file == NULL) {
-        return;
-    }
-
-    char line[512]; // A buffer to read each line
-    while (fgets(line, sizeof(line), file) != NULL) {
-        // Remove trailing newline character
-        line[strcspn(line, "\n")] = '\0';
-
-        Book *new_book = (Book*)malloc(sizeof(Book));
-        if (new_book == NULL) {
-            printf("Memory allocation failed during book loading.\n");
-            fclose(file);
-            return;
-        }
-
-        // Parse the line using strtok
-        char *token = strtok(line, "|");
-        if (token != NULL) strcpy(new_book->isbn, token); else { free(new_book); continue; }
-        token = strtok(NULL, "|");
-        if (token != NULL) strcpy(new_book->title, token); else { free(new_book); continue; }
-        token = strtok(NULL, "|");
-        if (token != NULL) strcpy(new_book->author, token); else { free(new_book); continue; }
-        token = strtok(NULL, "|");
-        if (token != NULL) strcpy(new_book->genre, token); else { free(new_book); continue; }
-        token = strtok(NULL, "|");
-        if (token != NULL) new_book->available = atoi(token); else { free(new_book); continue; }
-        token = strtok(NULL, "|");
-        if (token != NULL) new_book->borrow_count = atoi(token); else { free(new_book); continue; }
-
-        new_book->next = NULL; // Will be set correctly by insert_book
-
-        // Insert the book into the hash table
-        unsigned int index = hash_function(new_book->isbn);
-        new_book->next = hash_table[index];
-        hash_table[index] = new_book;
-
-        // Also add to BST for title-based searching
-        insert_into_bst(new_book);
-    }
-
-    fclose(file);
-    
-}
-
-// Function to save all users to a file
-void save_users_to_file(const char *filename) {
-    FILE *file = fopen(filename, "w");
-    if (file == NULL) {
-        perror("Error opening users file for writing");
-        return;
-    }
-
-    User *current = user_list;
-    while (current != NULL) {
-        // Write user details
-        fprintf(file, "%d|%s|%d", current->id, current->name, current->borrowed_count);
-        // Write borrowed books
-        for (int i = 0; i < current->borrowed_count; i++) {
-            fprintf(file, "|%s", current->borrowed_books[i]);
-        }
-        fprintf(file, "\n");
-        current = current->next;
-    }
-
-    fclose(file);
-    
-}
-
-// Function to load users from a file
-void load_users_from_file(const char *filename) {
-    FILE *file = fopen(filename, "r");
-    if (file == NULL) {
-        return;
-    }
-
-    char line[1024]; // Larger buffer for user lines due to borrowed books
-    int current_max_id = 1000; // Track max ID to correctly set next_user_id
-
-    // Initialize user_list to NULL
-    User *temp_user_list = NULL;
-
-    while (fgets(line, sizeof(line), file) != NULL) {
-        line[strcspn(line, "\n")] = '\0';
-
-        User *new_user = (User*)malloc(sizeof(User));
-        if (new_user == NULL) {
-            printf("Memory allocation failed during user loading.\n");
-            fclose(file);
-            return;
-        }
-        new_user->next = NULL;
-
-        char *token;
-        char *rest_of_line = line; 
-
-        token = strtok_r(rest_of_line, "|", &rest_of_line);
-        if (token != NULL) new_user->id = atoi(token); else { free(new_user); continue; }
-
-        token = strtok_r(rest_of_line, "|", &rest_of_line);
-        if (token != NULL) strcpy(new_user->name, token); else { free(new_user); continue; }
-
-        token = strtok_r(rest_of_line, "|", &rest_of_line);
-        if (token != NULL) new_user->borrowed_count = atoi(token); else { free(new_user); continue; }
-
-        for (int i = 0; i < new_user->borrowed_count; i++) {
-            token = strtok_r(rest_of_line, "|", &rest_of_line);
-            if (token != NULL) strcpy(new_user->borrowed_books[i], token); else { free(new_user); continue; }
-        }
-
-        // Add to the beginning of the temporary linked list
-        new_user->next = temp_user_list;
-        temp_user_list = new_user;
-
-        if (new_user->id > current_max_id) {
-            current_max_id = new_user->id;
-        }
-    }
-    next_user_id = current_max_id + 1; // Set next_user_id correctly
-
-    // Reverse the temporary list to maintain original order 
-    user_list = NULL;
-    User *current_temp = temp_user_list;
-    while(current_temp != NULL) {
-        User *node_to_move = current_temp;
-        current_temp = current_temp->next;
-
-        node_to_move->next = user_list;
-        user_list = node_to_move;
-    }
-
-    fclose(file);
-    
-}
-
-
-// --- Memory Freeing Functions ---
-
-// Helper function to free BST nodes recursively
-void free_bst_nodes(TreeNode *root) {
-    if (root != NULL) {
-        free_bst_nodes(root->left);
-        free_bst_nodes(root->right);
-        free(root); // Free the TreeNode itself
-    }
-}
-
-// Function to free all books from the hash table and BST
-void free_all_books() {
-    for (int i = 0; i < HASH_TABLE_SIZE; i++) {
-        Book *current = hash_table[i];
-        while (current != NULL) {
-            Book *temp = current;
-            current = current->next;
-            free(temp); // Free the Book structure
-        }
-        hash_table[i] = NULL; // Reset the hash table entry
-    }
-    free_bst_nodes(title_bst_root); // Free BST nodes
-    title_bst_root = NULL; // Reset BST root
-    printf("All book data freed from memory.\n");
-}
-
-// Function to free all users from the linked list
-void free_all_users() {
-    User *current = user_list;
-    while (current != NULL) {
-        User *temp = current;
-        current = current->next;
-        free(temp); // Free the User structure
-    }
-    user_list = NULL; // Reset the user list head
-    printf("All user data freed from memory.\n");
-}
\ No newline at end of file
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <stdint.h>
+#include <limits.h>
+#include <math.h>
+#include <time.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <linux/perf_event.h>
+
+#define MAX_TITLE_LENGTH 100
+#define MAX_AUTHOR_LENGTH 50
+#define MAX_GENRE_LENGTH 30
+#define MAX_ISBN_LENGTH 20
+#define MAX_NAME_LENGTH 50
+#define MAX_BARCODE_LENGTH 32
+#define HASH_TABLE_INITIAL_SIZE 128 // Power of two; the ISBN index doubles when titles exceed buckets
+#define LEGACY_HASH_BUCKETS 101 // Fixed table size before the index became resizable
+#define MAX_USERS 100 // Defined but not strictly enforced by linked list size
+#define MAX_BOOKS 500 // Defined but not strictly enforced by hash table size
+#define MAX_BORROWED 10
+#define MAX_BATCH_ITEMS MAX_BORROWED // Items in one kiosk transaction
+#define LOAN_PERIOD_DAYS 14
+#define SECONDS_PER_HOUR 3600
+#define SECONDS_PER_DAY 86400
+#define WHEEL_HOUR_SLOTS 256 // Hour-granularity slots (~10 days ahead)
+#define WHEEL_DAY_SLOTS 256  // Day-granularity slots (~8 months ahead)
+#define HISTORY_SEGMENT_CAPACITY 65536 // Events per history segment
+#define HISTORY_MAX_MONTHS 240 // Longest range the monthly history report covers
+#define MAX_GENRES 256 // Distinct genres tracked by history reports
+#define TREND_DAYS 30 // Daily popularity buckets kept per book
+#define TREND_TOP_N 10 // Entries shown in trending reports
+#define MOST_BORROWED_TOP_N 10 // Entries shown in the most borrowed report
+#define FINE_CLASS_STANDARD 0
+#define FINE_CLASS_HIGH_DEMAND 1 // Titles that had holds waiting when issued
+#define FINE_RATE_STANDARD_CENTS 25 // Per full day late
+#define FINE_RATE_HIGH_DEMAND_CENTS 100
+#define FINE_CAP_CENTS 2000 // Maximum fine per loan
+#define MAX_FINE_THREADS 16
+#define READ_FILTER_MIN_WORDS 4 // 256 bits; the filter doubles as the reading history grows
+#define READ_FILTER_BITS_PER_TITLE 16 // ~1.4% false positives with two probes
+#define COOCCUR_SLOTS 32 // Co-borrowed titles tracked per book
+#define COOCCUR_TOP_N 10 // Recommendations shown per book
+#define SCHED_MAX_JOBS 16
+#define SCHED_WORKERS 2
+#define CHECKPOINT_INTERVAL_SEC 300
+#define OVERDUE_SWEEP_INTERVAL_SEC 60
+#define STATS_ROLLUP_INTERVAL_SEC 60
+#define STATS_ROLLUP_CHUNK 4096 // Books scanned between yield checks
+#define OVERDUE_SWEEP_CHUNK 4096 // Loans counted between yield checks
+#define FINE_MERGE_CHUNK 4096 // Users given their fines between yield checks
+#define CHECKPOINT_FILES 4 // books, users, holds, history
+#define CHECKPOINT_CHUNK 4096 // Records serialized between yield checks
+#define CHECKPOINT_MAX_RESTARTS 3 // Then the checkpoint finishes without yielding
+#define LATENCY_LINEAR_BUCKETS 64 // Exact 1 ns buckets below 64 ns
+#define LATENCY_SUB_BUCKETS 32    // Buckets per power of two above that (~3% resolution)
+#define LATENCY_MAX_EXPONENT 42   // ~73 minutes; anything slower lands in the last bucket
+#define LATENCY_BUCKETS (LATENCY_LINEAR_BUCKETS + (LATENCY_MAX_EXPONENT - 5) * LATENCY_SUB_BUCKETS)
+#define SLOW_LOG_ENTRIES 64 // Slow operations kept; the oldest is overwritten
+#define SLOW_LOG_DEFAULT_MS 100
+#define SLOW_LOG_ARG_LENGTH 64
+#define PERF_COUNTERS 4 // cycles, instructions, cache misses, branch misses
+#define METRICS_INTERVAL_SEC 15 // How often the metrics file is rewritten
+#define METRICS_POLL_MS 250 // Longest the exporter sleeps before checking for shutdown
+#define CAPTURE_MAGIC "LIBCAP01" // Capture file header, followed by the start wall time
+#define CAPTURE_MAX_STRINGS 16 // String arguments per captured operation
+#define CAPTURE_STRING_LENGTH 255
+#define IMPORT_CHUNK_BYTES (16 << 20) // Import file read size; each read is parsed across threads
+#define IMPORT_MAX_THREADS 16
+#define IMPORT_MAX_FIELDS 5 // ISBN, title, author, genre, copies
+#define IMPORT_MAX_COPIES 1000
+#define IMPORT_ERRORS_SHOWN 10 // Rejected lines listed per import
+#define IMPORT_REBUILD_RATIO 16 // Imports smaller than 1/16 of the catalog insert titles one by one
+#define IMPORT_PREFETCH_DISTANCE 8 // Records ahead whose ISBN bucket the merge prefetches
+#define CHAIN_HISTOGRAM_MAX 16 // Longer chains share the last histogram row
+#define STARTUP_MAX_PHASES 16
+#define TRACE_RING_EVENTS 65536 // Per thread; the oldest events are overwritten when full
+#define BENCH_MAX_SIZES 8
+#define BENCH_DEFAULT_MIN_TIME_MS 200 // Minimum measured time per operation
+#define BENCH_SORTED_BST_LIMIT 20000 // Sorted inserts degenerate the BST, so they are capped
+#define BENCH_MISS_KEYS 4096 // Pre-built ISBNs that are not in the catalog
+#define BENCH_MAX_RESULTS 4096 // Results kept from a baseline file or a comparison run
+#define BENCH_DEFAULT_COMPARE_RUNS 5 // Suite repetitions when comparing against a baseline
+#define BENCH_DEFAULT_THRESHOLD_PCT 5.0 // Slowdown a comparison tolerates before failing
+#define BENCH_ALLOC_SLACK 0.05 // Allocs/op a result may exceed its baseline by before it fails
+#define WORKLOAD_DEFAULT_SIZE 100000
+#define WORKLOAD_DEFAULT_DURATION_MS 3000
+#define WORKLOAD_DEFAULT_SKEW 0.99
+#define WORKLOAD_DEFAULT_MIX "isbn=500,title=300,author=152,issue=20,return=20,add=4,remove=4" // ~20 searches per mutation
+
+// Define structures
+
+struct Hold;
+
+// Copy status values
+#define COPY_ON_SHELF 0
+#define COPY_ON_LOAN 1
+
+// Physical copy of a title
+typedef struct BookCopy {
+    char barcode[MAX_BARCODE_LENGTH];
+    int status;    // COPY_ON_SHELF or COPY_ON_LOAN
+    int holder_id; // ID of the user holding the copy, 0 when on the shelf
+    int next_free; // Next on-shelf copy in the free stack, -1 terminates
+} BookCopy;
+
+// Co-occurrence counter: how many patrons borrowed both this title and `ordinal`
+typedef struct CooccurEntry {
+    uint32_t ordinal;
+    uint32_t count;
+} CooccurEntry;
+
+// Book structure (one record per title/ISBN)
+typedef struct Book {
+    char isbn[MAX_ISBN_LENGTH];
+    char title[MAX_TITLE_LENGTH];
+    char author[MAX_AUTHOR_LENGTH];
+    char genre[MAX_GENRE_LENGTH];
+    int available; // Number of copies on the shelf
+    int copy_count; // Total number of copies
+    int copy_capacity;
+    int free_copy; // Head of the stack of on-shelf copies, -1 when none
+    BookCopy *copies; // Per-copy state, copy_count entries
+    int borrow_count; // For tracking popularity
+    int ordinal; // Stable small integer ID used by the loan history
+    uint16_t trend_buckets[TREND_DAYS]; // Issues per day, ring indexed by day % TREND_DAYS
+    int trend_day; // Day number of the newest bucket
+    CooccurEntry *cooccur; // Up to COOCCUR_SLOTS co-borrowed titles, allocated on first use
+    int cooccur_count;
+    struct Hold *hold_head; // FIFO queue of patrons waiting for this book
+    struct Hold *hold_tail;
+    int hold_count;
+    struct Book *next; // For hash table collision handling via chaining
+} Book;
+
+struct User;
+struct LoanList;
+
+// Loan structure, one per borrowed book, linked into the due-date timing wheel
+typedef struct Loan {
+    struct User *user;
+    Book *book;
+    int copy_index; // Index into book->copies, -1 if the copy is unknown
+    char isbn[MAX_ISBN_LENGTH];
+    time_t issue_time;
+    time_t due_time;
+    int rate_class; // FINE_CLASS_* used when assessing late fees
+    int active_index; // Slot in the dense active-loan arrays
+    struct LoanList *bucket; // Wheel bucket currently holding this loan
+    struct Loan *prev;
+    struct Loan *next;
+} Loan;
+
+// Doubly linked list of loans (one per timing wheel bucket)
+typedef struct LoanList {
+    Loan *head;
+    Loan *tail;
+    int count;
+} LoanList;
+
+// User structure
+typedef struct User {
+    int id;
+    char name[MAX_NAME_LENGTH];
+    char borrowed_books[MAX_BORROWED][MAX_ISBN_LENGTH]; // Queue implementation for borrowed books
+    Loan *loans[MAX_BORROWED]; // Loan records, parallel to borrowed_books
+    int borrowed_count;
+    struct Hold *holds; // Holds placed by this user, across all books
+    int hold_count;
+    uint8_t *read_history; // Distinct book ordinals ever borrowed, sorted, as varint-encoded gaps
+    int read_history_bytes;
+    int read_history_capacity;
+    int read_count; // Number of distinct titles in read_history
+    uint64_t *read_filter; // Bloom filter over read_history ordinals, NULL until the first title
+    int read_filter_words; // Power of two, at least READ_FILTER_BITS_PER_TITLE bits per title
+    long fine_cents; // Fines from the last assessment run
+    int overdue_count; // Overdue loans in the last assessment run
+    struct User *next; // For linked list implementation
+} User;
+
+// Hold structure, linked into both the book's queue and the user's hold list
+typedef struct Hold {
+    User *user;
+    Book *book;
+    time_t placed_time;
+    struct Hold *prev_in_book;
+    struct Hold *next_in_book;
+    struct Hold *prev_in_user;
+    struct Hold *next_in_user;
+} Hold;
+
+// Engine status codes: core operations report outcomes and the menus render them
+#define ENGINE_OK 0
+#define ENGINE_NO_MEMORY 1
+#define ENGINE_BOOK_EXISTS 2
+#define ENGINE_BOOK_NOT_FOUND 3
+#define ENGINE_USER_NOT_FOUND 4
+#define ENGINE_COPIES_ON_LOAN 5 // A title with copies out cannot be removed
+#define ENGINE_USER_HAS_LOANS 6
+#define ENGINE_NONE_AVAILABLE 7
+#define ENGINE_ALREADY_BORROWED 8
+#define ENGINE_BORROW_LIMIT 9
+#define ENGINE_NOT_BORROWED 10
+#define ENGINE_COPIES_AVAILABLE 11 // Holds are only for titles with no copy on the shelf
+#define ENGINE_ALREADY_HELD 12
+#define ENGINE_NO_HOLD 13
+#define ENGINE_BAD_BATCH_SIZE 14
+#define ENGINE_BATCH_REJECTED 15 // item_status says what was wrong with each item
+#define ENGINE_SCANNED_TWICE 16 // Batch items only
+
+// What a core operation did; only the fields the operation sets are meaningful
+typedef struct EngineResult {
+    int status; // ENGINE_*
+    Book *book; // Title acted on (NULL after a removal)
+    User *user;
+    Loan *loan; // Loan created by an issue
+    int read_before; // Issue: the user had borrowed this title before
+    int count; // Copies added or still on loan, queue position, or batch problems
+    char title[MAX_TITLE_LENGTH]; // Removals keep the name of what they freed
+    char name[MAX_NAME_LENGTH];
+    Loan *served[MAX_BATCH_ITEMS]; // Holds fulfilled by returned copies
+    int served_count;
+    int item_status[MAX_BATCH_ITEMS]; // Batch items, parallel to the ISBNs passed in
+    Book *items[MAX_BATCH_ITEMS];
+    Loan *item_loans[MAX_BATCH_ITEMS];
+    int item_read_before[MAX_BATCH_ITEMS];
+} EngineResult;
+
+// History event types
+#define HISTORY_EVENT_ISSUE 1
+#define HISTORY_EVENT_RETURN 2
+#define HISTORY_DELTA_ESCAPE 0xFFFF // Gap too long for a delta: the time is in wide_times
+
+// Append-only columnar block of loan history events
+typedef struct HistorySegment {
+    int count;
+    int capacity;
+    time_t base_time;         // Timestamp of the first event; later ones are deltas
+    time_t min_time;          // Range of timestamps, for pruning time-range queries
+    time_t max_time;
+    int persisted;            // Events already written to the history file
+    uint16_t *time_deltas;    // Seconds since the previous event in this segment, or HISTORY_DELTA_ESCAPE
+    uint16_t *user_codes;     // Index into user_dict
+    uint32_t *book_ordinals;  // Book::ordinal of the borrowed title
+    uint8_t *event_types;     // HISTORY_EVENT_ISSUE or HISTORY_EVENT_RETURN
+    int *user_dict;           // Distinct user IDs seen in this segment
+    int user_dict_count;
+    int *user_dict_slots;     // Open-addressing map user ID -> code, only while the segment is open
+    time_t *wide_times;       // Timestamps of escaped events, in order
+    int wide_count;
+    int wide_capacity;
+    struct HistorySegment *next;
+} HistorySegment;
+
+struct Job;
+typedef int (*JobFunction)(struct Job *job); // Returns 1 when done, 0 to be resumed after yielding
+
+// Background job and its run statistics
+typedef struct Job {
+    const char *name;
+    JobFunction run;
+    int priority;            // Lower runs first when several jobs are due
+    long period_ms;          // 0 for a one-shot delayed job
+    long budget_ms;          // Run-time budget before the job should yield
+    uint64_t next_run_ns;    // Monotonic time of the next run
+    uint64_t deadline_ns;    // Budget deadline of the current run
+    int cursor;              // Resume point for jobs that work in chunks
+    uint64_t released_ns;    // When the job last let go of the engine lock
+    uint64_t unlocked_ns;    // Time this run spent off the engine lock, not charged to its budget
+    int active;
+    time_t last_run_wall;    // When the last run started (wall clock)
+    uint64_t last_duration_ns;
+    uint64_t max_duration_ns;
+    long run_count;
+    long yield_count;
+    long overrun_count;      // Runs that exceeded their budget
+} Job;
+
+// Catalog totals precomputed by the stats rollup job
+typedef struct CatalogStats {
+    long titles;
+    long copies;
+    long copies_available;
+    long holds;
+    long users;
+    long active_users;
+    time_t computed_at;
+} CatalogStats;
+
+// One fine assessment: the loan arrays it reads, and its outputs
+typedef struct FineRun {
+    int count;
+    int id_range;
+    int threads;
+    time_t now;
+    uint32_t *due_times; // Copies of the active-loan arrays when owned, else the live arrays
+    uint16_t *daily_rates;
+    int32_t *user_ids;
+    int owned;
+    uint32_t *fines;
+    int64_t *totals;  // threads x id_range
+    int32_t *overdue;
+} FineRun;
+
+// A checkpoint serialized into memory across yields, then written out without the engine lock
+typedef struct CheckpointRun {
+    FILE *streams[CHECKPOINT_FILES]; // Memory streams: books, users, holds, history
+    char *data[CHECKPOINT_FILES];
+    size_t lengths[CHECKPOINT_FILES];
+    int stage;             // File being serialized
+    int bucket;            // Next hash bucket (books and holds)
+    User *user;            // Next user
+    long mutations;        // engine_mutation_count when serializing started
+    long resize_count;     // hash_resize_count then
+    int restarts;          // Times a change while yielded forced a fresh start
+    struct HistorySegment *history_last; // Tail segment when history was serialized
+    int history_last_count;              // and its event count then
+    uint64_t started;
+} CheckpointRun;
+
+// Live probe counters for ISBN lookups (updated under the engine lock)
+typedef struct ProbeStats {
+    long hits;
+    long misses;
+    long hit_probes;  // Chain entries compared on successful lookups
+    long miss_probes; // Chain entries compared on failed lookups
+} ProbeStats;
+
+// Full-width string hash used when comparing candidate hash functions
+typedef uint32_t (*HashCandidateFunction)(const char *key);
+
+// One begin ('B') or end ('E') trace event; names are string literals
+typedef struct TraceEvent {
+    uint64_t ts_ns;
+    const char *name;
+    const char *category;
+    char phase;
+} TraceEvent;
+
+// One thread's trace events; only the owner writes, the flush reads after threads stop
+typedef struct TraceRing {
+    TraceEvent events[TRACE_RING_EVENTS];
+    uint64_t written; // Total events written; the ring holds the last TRACE_RING_EVENTS
+    int tid;
+    const char *thread_name;
+    struct TraceRing *next;
+} TraceRing;
+
+// Time and volume for one step of startup
+typedef struct StartupPhase {
+    const char *name;
+    uint64_t ns;
+    uint64_t io_ns;    // Reading files
+    uint64_t index_ns; // Building the hash table and title BST
+    long bytes;
+    long records;
+    uint64_t allocs;
+    uint64_t start_ns;
+    uint64_t start_allocs;
+} StartupPhase;
+
+// Heap allocation counts, kept per thread
+typedef struct AllocCounters {
+    uint64_t allocs; // malloc/calloc calls, plus realloc calls that move or grow a block
+    uint64_t frees;
+    uint64_t bytes;  // Bytes requested
+} AllocCounters;
+
+// Subsystems heap blocks are charged to
+#define ALLOC_CATALOG 0      // Books, copies, ordinal and ISBN indexes
+#define ALLOC_TITLE_INDEX 1  // Title BST nodes
+#define ALLOC_USERS 2
+#define ALLOC_LOANS 3        // Loans, the active-loan arrays and fine scratch
+#define ALLOC_HOLDS 4
+#define ALLOC_HISTORY 5      // History segments and report scratch
+#define ALLOC_READING 6      // Reading histories and co-occurrence tables
+#define ALLOC_LOADING 7      // File buffers and loader scratch
+#define ALLOC_TOOLS 8        // Instrumentation, benchmarks and diagnostics
+#define ALLOC_SUBSYSTEMS 9
+
+// Prefixed to every block so lib_free knows the subsystem and size; 16 bytes keeps malloc's alignment
+typedef struct AllocHeader {
+    uint32_t subsystem;
+    uint32_t reserved;
+    uint64_t size;
+} AllocHeader;
+
+// Process-wide heap totals for one subsystem
+typedef struct SubsystemAllocStats {
+    _Atomic uint64_t allocs;
+    _Atomic uint64_t frees;
+    _Atomic uint64_t bytes;      // Bytes requested
+    _Atomic int64_t live_bytes;  // Requested bytes not yet freed
+} SubsystemAllocStats;
+
+// Engine operations with latency histograms
+#define LATENCY_ADD_BOOK 0
+#define LATENCY_REMOVE_BOOK 1
+#define LATENCY_ADD_COPIES 2
+#define LATENCY_ADD_USER 3
+#define LATENCY_REMOVE_USER 4
+#define LATENCY_ISSUE 5
+#define LATENCY_RETURN 6
+#define LATENCY_PLACE_HOLD 7
+#define LATENCY_CANCEL_HOLD 8
+#define LATENCY_KIOSK_CHECKOUT 9
+#define LATENCY_KIOSK_RETURN 10
+#define LATENCY_SEARCH_ISBN 11
+#define LATENCY_SEARCH_TITLE 12
+#define LATENCY_SEARCH_AUTHOR 13
+#define LATENCY_OPS 14
+
+// One thread's latency histograms; only the owning thread writes, readers merge all threads
+typedef struct LatencyRecorder {
+    _Atomic uint64_t counts[LATENCY_OPS][LATENCY_BUCKETS];
+    _Atomic uint64_t total_ns[LATENCY_OPS];
+    _Atomic uint64_t max_ns[LATENCY_OPS];
+    _Atomic uint64_t allocs[LATENCY_OPS]; // Heap calls made while the operation ran
+    _Atomic uint64_t frees[LATENCY_OPS];
+    _Atomic uint64_t bytes[LATENCY_OPS];
+    struct LatencyRecorder *next;
+} LatencyRecorder;
+
+// Histogram for one operation merged across threads
+typedef struct LatencySummary {
+    uint64_t count;
+    uint64_t total_ns;
+    uint64_t max_ns;
+    uint64_t allocs;
+    uint64_t frees;
+    uint64_t bytes;
+    uint64_t counts[LATENCY_BUCKETS];
+} LatencySummary;
+
+// One operation's result from one benchmark run
+typedef struct BenchResult {
+    long size;
+    char op[48];
+    double ns_per_op;
+    double allocs_per_op;
+} BenchResult;
+
+// Samples of one (size, op) summarised for comparison
+typedef struct BenchSamples {
+    int n;
+    double mean;
+    double variance; // Sample variance, 0 with fewer than two samples
+} BenchSamples;
+
+// Code regions measured with hardware counters
+#define PERF_SEARCH_ISBN 0
+#define PERF_SEARCH_TITLE 1
+#define PERF_FIND_USER 2
+#define PERF_REPORT_ALL_BOOKS 3
+#define PERF_REPORT_AVAILABLE 4
+#define PERF_REPORT_BORROWED 5
+#define PERF_REPORT_MOST_BORROWED 6
+#define PERF_REPORT_ACTIVE_USERS 7
+#define PERF_REPORT_OVERDUE 8
+#define PERF_REPORT_DUE_SOON 9
+#define PERF_REPORT_MONTHLY_GENRE 10
+#define PERF_REPORT_TRENDING 11
+#define PERF_OPS 12
+
+// One reading of the counter group, in perf_counter_names order
+typedef struct PerfSample {
+    uint64_t values[PERF_COUNTERS];
+} PerfSample;
+
+// Counter totals for one region, summed over every thread that measured it
+typedef struct PerfOpStats {
+    _Atomic uint64_t calls;
+    _Atomic uint64_t totals[PERF_COUNTERS];
+} PerfOpStats;
+
+// One captured engine operation as read back for replay
+typedef struct CaptureRecord {
+    uint64_t offset_ns; // Since the capture started
+    int32_t number;     // User ID, copy count or -1
+    uint8_t op;         // LATENCY_* operation
+    int string_count;   // ISBN, title, author, genre, name or scanned ISBNs
+    char strings[CAPTURE_MAX_STRINGS][CAPTURE_STRING_LENGTH + 1];
+} CaptureRecord;
+
+// Title with 8 of its bytes packed big-endian for sorting
+typedef struct TitleSortKey {
+    uint64_t key;
+    Book *book;
+} TitleSortKey;
+
+// A parsed import record with the keys its indexes need, computed by the parsing thread
+typedef struct ImportRecord {
+    Book *book;
+    uint64_t hash; // hash_isbn; the merge only masks it to a bucket
+    uint64_t title_key; // title_prefix_key of the first 8 bytes
+} ImportRecord;
+
+// One import thread's share of a chunk: the lines in [begin, end) become ready-to-link records
+typedef struct ImportWorker {
+    char *begin;
+    char *end;
+    char separator; // ',' (quoted fields allowed) or '\t'
+    int default_copies;
+    ImportRecord *records; // In file order; the array is reused across chunks
+    long count;
+    long capacity;
+    long lines;
+    long malformed;
+    long bad_isbn;
+    long no_memory;
+    int error_count;
+    long error_lines[IMPORT_ERRORS_SHOWN]; // Line numbers within the slice
+    const char *error_reasons[IMPORT_ERRORS_SHOWN];
+} ImportWorker;
+
+// State and totals for one import
+typedef struct ImportRun {
+    int first_ordinal; // Titles at or above it came from this import
+    TitleSortKey *added; // Linked so far, for the title index build at the end
+    long added_count;
+    long added_capacity;
+    long lines;
+    long malformed;
+    long bad_isbn;
+    long duplicates; // ISBN already in the catalog
+    long repeated;   // ISBN seen earlier in the file
+    long no_memory;
+    long bytes;
+    uint64_t read_ns;
+    uint64_t parse_ns;
+    uint64_t merge_ns;
+    uint64_t index_ns;
+    int errors_shown;
+} ImportRun;
+
+// Engine state copied out under the engine lock so the metrics exporter can read it without the lock
+typedef struct MetricsGauges {
+    _Atomic long titles;
+    _Atomic long users;
+    _Atomic long active_loans;
+    _Atomic long history_events;
+    _Atomic long index_buckets;
+    _Atomic long index_resizes;
+} MetricsGauges;
+
+// One engine operation that ran past the slow-log threshold, with the context at the time
+typedef struct SlowOpEntry {
+    time_t when;
+    int op;
+    const char *thread_name;
+    char text_arg[SLOW_LOG_ARG_LENGTH];
+    long number_arg;
+    uint64_t total_ns;      // Lock wait plus execution
+    uint64_t lock_wait_ns;  // Waiting for the engine after the operator pressed Enter
+    uint64_t rehash_ns;     // Growing the ISBN index during the operation
+    uint64_t allocs;
+    uint64_t alloc_bytes;
+    char waited_on[24];     // Background job holding the engine when the wait began, "" if none
+    int save_running;       // A checkpoint save held the engine when the wait began
+    int rehashed;           // The ISBN index grew during the operation
+    long titles;            // Index statistics when the operation finished
+    int buckets;
+    long resizes;
+    double probes_per_hit;
+    int active_loans;
+} SlowOpEntry;
+
+// State shared by the benchmark operations for one catalog size
+typedef struct BenchContext {
+    long size;
+    Book **books;        // Catalog in creation order
+    Book **sorted_books; // Catalog in title order
+    int *user_ids;
+    long user_count;
+    char (*miss_isbns)[MAX_ISBN_LENGTH];
+    char (*miss_titles)[MAX_TITLE_LENGTH]; // Sort among real titles, so misses walk the full depth
+    long issued;         // Loans made by the issue benchmark, undone by the return benchmark
+    long inserted;       // Extra titles added by the insert benchmark
+    uint64_t rng;
+    uint64_t min_time_ns;
+    const char *only_ops; // Comma-separated filter, NULL runs everything
+    int csv;
+    FILE *out;
+    BenchResult *baseline;   // Previous run, NULL when not checking
+    int baseline_count;
+    double alloc_tolerance;  // Allowed growth over the baseline, as a fraction
+    int alloc_checked;
+    int alloc_regressions;
+    int run;                 // Repetition of the suite, from 0
+    int compare;             // Collect results for a diff instead of printing them
+    BenchResult *results;
+    int result_count;
+    int perf;                // Read hardware counters around each measured batch
+} BenchContext;
+
+typedef void (*BenchOp)(BenchContext *ctx, long i);
+
+// Operation types a workload mixes
+#define WORKLOAD_SEARCH_ISBN 0
+#define WORKLOAD_SEARCH_TITLE 1
+#define WORKLOAD_SEARCH_AUTHOR 2
+#define WORKLOAD_ISSUE 3
+#define WORKLOAD_RETURN 4
+#define WORKLOAD_ADD 5
+#define WORKLOAD_REMOVE 6
+#define WORKLOAD_OP_TYPES 7
+
+// Latency samples for one operation type
+typedef struct WorkloadOpStats {
+    long count;
+    long ok;          // Calls the engine reported as successful
+    uint32_t *samples; // Nanoseconds per call
+    long capacity;
+    uint64_t total_ns;
+} WorkloadOpStats;
+
+// Zipf-skewed operation mix driven against the in-process engine
+typedef struct Workload {
+    int weights[WORKLOAD_OP_TYPES];
+    int weight_total;
+    double *zipf_cdf;   // Cumulative popularity by rank
+    Book **by_rank;     // Catalog shuffled so popularity is unrelated to ISBN order
+    long rank_count;
+    char (*added)[MAX_ISBN_LENGTH]; // Titles added by the workload, removed newest first
+    long added_count;
+    long added_capacity;
+    long next_added;
+    WorkloadOpStats stats[WORKLOAD_OP_TYPES];
+} Workload;
+
+// Binary Search Tree Node for efficient book lookup
+typedef struct TreeNode {
+    Book *book; // Pointer to a Book in the hash table
+    struct TreeNode *left;
+    struct TreeNode *right;
+} TreeNode;
+
+// Global variables
+Book *hash_initial_buckets[HASH_TABLE_INITIAL_SIZE]; // Used until the first resize
+Book **hash_table = hash_initial_buckets; // Hash table for books, hash_capacity chains
+int hash_capacity = HASH_TABLE_INITIAL_SIZE;
+long hash_count = 0; // Titles in the hash table
+long hash_resize_count = 0;
+uint64_t hash_seed[2]; // Per-process SipHash key, so bucket placement can't be predicted
+User *user_list = NULL; // Linked list for users
+long registered_users = 0; // Users in user_list
+TreeNode *title_bst_root = NULL; // BST for book lookup by title
+int next_user_id = 1001; // Starting ID for users
+int next_book_ordinal = 1; // Next ordinal handed to a new title
+Book **book_by_ordinal = NULL; // Titles indexed by ordinal (NULL once removed)
+int book_ordinal_capacity = 0;
+ProbeStats isbn_probe_stats;
+
+// Columnar loan history
+HistorySegment *history_head = NULL;
+HistorySegment *history_tail = NULL; // Open segment receiving appends
+long history_event_count = 0;
+
+// Hierarchical timing wheel for loan due dates
+LoanList wheel_hours[WHEEL_HOUR_SLOTS]; // Loans due within the next WHEEL_HOUR_SLOTS hours
+LoanList wheel_days[WHEEL_DAY_SLOTS];   // Loans due within the next WHEEL_DAY_SLOTS days
+LoanList wheel_far;                     // Loans due beyond the day wheel's horizon
+LoanList overdue_loans;                 // Loans whose due hour has passed, in due order
+long wheel_current_hour = -1;           // Hour the wheel has advanced to (-1 until first use)
+
+// Dense, structure-of-arrays copy of every active loan for batch jobs
+uint32_t *active_due_times = NULL;   // Due time (seconds since the epoch)
+uint16_t *active_daily_rates = NULL; // Fine in cents per full day late
+int32_t *active_user_ids = NULL;
+Loan **active_loans = NULL;          // Back-pointers for swap-removal
+int active_loan_count = 0;
+int active_loan_capacity = 0;
+time_t last_fine_assessment = 0;
+
+// Engine lock: held by the menu thread except while it waits for input
+pthread_mutex_t engine_mutex = PTHREAD_MUTEX_INITIALIZER;
+atomic_int circulation_waiting = 0; // Set while the menu thread wants the lock back
+_Atomic(const char *) engine_job_running = NULL; // Name of the background job holding the engine
+atomic_int save_in_progress = 0;
+_Thread_local uint64_t input_lock_wait_ns = 0; // Last wait to retake the engine after input
+_Thread_local const char *input_lock_holder = NULL;
+_Thread_local int input_wait_saw_save = 0;
+_Thread_local uint64_t thread_rehash_ns = 0; // Time this thread spent growing the ISBN index
+
+// Background job scheduler (timer queue is a min-heap on next_run_ns)
+Job sched_jobs[SCHED_MAX_JOBS];
+int sched_job_count = 0;
+Job *sched_heap[SCHED_MAX_JOBS];
+int sched_heap_size = 0;
+pthread_mutex_t sched_mutex = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t sched_cond;
+pthread_t sched_threads[SCHED_WORKERS];
+int sched_thread_count = 0;
+int sched_stopping = 0;
+long overdue_loan_count = 0; // Maintained by the overdue sweep job
+Loan *overdue_sweep_next = NULL; // Next loan a yielded sweep counts; unlinking it moves this on
+long overdue_sweep_hour = -1;    // Wheel hour whose slot the sweep is counting
+long overdue_sweep_late = 0;     // Late loans counted so far in that slot
+FineRun fine_job_run;            // Assessment the nightly job is merging into users
+CheckpointRun checkpoint_run;    // Checkpoint the job is serializing
+long engine_mutation_count = 0;  // Engine operations that may have changed saved state
+User *fine_merge_next = NULL;    // Next user the yielded merge updates; removing it moves this on
+CatalogStats catalog_stats;
+CatalogStats catalog_stats_partial; // Rollup in progress
+long stats_rollup_resize_count = 0; // hash_resize_count when the rollup in progress started
+_Thread_local AllocCounters alloc_counters; // Heap calls made by the current thread
+_Thread_local AllocCounters op_alloc_start[LATENCY_OPS]; // alloc_counters when each operation began
+SubsystemAllocStats subsystem_allocs[ALLOC_SUBSYSTEMS];
+const char *alloc_subsystem_names[ALLOC_SUBSYSTEMS] = {
+    "catalog", "title_index", "users", "loans", "holds", "history", "reading", "loading", "tools"
+};
+int trace_enabled = 0; // Set once at startup by --trace
+uint64_t trace_start_ns = 0;
+TraceRing *trace_rings = NULL;
+int trace_ring_count = 0;
+pthread_mutex_t trace_mutex = PTHREAD_MUTEX_INITIALIZER;
+_Thread_local TraceRing *trace_local = NULL;
+_Thread_local const char *trace_local_name = "menu";
+StartupPhase startup_phases[STARTUP_MAX_PHASES];
+int startup_phase_count = 0;
+StartupPhase *startup_current = NULL; // Phase loaders report into, NULL outside startup
+LatencyRecorder *latency_recorders = NULL; // Every thread that has recorded a latency
+pthread_mutex_t latency_mutex = PTHREAD_MUTEX_INITIALIZER;
+_Thread_local LatencyRecorder *latency_local = NULL;
+_Thread_local const char *op_text_arg = NULL; // Arguments of the running operation, for the slow log
+_Thread_local long op_number_arg = -1;
+_Thread_local uint64_t op_rehash_start_ns = 0;
+_Thread_local long op_resize_start = 0;
+int perf_enabled = 0; // Per-call regions are measured (--perf-counters and the counters opened)
+int perf_available[PERF_COUNTERS]; // Counters the hardware (or hypervisor) supports
+PerfOpStats perf_stats[PERF_OPS];
+_Thread_local int perf_group_fd = -1;
+_Thread_local int perf_group_slots[PERF_COUNTERS]; // Position of each counter in a group read, -1 if absent
+_Thread_local int perf_group_size = 0;
+_Thread_local PerfSample perf_start_samples[PERF_OPS];
+MetricsGauges metrics_gauges;
+_Atomic uint64_t save_count = 0;
+_Atomic uint64_t save_total_ns = 0;
+_Atomic uint64_t save_last_ns = 0;
+_Atomic int64_t save_last_completed = 0; // Wall-clock seconds, 0 before the first save
+time_t process_start_time = 0;
+const char *metrics_file = NULL;  // --metrics-file: rewritten every METRICS_INTERVAL_SEC
+int metrics_listen_fd = -1;       // --metrics-port: HTTP on 127.0.0.1
+pthread_t metrics_thread;
+int metrics_running = 0;
+atomic_int metrics_stopping = 0;
+FILE *capture_file = NULL; // --capture: every engine operation is appended here
+uint64_t capture_start_ns = 0;
+long capture_count = 0;
+_Thread_local const char *op_extra_args[CAPTURE_MAX_STRINGS]; // Strings beyond the text argument, for capture
+_Thread_local int op_extra_count = 0;
+time_t engine_clock_pin = 0; // Replay fixes the engine's wall clock to each operation's recorded time
+SlowOpEntry slow_log[SLOW_LOG_ENTRIES];
+long slow_log_total = 0; // Entries ever recorded; the newest is at (total - 1) % SLOW_LOG_ENTRIES
+pthread_mutex_t slow_log_mutex = PTHREAD_MUTEX_INITIALIZER;
+uint64_t slow_op_threshold_ns = (uint64_t)SLOW_LOG_DEFAULT_MS * 1000000ULL;
+volatile unsigned long bench_sink = 0; // Keeps benchmarked results from being optimized away
+
+// Function prototypes
+
+// Allocation functions (counted wrappers around the C allocator)
+void* lib_malloc(int subsystem, size_t size);
+void* lib_calloc(int subsystem, size_t count, size_t size);
+void* lib_realloc(int subsystem, void *ptr, size_t size);
+void lib_free(void *ptr);
+void alloc_account(int subsystem, int64_t allocs, int64_t frees, int64_t bytes, int64_t live_delta);
+void list_subsystem_allocations();
+
+// Hash table functions
+unsigned int hash_function(char *isbn);
+void hash_seed_init();
+uint64_t hash_siphash13(const char *key, size_t length, uint64_t k0, uint64_t k1);
+uint64_t hash_isbn(const char *isbn);
+int hash_table_grow(int new_capacity);
+int hash_table_reserve(long titles);
+uint32_t hash_poly31(const char *key);
+int insert_book(Book *new_book, EngineResult *result);
+int link_book(Book *book);
+Book* search_book_by_isbn(char *isbn);
+int remove_book(char *isbn, EngineResult *result);
+
+// Book ordinal functions
+int register_book_ordinal(Book *book);
+void unregister_book_ordinal(Book *book);
+
+// Copy inventory functions
+int add_copies(Book *book, int count);
+void format_barcode(char *out, const char *isbn, int number);
+int add_book_copies(char *isbn, int count, EngineResult *result);
+int claim_copy(Book *book, int holder_id);
+void release_copy(Book *book, int copy_index);
+int attach_loaded_copy(Book *book, int holder_id);
+void rebuild_free_copies(Book *book);
+
+// User linked list functions
+int add_user(char *name, EngineResult *result);
+User* find_user(int id);
+int remove_user(int id, EngineResult *result);
+
+// BST functions
+int insert_into_bst(Book *book);
+void bst_attach_node(TreeNode *new_node);
+void bst_free_chain(TreeNode *chain);
+void remove_from_bst(Book *book);
+TreeNode* create_tree_node(Book *book);
+TreeNode* search_by_title(TreeNode *root, char *title);
+TreeNode* title_bst_find(TreeNode *root, char *title);
+void inorder_traversal(TreeNode *root);
+
+// Issue & Return functions
+int engine_result(EngineResult *result, int status);
+int issue_book(int user_id, char *isbn, EngineResult *result);
+int return_book(int user_id, char *isbn, EngineResult *result);
+Loan* checkout_book(User *user, Book *book);
+void checkout_into(User *user, Book *book, Loan *loan, time_t now);
+void checkin_loan(User *user, int loan_index);
+int issue_books_batch(int user_id, char isbns[][MAX_ISBN_LENGTH], int count, EngineResult *result);
+int return_books_batch(int user_id, char isbns[][MAX_ISBN_LENGTH], int count, EngineResult *result);
+
+// Loan timing wheel functions
+Loan* create_loan(User *user, Book *book, time_t issue_time, time_t due_time);
+void init_loan(Loan *loan, User *user, Book *book, time_t issue_time, time_t due_time);
+void cancel_loan(Loan *loan);
+void loan_list_append(LoanList *list, Loan *loan);
+void loan_list_unlink(Loan *loan);
+void wheel_place(Loan *loan);
+void wheel_replace_bucket(LoanList *list);
+void wheel_advance(time_t now);
+
+// Active loan array and fine assessment functions
+int active_loans_reserve(int extra);
+int active_loans_add(Loan *loan);
+void active_loans_remove(Loan *loan);
+void compute_fines(const uint32_t *restrict due_times, const uint16_t *restrict daily_rates,
+                   uint32_t *restrict fines, int count, uint32_t now);
+void* fine_worker_run(void *arg);
+int fine_run_begin(FineRun *run, time_t now, int snapshot);
+void fine_run_compute(FineRun *run);
+long fine_run_merge_user(FineRun *run, User *user);
+void fine_run_end(FineRun *run);
+long assess_overdue_fines(time_t now);
+void list_fine_summary();
+
+// Engine lock and scheduler functions
+void engine_lock();
+void engine_unlock();
+void engine_unlock_for_input();
+void engine_relock_after_input();
+int job_should_yield(Job *job);
+void job_release_engine(Job *job);
+void job_reacquire_engine(Job *job);
+uint64_t monotonic_ns();
+time_t engine_now();
+Job* schedule_job(const char *name, JobFunction run, int priority, long delay_ms, long period_ms, long budget_ms);
+int sched_job_before(Job *a, Job *b);
+void sched_heap_push(Job *job);
+Job* sched_heap_pop();
+void* sched_worker_run(void *arg);
+void scheduler_start();
+void scheduler_stop();
+void list_background_jobs();
+int job_checkpoint(Job *job);
+void checkpoint_discard(CheckpointRun *run);
+int checkpoint_replace_file(const char *filename, const char *data, size_t length);
+int checkpoint_append_file(const char *filename, const char *data, size_t length);
+int job_overdue_sweep(Job *job);
+int job_fine_assessment(Job *job);
+int job_stats_rollup(Job *job);
+void save_all_data();
+void save_record_time(uint64_t started);
+
+// Hash diagnostics functions
+void list_isbn_index_diagnostics();
+uint32_t hash_djb2(const char *key);
+uint32_t hash_fnv1a(const char *key);
+uint32_t hash_poly31_mixed(const char *key);
+uint32_t hash_isbn_low32(const char *key);
+void hash_evaluate(const char *name, HashCandidateFunction hash, char (*keys)[MAX_ISBN_LENGTH], long count, long buckets);
+int run_hash_evaluation(int argc, char *argv[]);
+
+// Latency histogram functions
+int latency_bucket(uint64_t ns);
+uint64_t latency_bucket_upper(int bucket);
+LatencyRecorder* latency_recorder();
+uint64_t latency_record(int op, uint64_t start_ns);
+void latency_merge(int op, LatencySummary *summary);
+uint64_t latency_percentile(LatencySummary *summary, double quantile);
+void list_operation_latency();
+void dump_latency_histograms(const char *filename);
+void free_latency_recorders();
+uint64_t engine_op_begin(int op, const char *text_arg, long number_arg);
+void engine_op_end(int op, uint64_t started);
+void latency_record_allocs(int op, uint64_t allocs, uint64_t frees, uint64_t bytes);
+
+// Slow operation log functions
+void slow_log_record(int op, uint64_t ns, AllocCounters *used);
+void list_slow_operations();
+
+// Metrics export functions (Prometheus text format)
+void metrics_publish();
+void metrics_family(FILE *out, const char *name, const char *type, const char *help);
+void metrics_render(FILE *out);
+int metrics_write_file(const char *filename);
+void metrics_serve_client();
+void* metrics_run(void *arg);
+int metrics_start(const char *filename, int port);
+void metrics_stop();
+
+// Hardware counter functions (perf_event_open)
+int perf_open_event(uint32_t type, uint64_t config, int group_fd);
+int perf_thread_open();
+int perf_start();
+int perf_read(PerfSample *sample);
+void perf_begin(int op);
+void perf_end(int op);
+void list_perf_counters();
+
+// Trace functions (Chrome trace-event format)
+void trace_start();
+TraceRing* trace_ring();
+void trace_event(const char *name, const char *category, char phase);
+void trace_begin(const char *name, const char *category);
+void trace_end(const char *name, const char *category);
+void trace_set_thread_name(const char *name);
+void trace_flush(const char *filename);
+void free_trace_rings();
+
+// Hold queue functions
+int place_hold(int user_id, char *isbn, EngineResult *result);
+int cancel_hold(int user_id, char *isbn, EngineResult *result);
+Hold* enqueue_hold(User *user, Book *book, time_t placed_time);
+void remove_hold(Hold *hold);
+Hold* find_user_hold(User *user, Book *book);
+int hold_position(Hold *hold);
+void clear_book_holds(Book *book);
+void clear_user_holds(User *user);
+Loan* serve_next_hold(Book *book);
+void list_user_holds(int user_id);
+
+// Loan history functions
+HistorySegment* history_new_segment(time_t base_time, int capacity);
+void history_seal_segment(HistorySegment *segment);
+void* history_shrink_column(void *column, size_t bytes);
+int history_user_code(HistorySegment *segment, int user_id);
+time_t history_event_time(const HistorySegment *segment, int i, time_t t, int *wide);
+int history_reserve(time_t when, int user_id, int events);
+int history_append(time_t when, int user_id, int book_ordinal, int event_type);
+long history_count_events(time_t from, time_t to, int event_type);
+void report_loans_by_month_and_genre(int start_year, int start_month, int end_year, int end_month);
+void save_history_to_file(const char *filename);
+int history_has_unsaved();
+int write_history(FILE *file, int everything);
+int write_history_block(FILE *file, HistorySegment *segment, int start, int n, time_t base, time_t max_time);
+void history_mark_persisted(HistorySegment *last, int last_count);
+void load_history_from_file(const char *filename);
+void free_history();
+
+// Reading history functions
+int user_has_read(User *user, int book_ordinal);
+void read_filter_add(uint64_t *filter, int words, uint32_t ordinal);
+int user_grow_read_filter(User *user, int titles);
+int user_reserve_read(User *user, int titles);
+int user_record_read(User *user, int book_ordinal);
+int encode_varint(uint32_t value, uint8_t *out);
+void rebuild_reading_histories();
+void list_user_reading_history(int user_id);
+
+// Co-occurrence functions
+void cooccur_add(Book *book, uint32_t neighbor_ordinal);
+void cooccur_link_reader(User *user, int book_ordinal);
+void rebuild_cooccurrence();
+int cooccur_top(Book *book, Book **out, uint32_t *counts, int limit);
+
+// Trending functions
+void trend_record(Book *book, time_t when);
+long trend_score(Book *book, int days, long today);
+void rebuild_trending_from_history();
+void list_trending_books(int days);
+
+// Report generation functions
+int list_books_by_author(char *author);
+void list_all_books();
+void list_available_books();
+void list_borrowed_books();
+void list_most_borrowed_books();
+int most_borrowed_before(const Book *a, const Book *b);
+void list_active_users();
+int active_user_compare(const void *a, const void *b);
+void list_overdue_loans();
+void list_loans_due_soon();
+
+// Menu functions
+void display_menu();
+void book_management_menu();
+void user_management_menu();
+void issue_return_menu();
+void search_menu();
+void report_menu();
+void render_result(int op, const char *isbn, int id, EngineResult *result);
+void render_batch_result(int op, int id, char isbns[][MAX_ISBN_LENGTH], int count, EngineResult *result);
+void render_served_holds(EngineResult *result);
+
+// Helper functions
+void read_string(char *buffer, int length);
+void read_isbn(char *buffer);
+int read_int(int *value);
+void clear_input_buffer();
+void format_time(time_t t, char *buffer, size_t length);
+void print_book_details(Book *book);
+
+// File I/O functions for persistence
+void save_books_to_file(const char *filename);
+void write_books(FILE *file);
+void write_book(FILE *file, Book *current);
+void load_books_from_file(const char *filename);
+void save_users_to_file(const char *filename);
+void write_users(FILE *file);
+void write_user(FILE *file, User *current);
+void load_users_from_file(const char *filename);
+void save_holds_to_file(const char *filename);
+void write_holds(FILE *file);
+void write_book_holds(FILE *file, Book *book);
+void load_holds_from_file(const char *filename);
+
+// Startup profiling functions
+char* slurp_file(const char *filename, long *length);
+char* next_buffered_line(char **cursor);
+void startup_phase_begin(const char *name);
+void startup_phase_end();
+int bst_height(TreeNode *root);
+void print_startup_profile();
+void dump_startup_profile(const char *filename);
+
+// Memory freeing functions
+void free_all_books();
+void free_bst_nodes(TreeNode *root); // Helper for freeing BST
+void free_all_users();
+
+// Benchmark functions
+int run_benchmarks(int argc, char *argv[]);
+int bench_parse_sizes(const char *text, long *sizes, int max_sizes);
+uint64_t bench_random(BenchContext *ctx);
+int bench_selected(BenchContext *ctx, const char *name);
+int bench_build_catalog(BenchContext *ctx, long size);
+void bench_collect_titles(TreeNode *root, Book **out, long *count);
+void bench_reset_engine(BenchContext *ctx);
+void bench_run(BenchContext *ctx, const char *name, BenchOp op, long max_iters, long size_used);
+void bench_run_suite(BenchContext *ctx);
+FILE* bench_redirect_output();
+int bench_load_baseline(BenchContext *ctx, const char *filename);
+void bench_check_allocs(BenchContext *ctx, const char *name, double allocs_per_op);
+void bench_samples(BenchResult *results, int count, long size, const char *op, BenchSamples *samples);
+double bench_t_critical(double df);
+int bench_compare(BenchContext *ctx, double threshold);
+
+// Capture and replay functions
+void engine_op_extra(const char *text);
+void capture_snapshot_name(const char *capture, const char *kind, char *out, size_t size);
+int capture_start(const char *filename);
+void capture_write_string(const char *text);
+void capture_record(int op, const char *text, long number);
+void capture_stop();
+int capture_read_record(FILE *file, CaptureRecord *record);
+void replay_execute(CaptureRecord *record);
+int run_replay(int argc, char *argv[]);
+
+// Bulk import functions
+int isbn_normalize(const char *raw, char *out);
+int import_split_fields(char *line, char separator, char **fields, int max);
+void import_copy_field(char *dest, const char *src, int size, const char *fallback);
+void import_reject(ImportWorker *worker, const char *reason);
+void* import_worker_run(void *arg);
+void import_parse_chunk(ImportWorker *workers, int threads, char *data, char *end);
+void import_merge(ImportRun *run, ImportWorker *workers, int threads);
+uint64_t title_prefix_key(const char *title);
+int title_key_compare(const void *a, const void *b);
+void title_sort_run(TitleSortKey *keys, long count, int depth);
+int title_sort(TitleSortKey *keys, long count);
+void bst_run_starts(TreeNode **nodes, long count, long *run_start);
+TreeNode* bst_build_balanced(TreeNode **nodes, const long *run_start, long lo, long hi);
+int title_bst_bulk_insert(TitleSortKey *books, long count);
+int run_import(int argc, char *argv[]);
+
+// Workload generator functions
+int run_workload(int argc, char *argv[]);
+int workload_parse_mix(const char *text, int *weights);
+int workload_zipf_setup(Workload *workload, long size, double skew);
+long workload_zipf_rank(Workload *workload, BenchContext *ctx);
+void workload_record(WorkloadOpStats *stats, uint64_t ns, int ok);
+int workload_compare_u32(const void *a, const void *b);
+void workload_report(Workload *workload, BenchContext *ctx, uint64_t elapsed_ns);
+
+
+// Main function
+int main(int argc, char *argv[]) {
+    int choice;
+
+    hash_seed_init();
+    process_start_time = time(NULL);
+
+    if (argc > 1 && strcmp(argv[1], "--bench") == 0) {
+        return run_benchmarks(argc - 2, argv + 2);
+    }
+    if (argc > 1 && strcmp(argv[1], "--workload") == 0) {
+        return run_workload(argc - 2, argv + 2);
+    }
+    if (argc > 1 && strcmp(argv[1], "--hash-eval") == 0) {
+        return run_hash_evaluation(argc - 2, argv + 2);
+    }
+    if (argc > 1 && strcmp(argv[1], "--replay") == 0) {
+        return run_replay(argc - 2, argv + 2);
+    }
+    if (argc > 1 && strcmp(argv[1], "--import") == 0) {
+        return run_import(argc - 2, argv + 2);
+    }
+
+    // Interactive options: --verbose prints the startup profile, --startup-profile FILE saves it,
+    // --trace FILE records spans and writes them as Chrome trace JSON at exit,
+    // --slow-ms N sets the slow operation log threshold, --perf-counters reads hardware counters,
+    // --metrics-file FILE / --metrics-port N export Prometheus metrics, --capture FILE records operations
+    int verbose = 0;
+    const char *profile_file = NULL;
+    const char *trace_file = NULL;
+    const char *metrics_path = NULL;
+    int metrics_port = 0;
+    const char *capture_path = NULL;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--verbose") == 0) {
+            verbose = 1;
+        } else if (strcmp(argv[i], "--startup-profile") == 0 && i + 1 < argc) {
+            profile_file = argv[++i];
+        } else if (strcmp(argv[i], "--trace") == 0 && i + 1 < argc) {
+            trace_file = argv[++i];
+        } else if (strcmp(argv[i], "--slow-ms") == 0 && i + 1 < argc) {
+            slow_op_threshold_ns = (uint64_t)(atof(argv[++i]) * 1e6);
+        } else if (strcmp(argv[i], "--perf-counters") == 0) {
+            perf_enabled = perf_start();
+        } else if (strcmp(argv[i], "--metrics-file") == 0 && i + 1 < argc) {
+            metrics_path = argv[++i];
+        } else if (strcmp(argv[i], "--metrics-port") == 0 && i + 1 < argc) {
+            metrics_port = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--capture") == 0 && i + 1 < argc) {
+            capture_path = argv[++i];
+        }
+    }
+    if (trace_file != NULL) {
+        trace_start();
+    }
+
+    printf("\n===== Smart Library Management System =====\n");
+
+    // The menu thread owns the engine except while waiting for input
+    engine_lock();
+
+    // Load data at startup, one profiled phase per step
+    startup_phase_begin("load_books");
+    load_books_from_file("books.dat");
+    startup_phase_end();
+    startup_phase_begin("load_users");
+    load_users_from_file("users.dat");
+    startup_phase_end();
+    startup_phase_begin("load_holds");
+    load_holds_from_file("holds.dat");
+    startup_phase_end();
+    startup_phase_begin("load_history");
+    load_history_from_file("history.dat");
+    startup_phase_end();
+    startup_phase_begin("rebuild_trending");
+    rebuild_trending_from_history();
+    startup_phase_end();
+    startup_phase_begin("rebuild_reading_histories");
+    rebuild_reading_histories();
+    startup_phase_end();
+    startup_phase_begin("rebuild_cooccurrence");
+    rebuild_cooccurrence();
+    startup_phase_end();
+    startup_phase_begin("scheduler_start");
+    scheduler_start();
+    startup_phase_end();
+
+    if (verbose) {
+        print_startup_profile();
+    }
+    if (profile_file != NULL) {
+        dump_startup_profile(profile_file);
+    }
+    metrics_publish();
+    if (metrics_path != NULL || metrics_port > 0) {
+        metrics_start(metrics_path, metrics_port);
+    }
+    if (capture_path != NULL) {
+        capture_start(capture_path);
+    }
+
+    do {
+        display_menu();
+        printf("Enter your choice: ");
+        read_int(&choice);
+
+        switch(choice) {
+            case 1:
+                book_management_menu();
+                break;
+            case 2:
+                user_management_menu();
+                break;
+            case 3:
+                issue_return_menu();
+                break;
+            case 4:
+                search_menu();
+                break;
+            case 5:
+                report_menu();
+                break;
+            case 0:
+                printf("Exiting the system. Saving data...\n");
+                scheduler_stop();
+                save_all_data();
+                printf("Data saved. Thank you!\n");
+                break;
+            default:
+                printf("Invalid choice. Please try again.\n");
+        }
+
+    } while(choice != 0);
+
+    metrics_stop();
+    capture_stop();
+    if (trace_file != NULL) {
+        trace_flush(trace_file);
+    }
+
+    // Free allocated memory before exit
+    free_all_books();
+    free_all_users();
+    free_history();
+    lib_free(active_due_times);
+    lib_free(active_daily_rates);
+    lib_free(active_user_ids);
+    lib_free(active_loans);
+    free_latency_recorders();
+    free_trace_rings();
+    engine_unlock();
+
+    return 0;
+}
+
+// --- Allocation Functions ---
+
+// All heap traffic goes through these so benchmarks can report allocations per operation,
+// and every block carries a header charging it to a subsystem
+void alloc_account(int subsystem, int64_t allocs, int64_t frees, int64_t bytes, int64_t live_delta) {
+    SubsystemAllocStats *stats = &subsystem_allocs[subsystem];
+    if (allocs != 0) {
+        atomic_fetch_add_explicit(&stats->allocs, (uint64_t)allocs, memory_order_relaxed);
+    }
+    if (frees != 0) {
+        atomic_fetch_add_explicit(&stats->frees, (uint64_t)frees, memory_order_relaxed);
+    }
+    if (bytes != 0) {
+        atomic_fetch_add_explicit(&stats->bytes, (uint64_t)bytes, memory_order_relaxed);
+    }
+    atomic_fetch_add_explicit(&stats->live_bytes, live_delta, memory_order_relaxed);
+}
+
+void* lib_malloc(int subsystem, size_t size) {
+    if (size > SIZE_MAX - sizeof(AllocHeader)) {
+        return NULL;
+    }
+    AllocHeader *header = (AllocHeader*)malloc(sizeof(AllocHeader) + size);
+    if (header == NULL) {
+        return NULL;
+    }
+    header->subsystem = (uint32_t)subsystem;
+    header->size = size;
+    alloc_counters.allocs++;
+    alloc_counters.bytes += size;
+    alloc_account(subsystem, 1, 0, (int64_t)size, (int64_t)size);
+    return header + 1;
+}
+
+void* lib_calloc(int subsystem, size_t count, size_t size) {
+    if (size != 0 && count > (SIZE_MAX - sizeof(AllocHeader)) / size) {
+        return NULL;
+    }
+    AllocHeader *header = (AllocHeader*)calloc(1, sizeof(AllocHeader) + count * size);
+    if (header == NULL) {
+        return NULL;
+    }
+    header->subsystem = (uint32_t)subsystem;
+    header->size = count * size;
+    alloc_counters.allocs++;
+    alloc_counters.bytes += count * size;
+    alloc_account(subsystem, 1, 0, (int64_t)(count * size), (int64_t)(count * size));
+    return header + 1;
+}
+
+void* lib_realloc(int subsystem, void *ptr, size_t size) {
+    if (ptr == NULL) {
+        return lib_malloc(subsystem, size);
+    }
+    if (size > SIZE_MAX - sizeof(AllocHeader)) {
+        return NULL;
+    }
+    AllocHeader *old_header = (AllocHeader*)ptr - 1;
+    int old_subsystem = (int)old_header->subsystem;
+    uint64_t old_size = old_header->size;
+    AllocHeader *header = (AllocHeader*)realloc(old_header, sizeof(AllocHeader) + size);
+    if (header == NULL) {
+        return NULL; // The old block is untouched
+    }
+    header->subsystem = (uint32_t)subsystem;
+    header->size = size;
+    alloc_counters.allocs++;
+    alloc_counters.frees++; // The old block is released or reused
+    alloc_counters.bytes += size;
+    alloc_account(old_subsystem, 0, 1, 0, -(int64_t)old_size);
+    alloc_account(subsystem, 1, 0, (int64_t)size, (int64_t)size);
+    return header + 1;
+}
+
+void lib_free(void *ptr) {
+    if (ptr == NULL) {
+        return;
+    }
+    AllocHeader *header = (AllocHeader*)ptr - 1;
+    alloc_counters.frees++;
+    alloc_account((int)header->subsystem, 0, 1, 0, -(int64_t)header->size);
+    free(header);
+}
+
+// --- Hash Table Functions ---
+
+// Hash function implementation: seeded SipHash reduced to the power-of-two table
+unsigned int hash_function(char *isbn) {
+    return (unsigned int)(hash_isbn(isbn) & (uint64_t)(hash_capacity - 1));
+}
+
+// Pick the per-process hash key from the OS, falling back to time and PID
+void hash_seed_init() {
+    FILE *random = fopen("/dev/urandom", "rb");
+    if (random == NULL || fread(hash_seed, sizeof(hash_seed), 1, random) != 1) {
+        hash_seed[0] = (uint64_t)time(NULL) * 0x9E3779B97F4A7C15ULL ^ monotonic_ns();
+        hash_seed[1] = ((uint64_t)getpid() << 32) ^ (uint64_t)(uintptr_t)&hash_seed;
+    }
+    if (random != NULL) {
+        fclose(random);
+    }
+}
+
+// One SipHash round over the state v0..v3
+void sip_round(uint64_t *v) {
+    v[0] += v[1]; v[1] = (v[1] << 13) | (v[1] >> 51); v[1] ^= v[0]; v[0] = (v[0] << 32) | (v[0] >> 32);
+    v[2] += v[3]; v[3] = (v[3] << 16) | (v[3] >> 48); v[3] ^= v[2];
+    v[0] += v[3]; v[3] = (v[3] << 21) | (v[3] >> 43); v[3] ^= v[0];
+    v[2] += v[1]; v[1] = (v[1] << 17) | (v[1] >> 47); v[1] ^= v[2]; v[2] = (v[2] << 32) | (v[2] >> 32);
+}
+
+// SipHash-1-3: keyed, so colliding ISBNs can't be crafted without the seed
+uint64_t hash_siphash13(const char *key, size_t length, uint64_t k0, uint64_t k1) {
+    uint64_t v[4] = {k0 ^ 0x736f6d6570736575ULL, k1 ^ 0x646f72616e646f6dULL,
+                     k0 ^ 0x6c7967656e657261ULL, k1 ^ 0x7465646279746573ULL};
+    const unsigned char *bytes = (const unsigned char*)key;
+    size_t full = length & ~(size_t)7;
+    for (size_t i = 0; i < full; i += 8) {
+        uint64_t m;
+        memcpy(&m, bytes + i, sizeof(m)); // Block order only has to be consistent within a process
+        v[3] ^= m;
+        sip_round(v);
+        v[0] ^= m;
+    }
+
+    uint64_t last = (uint64_t)length << 56;
+    for (size_t i = full; i < length; i++) {
+        last |= (uint64_t)bytes[i] << (8 * (i - full));
+    }
+    v[3] ^= last;
+    sip_round(v);
+    v[0] ^= last;
+
+    v[2] ^= 0xff;
+    sip_round(v);
+    sip_round(v);
+    sip_round(v);
+    return v[0] ^ v[1] ^ v[2] ^ v[3];
+}
+
+uint64_t hash_isbn(const char *isbn) {
+    return hash_siphash13(isbn, strlen(isbn), hash_seed[0], hash_seed[1]);
+}
+
+// Rehash every title into a table of new_capacity (a power of two) chains
+int hash_table_grow(int new_capacity) {
+    Book **grown = (Book**)lib_calloc(ALLOC_CATALOG, new_capacity, sizeof(Book*));
+    if (grown == NULL) {
+        return 0;
+    }
+    trace_begin("hash_table_grow", "index");
+    uint64_t grow_started = monotonic_ns();
+
+    Book **old_table = hash_table;
+    int old_capacity = hash_capacity;
+    hash_table = grown;
+    hash_capacity = new_capacity;
+    for (int i = 0; i < old_capacity; i++) {
+        Book *current = old_table[i];
+        while (current != NULL) {
+            Book *next = current->next;
+            unsigned int index = hash_function(current->isbn);
+            current->next = hash_table[index];
+            hash_table[index] = current;
+            current = next;
+        }
+    }
+
+    if (old_table != hash_initial_buckets) {
+        lib_free(old_table);
+    } else {
+        memset(hash_initial_buckets, 0, sizeof(hash_initial_buckets)); // Empty for when free_all_books returns to it
+    }
+    hash_resize_count++;
+    thread_rehash_ns += monotonic_ns() - grow_started;
+    trace_end("hash_table_grow", "index");
+    return 1;
+}
+
+// Size the ISBN index once for a known number of titles instead of doubling through every power of two
+int hash_table_reserve(long titles) {
+    long wanted = hash_capacity;
+    while (wanted < titles && wanted < (1 << 30)) {
+        wanted *= 2;
+    }
+    return wanted > hash_capacity ? hash_table_grow((int)wanted) : 1;
+}
+
+// Polynomial string hash (multiply by 31), before reduction to a bucket
+uint32_t hash_poly31(const char *key) {
+    uint32_t hash = 0;
+    while (*key) {
+        hash = (hash * 31) + (unsigned char)*key++;
+    }
+    return hash;
+}
+
+// Insert a book into the hash table; the book is freed unless it was added
+int insert_book(Book *new_book, EngineResult *result) {
+    engine_result(result, ENGINE_OK);
+    unsigned int index = hash_function(new_book->isbn);
+
+    // Check if book with the same ISBN already exists
+    Book *current = hash_table[index];
+    while (current != NULL) {
+        if (strcmp(current->isbn, new_book->isbn) == 0) {
+            lib_free(new_book->copies);
+            lib_free(new_book); // Free the newly allocated book if it's a duplicate
+            result->book = current;
+            return engine_result(result, ENGINE_BOOK_EXISTS);
+        }
+        current = current->next;
+    }
+
+    if (!link_book(new_book)) {
+        lib_free(new_book->copies);
+        lib_free(new_book);
+        return engine_result(result, ENGINE_NO_MEMORY);
+    }
+
+    result->book = new_book;
+    return ENGINE_OK;
+}
+
+// Index a book whose ISBN is known to be new: ordinal, hash chain and title BST.
+// Everything that can fail is allocated first, so on failure nothing is linked.
+int link_book(Book *book) {
+    // Keep chains short: double the index once titles outnumber buckets (a failed resize only costs speed)
+    if (hash_count >= hash_capacity) {
+        hash_table_grow(hash_capacity * 2);
+    }
+
+    TreeNode *node = create_tree_node(book);
+    if (node == NULL) {
+        return 0;
+    }
+
+    // Give the title its history ordinal
+    if (!register_book_ordinal(book)) {
+        lib_free(node);
+        return 0;
+    }
+
+    // Add book to the beginning of the chain at its index
+    unsigned int index = hash_function(book->isbn);
+    book->next = hash_table[index];
+    hash_table[index] = book;
+    hash_count++;
+
+    // Also add to BST for title-based searching
+    bst_attach_node(node);
+    return 1;
+}
+
+// Search for a book by ISBN
+Book* search_book_by_isbn(char *isbn) {
+    perf_begin(PERF_SEARCH_ISBN);
+    unsigned int index = hash_function(isbn);
+    Book *current = hash_table[index];
+    long probes = 0;
+
+    while (current != NULL) {
+        probes++;
+        if (strcmp(current->isbn, isbn) == 0) {
+            break;
+        }
+        current = current->next;
+    }
+
+    if (current != NULL) {
+        isbn_probe_stats.hits++;
+        isbn_probe_stats.hit_probes += probes;
+    } else {
+        isbn_probe_stats.misses++;
+        isbn_probe_stats.miss_probes += probes;
+    }
+    perf_end(PERF_SEARCH_ISBN);
+    return current; // NULL if not found
+}
+
+// Remove a book by ISBN
+int remove_book(char *isbn, EngineResult *result) {
+    engine_result(result, ENGINE_OK);
+    unsigned int index = hash_function(isbn);
+    Book *current = hash_table[index];
+    Book *prev = NULL;
+
+    // Search for the book in the hash table chain
+    while (current != NULL && strcmp(current->isbn, isbn) != 0) {
+        prev = current;
+        current = current->next;
+    }
+
+    if (current == NULL) {
+        return engine_result(result, ENGINE_BOOK_NOT_FOUND);
+    }
+
+    // Check if any copy is currently borrowed
+    if (current->available < current->copy_count) {
+        result->book = current;
+        result->count = current->copy_count - current->available;
+        return engine_result(result, ENGINE_COPIES_ON_LOAN);
+    }
+
+    // Patrons waiting on a withdrawn book lose their holds
+    clear_book_holds(current);
+
+    // Remove from hash table
+    if (prev == NULL) { // Book is the head of the chain
+        hash_table[index] = current->next;
+    } else {
+        prev->next = current->next;
+    }
+    hash_count--;
+
+    // Remove from BST
+    remove_from_bst(current);
+    unregister_book_ordinal(current);
+
+    strcpy(result->title, current->title);
+    lib_free(current->copies);
+    lib_free(current->cooccur);
+    lib_free(current); // Free the memory allocated for the book
+    return ENGINE_OK;
+}
+
+
+// --- Book Ordinal Functions ---
+
+// Assign an ordinal to a title (or keep the one it was loaded with) and index it
+int register_book_ordinal(Book *book) {
+    if (book->ordinal <= 0) {
+        book->ordinal = next_book_ordinal;
+    }
+    if (book->ordinal >= next_book_ordinal) {
+        next_book_ordinal = book->ordinal + 1;
+    }
+
+    if (book->ordinal >= book_ordinal_capacity) {
+        int new_capacity = book_ordinal_capacity > 0 ? book_ordinal_capacity : 64;
+        while (new_capacity <= book->ordinal) {
+            new_capacity *= 2;
+        }
+        Book **grown = (Book**)lib_realloc(ALLOC_CATALOG, book_by_ordinal, new_capacity * sizeof(Book*));
+        if (grown == NULL) {
+            return 0;
+        }
+        memset(grown + book_ordinal_capacity, 0, (new_capacity - book_ordinal_capacity) * sizeof(Book*));
+        book_by_ordinal = grown;
+        book_ordinal_capacity = new_capacity;
+    }
+
+    book_by_ordinal[book->ordinal] = book;
+    return 1;
+}
+
+// Drop a removed title from the ordinal index (its ordinal is never reused)
+void unregister_book_ordinal(Book *book) {
+    if (book->ordinal > 0 && book->ordinal < book_ordinal_capacity) {
+        book_by_ordinal[book->ordinal] = NULL;
+    }
+}
+
+
+// --- Copy Inventory Functions ---
+
+// Append new on-shelf copies to a title; returns the number added
+int add_copies(Book *book, int count) {
+    if (count <= 0) {
+        return 0;
+    }
+
+    if (book->copy_count + count > book->copy_capacity) {
+        int new_capacity = book->copy_capacity > 0 ? book->copy_capacity : 1;
+        while (new_capacity < book->copy_count + count) {
+            new_capacity *= 2;
+        }
+        BookCopy *grown = (BookCopy*)lib_realloc(ALLOC_CATALOG, book->copies, new_capacity * sizeof(BookCopy));
+        if (grown == NULL) {
+            return 0;
+        }
+        book->copies = grown;
+        book->copy_capacity = new_capacity;
+    }
+
+    // Push in reverse so the lowest-numbered new copy is handed out first
+    int first = book->copy_count;
+    book->copy_count += count;
+    for (int index = book->copy_count - 1; index >= first; index--) {
+        BookCopy *copy = &book->copies[index];
+        format_barcode(copy->barcode, book->isbn, index + 1);
+        copy->status = COPY_ON_SHELF;
+        copy->holder_id = 0;
+        copy->next_free = book->free_copy;
+        book->free_copy = index;
+        book->available++;
+    }
+    return count;
+}
+
+// Barcode "<isbn>-<number>", formatted by hand: bulk imports create millions of copies
+void format_barcode(char *out, const char *isbn, int number) {
+    size_t length = strlen(isbn);
+    memcpy(out, isbn, length);
+    out[length++] = '-';
+    char digits[12];
+    int count = 0;
+    unsigned int value = (unsigned int)number;
+    do {
+        digits[count++] = (char)('0' + value % 10);
+        value /= 10;
+    } while (value != 0);
+    while (count > 0) {
+        out[length++] = digits[--count];
+    }
+    out[length] = '\0';
+}
+
+// Add copies to an existing title by ISBN
+int add_book_copies(char *isbn, int count, EngineResult *result) {
+    engine_result(result, ENGINE_OK);
+    Book *book = search_book_by_isbn(isbn);
+    if (book == NULL) {
+        return engine_result(result, ENGINE_BOOK_NOT_FOUND);
+    }
+
+    result->book = book;
+    result->count = count;
+    if (add_copies(book, count) != count) {
+        return engine_result(result, ENGINE_NO_MEMORY);
+    }
+    return ENGINE_OK;
+}
+
+// Pop an on-shelf copy for a borrower (O(1)); returns its index or -1
+int claim_copy(Book *book, int holder_id) {
+    int index = book->free_copy;
+    if (index < 0) {
+        return -1;
+    }
+
+    BookCopy *copy = &book->copies[index];
+    book->free_copy = copy->next_free;
+    copy->next_free = -1;
+    copy->status = COPY_ON_LOAN;
+    copy->holder_id = holder_id;
+    book->available--;
+    return index;
+}
+
+// Push a returned copy back onto the shelf (O(1))
+void release_copy(Book *book, int copy_index) {
+    if (copy_index < 0 || copy_index >= book->copy_count) {
+        return;
+    }
+
+    BookCopy *copy = &book->copies[copy_index];
+    if (copy->status == COPY_ON_SHELF) {
+        return;
+    }
+    copy->status = COPY_ON_SHELF;
+    copy->holder_id = 0;
+    copy->next_free = book->free_copy;
+    book->free_copy = copy_index;
+    book->available++;
+}
+
+// Match a loan read from users.dat to the copy the user holds (load time only)
+int attach_loaded_copy(Book *book, int holder_id) {
+    int unassigned = -1;
+    for (int i = 0; i < book->copy_count; i++) {
+        BookCopy *copy = &book->copies[i];
+        if (copy->status != COPY_ON_LOAN) {
+            continue;
+        }
+        if (copy->holder_id == holder_id) {
+            return i;
+        }
+        if (copy->holder_id == 0 && unassigned < 0) {
+            unassigned = i;
+        }
+    }
+
+    if (unassigned >= 0) {
+        book->copies[unassigned].holder_id = holder_id;
+        return unassigned;
+    }
+
+    // The books file disagrees with the users file; take a shelf copy if one exists
+    return claim_copy(book, holder_id);
+}
+
+// Recompute the free stack and availability counter from per-copy status
+void rebuild_free_copies(Book *book) {
+    book->free_copy = -1;
+    book->available = 0;
+    for (int i = book->copy_count - 1; i >= 0; i--) {
+        if (book->copies[i].status == COPY_ON_SHELF) {
+            book->copies[i].holder_id = 0;
+            book->copies[i].next_free = book->free_copy;
+            book->free_copy = i;
+            book->available++;
+        } else {
+            book->copies[i].next_free = -1;
+        }
+    }
+}
+
+
+// --- BST Functions ---
+
+// BST node creation; NULL if out of memory
+TreeNode* create_tree_node(Book *book) {
+    TreeNode *new_node = (TreeNode*)lib_malloc(ALLOC_TITLE_INDEX, sizeof(TreeNode));
+    if (new_node == NULL) {
+        return NULL;
+    }
+
+    new_node->book = book;
+    new_node->left = NULL;
+    new_node->right = NULL;
+
+    return new_node;
+}
+
+// Insert a book into the BST; 0 (tree unchanged) if the node cannot be allocated
+int insert_into_bst(Book *book) {
+    TreeNode *new_node = create_tree_node(book);
+    if (new_node == NULL) {
+        return 0;
+    }
+    bst_attach_node(new_node);
+    return 1;
+}
+
+// Link an allocated node into the BST by its book's title
+void bst_attach_node(TreeNode *new_node) {
+    if (title_bst_root == NULL) {
+        title_bst_root = new_node;
+        return;
+    }
+
+    TreeNode *current = title_bst_root;
+    TreeNode *parent = NULL;
+    int comparison;
+
+    while (current != NULL) {
+        parent = current;
+        comparison = strcmp(new_node->book->title, current->book->title);
+
+        if (comparison < 0) {
+            current = current->left;
+        } else if (comparison > 0) {
+            current = current->right;
+        } else {
+            // Title already exists, decide how to handle.
+            current = current->right;
+        }
+    }
+
+    if (comparison < 0) {
+        parent->left = new_node;
+    } else { // comparison > 0
+        parent->right = new_node;
+    }
+}
+
+// Free nodes chained through their right links (iteratively: a chain can be very long)
+void bst_free_chain(TreeNode *chain) {
+    while (chain != NULL) {
+        TreeNode *next = chain->right;
+        lib_free(chain);
+        chain = next;
+    }
+}
+
+// Remove a book's node from the BST
+void remove_from_bst(Book *book) {
+    TreeNode **link = &title_bst_root;
+
+    // Equal titles were inserted to the right, so keep descending until the pointer matches
+    while (*link != NULL && (*link)->book != book) {
+        if (strcmp(book->title, (*link)->book->title) < 0) {
+            link = &(*link)->left;
+        } else {
+            link = &(*link)->right;
+        }
+    }
+
+    TreeNode *node = *link;
+    if (node == NULL) {
+        return;
+    }
+
+    if (node->left == NULL) {
+        *link = node->right;
+    } else if (node->right == NULL) {
+        *link = node->left;
+    } else {
+        // Replace with the inorder successor, which keeps equal titles on the right
+        TreeNode **successor_link = &node->right;
+        while ((*successor_link)->left != NULL) {
+            successor_link = &(*successor_link)->left;
+        }
+        TreeNode *successor = *successor_link;
+        *successor_link = successor->right;
+        successor->left = node->left;
+        successor->right = node->right;
+        *link = successor;
+    }
+    lib_free(node);
+}
+
+// Search for a book by title in the BST
+TreeNode* search_by_title(TreeNode *root, char *title) {
+    perf_begin(PERF_SEARCH_TITLE);
+    TreeNode *found = title_bst_find(root, title);
+    perf_end(PERF_SEARCH_TITLE);
+    return found;
+}
+
+TreeNode* title_bst_find(TreeNode *root, char *title) {
+    if (root == NULL) {
+        return NULL;
+    }
+
+    int comparison = strcmp(title, root->book->title);
+    if (comparison == 0) {
+        return root; // Found a book with the matching title
+    } else if (comparison < 0) {
+        return title_bst_find(root->left, title);
+    } else {
+        return title_bst_find(root->right, title);
+    }
+}
+
+// Inorder traversal of BST (for listing books in alphabetical order by title)
+void inorder_traversal(TreeNode *root) {
+    if (root != NULL) {
+        inorder_traversal(root->left);
+        printf("Title: %-30s | Author: %-20s | ISBN: %-15s | Available: %d/%d\n",
+               root->book->title, root->book->author, root->book->isbn,
+               root->book->available, root->book->copy_count);
+        inorder_traversal(root->right);
+    }
+}
+
+// --- User Linked List Functions ---
+
+// Add new user to the linked list
+int add_user(char *name, EngineResult *result) {
+    engine_result(result, ENGINE_OK);
+    User *new_user = (User*)lib_calloc(ALLOC_USERS, 1, sizeof(User)); // Zeroed: empty reading history
+    if (new_user == NULL) {
+        return engine_result(result, ENGINE_NO_MEMORY);
+    }
+
+    new_user->id = next_user_id++;
+    strcpy(new_user->name, name);
+    new_user->borrowed_count = 0;
+    new_user->holds = NULL;
+    new_user->hold_count = 0;
+    new_user->next = NULL;
+
+    // Add to the beginning of the linked list
+    if (user_list == NULL) {
+        user_list = new_user;
+    } else {
+        new_user->next = user_list;
+        user_list = new_user;
+    }
+    registered_users++;
+
+    result->user = new_user;
+    return ENGINE_OK;
+}
+
+// Find a user by ID
+User* find_user(int id) {
+    perf_begin(PERF_FIND_USER);
+    User *current = user_list;
+
+    while (current != NULL && current->id != id) {
+        current = current->next;
+    }
+
+    perf_end(PERF_FIND_USER);
+    return current; // NULL if not found
+}
+
+// Remove a user by ID
+int remove_user(int id, EngineResult *result) {
+    engine_result(result, ENGINE_OK);
+    User *current = user_list;
+    User *prev = NULL;
+
+    while (current != NULL && current->id != id) {
+        prev = current;
+        current = current->next;
+    }
+
+    if (current == NULL) {
+        return engine_result(result, ENGINE_USER_NOT_FOUND);
+    }
+
+    // Check if the user has any borrowed books
+    if (current->borrowed_count > 0) {
+        result->user = current;
+        return engine_result(result, ENGINE_USER_HAS_LOANS);
+    }
+
+    // Withdraw any holds the user is still waiting on
+    clear_user_holds(current);
+
+    // Remove from linked list
+    if (current == fine_merge_next) {
+        fine_merge_next = current->next; // Keep a yielded fine merge's resume point valid
+    }
+    if (prev == NULL) { // User is the head of the list
+        user_list = current->next;
+    } else {
+        prev->next = current->next;
+    }
+
+    registered_users--;
+    strcpy(result->name, current->name);
+    lib_free(current->read_history);
+    lib_free(current->read_filter);
+    lib_free(current); // Free the memory allocated for the user
+    return ENGINE_OK;
+}
+
+
+// --- Issue & Return Functions ---
+
+// Start a result with nothing found yet; returns status so failures can return through it
+int engine_result(EngineResult *result, int status) {
+    result->status = status;
+    if (status == ENGINE_OK) {
+        result->book = NULL;
+        result->user = NULL;
+        result->loan = NULL;
+        result->read_before = 0;
+        result->count = 0;
+        result->served_count = 0;
+    }
+    return status;
+}
+
+// Issue a book to a user
+int issue_book(int user_id, char *isbn, EngineResult *result) {
+    engine_result(result, ENGINE_OK);
+    User *user = find_user(user_id);
+    if (user == NULL) {
+        return engine_result(result, ENGINE_USER_NOT_FOUND);
+    }
+    result->user = user;
+
+    Book *book = search_book_by_isbn(isbn);
+    if (book == NULL) {
+        return engine_result(result, ENGINE_BOOK_NOT_FOUND);
+    }
+    result->book = book;
+
+    if (book->available == 0) {
+        return engine_result(result, ENGINE_NONE_AVAILABLE);
+    }
+
+    for (int i = 0; i < user->borrowed_count; i++) {
+        if (strcmp(user->borrowed_books[i], isbn) == 0) {
+            return engine_result(result, ENGINE_ALREADY_BORROWED);
+        }
+    }
+
+    if (user->borrowed_count >= MAX_BORROWED) {
+        return engine_result(result, ENGINE_BORROW_LIMIT);
+    }
+
+    // Checked before the checkout records this loan in the reading history
+    result->read_before = user_has_read(user, book->ordinal);
+
+    Loan *loan = checkout_book(user, book);
+    if (loan == NULL) {
+        return engine_result(result, ENGINE_NO_MEMORY);
+    }
+
+    // A patron who was queued for this title no longer needs the hold
+    Hold *hold = find_user_hold(user, book);
+    if (hold != NULL) {
+        remove_hold(hold);
+    }
+
+    result->loan = loan;
+    return ENGINE_OK;
+}
+
+// Hand a free copy of a book to a validated user: record the loan and update both sides
+Loan* checkout_book(User *user, Book *book) {
+    if (book->available == 0) {
+        return NULL;
+    }
+
+    time_t now = engine_now();
+    Loan *loan = (Loan*)lib_malloc(ALLOC_LOANS, sizeof(Loan));
+    if (loan == NULL || !active_loans_reserve(1) || !history_reserve(now, user->id, 1) || !user_reserve_read(user, 1)) {
+        lib_free(loan);
+        return NULL;
+    }
+
+    checkout_into(user, book, loan, now);
+    return loan;
+}
+
+// Checkout step that cannot fail: the caller has checked for a free copy and room
+// under the borrow limit, allocated the loan, and reserved its active-loan slot,
+// history event and reading-history entry
+void checkout_into(User *user, Book *book, Loan *loan, time_t now) {
+    // Record the loan and register it in the due-date wheel
+    init_loan(loan, user, book, now, now + (time_t)LOAN_PERIOD_DAYS * SECONDS_PER_DAY);
+
+    // Take a copy off the shelf
+    loan->copy_index = claim_copy(book, user->id);
+
+    // Add book to user's borrowed list
+    user->loans[user->borrowed_count] = loan;
+    strcpy(user->borrowed_books[user->borrowed_count++], book->isbn);
+
+    book->borrow_count++;
+    if (user_record_read(user, book->ordinal)) {
+        cooccur_link_reader(user, book->ordinal);
+    }
+    trend_record(book, now);
+    history_append(now, user->id, book->ordinal, HISTORY_EVENT_ISSUE);
+}
+
+// Return a book
+int return_book(int user_id, char *isbn, EngineResult *result) {
+    engine_result(result, ENGINE_OK);
+    User *user = find_user(user_id);
+    if (user == NULL) {
+        return engine_result(result, ENGINE_USER_NOT_FOUND);
+    }
+    result->user = user;
+
+    Book *book = search_book_by_isbn(isbn);
+    if (book == NULL) {
+        return engine_result(result, ENGINE_BOOK_NOT_FOUND);
+    }
+    result->book = book;
+
+    // Check if user has borrowed this book
+    int found_idx = -1;
+    for (int i = 0; i < user->borrowed_count; i++) {
+        if (strcmp(user->borrowed_books[i], isbn) == 0) {
+            found_idx = i;
+            break;
+        }
+    }
+
+    if (found_idx == -1) {
+        return engine_result(result, ENGINE_NOT_BORROWED);
+    }
+
+    // Room for the return event, so the check-in cannot half fail
+    if (!history_reserve(engine_now(), user->id, 1)) {
+        return engine_result(result, ENGINE_NO_MEMORY);
+    }
+
+    checkin_loan(user, found_idx);
+
+    // Hand the copy straight to the next eligible patron in the hold queue
+    if (book->hold_head != NULL && (result->served[0] = serve_next_hold(book)) != NULL) {
+        result->served_count = 1;
+    }
+    return ENGINE_OK;
+}
+
+// Close one of a user's loans: shelve the copy, cancel the timer and drop it from the borrowed list
+void checkin_loan(User *user, int loan_index) {
+    Loan *loan = user->loans[loan_index];
+    Book *book = loan->book;
+
+    // Put the copy back on the shelf and cancel the loan's due-date timer
+    if (book != NULL) {
+        release_copy(book, loan->copy_index);
+        history_append(engine_now(), user->id, book->ordinal, HISTORY_EVENT_RETURN);
+    }
+    cancel_loan(loan);
+
+    // Remove book from user's borrowed list by shifting elements
+    for (int i = loan_index; i < user->borrowed_count - 1; i++) {
+        strcpy(user->borrowed_books[i], user->borrowed_books[i + 1]);
+        user->loans[i] = user->loans[i + 1];
+    }
+    user->borrowed_count--;
+}
+
+// Issue a whole stack of books to one user: every item is validated and all
+// resources are allocated before the first copy is claimed, so it is all or nothing
+int issue_books_batch(int user_id, char isbns[][MAX_ISBN_LENGTH], int count, EngineResult *result) {
+    engine_result(result, ENGINE_OK);
+    if (count <= 0 || count > MAX_BATCH_ITEMS) {
+        return engine_result(result, ENGINE_BAD_BATCH_SIZE);
+    }
+
+    User *user = find_user(user_id);
+    if (user == NULL) {
+        return engine_result(result, ENGINE_USER_NOT_FOUND);
+    }
+    result->user = user;
+
+    if (user->borrowed_count + count > MAX_BORROWED) {
+        return engine_result(result, ENGINE_BORROW_LIMIT);
+    }
+
+    // Validate every item before touching any state
+    Book **books = result->items;
+    for (int i = 0; i < count; i++) {
+        books[i] = search_book_by_isbn(isbns[i]);
+        result->item_status[i] = ENGINE_OK;
+        if (books[i] == NULL) {
+            result->item_status[i] = ENGINE_BOOK_NOT_FOUND;
+        } else if (books[i]->available == 0) {
+            result->item_status[i] = ENGINE_NONE_AVAILABLE;
+        } else {
+            for (int j = 0; j < i; j++) {
+                if (books[j] == books[i]) {
+                    result->item_status[i] = ENGINE_SCANNED_TWICE;
+                    break;
+                }
+            }
+            for (int j = 0; j < user->borrowed_count && result->item_status[i] == ENGINE_OK; j++) {
+                if (user->loans[j]->book == books[i]) {
+                    result->item_status[i] = ENGINE_ALREADY_BORROWED;
+                }
+            }
+        }
+        if (result->item_status[i] != ENGINE_OK) {
+            result->count++;
+        }
+    }
+    if (result->count > 0) {
+        return engine_result(result, ENGINE_BATCH_REJECTED);
+    }
+
+    // Allocate everything up front; the commit loop below cannot fail
+    Loan **loans = result->item_loans;
+    int allocated = 0;
+    while (allocated < count && (loans[allocated] = (Loan*)lib_malloc(ALLOC_LOANS, sizeof(Loan))) != NULL) {
+        allocated++;
+    }
+    time_t now = engine_now();
+    if (allocated < count || !active_loans_reserve(count) || !history_reserve(now, user->id, count) ||
+        !user_reserve_read(user, count)) {
+        for (int i = 0; i < allocated; i++) {
+            lib_free(loans[i]);
+        }
+        return engine_result(result, ENGINE_NO_MEMORY);
+    }
+
+    for (int i = 0; i < count; i++) {
+        result->item_read_before[i] = user_has_read(user, books[i]->ordinal);
+        checkout_into(user, books[i], loans[i], now);
+
+        Hold *hold = find_user_hold(user, books[i]);
+        if (hold != NULL) {
+            remove_hold(hold);
+        }
+    }
+    result->count = count;
+    return ENGINE_OK;
+}
+
+// Return a stack of books from one user; all items must be on loan to the user or none are taken
+int return_books_batch(int user_id, char isbns[][MAX_ISBN_LENGTH], int count, EngineResult *result) {
+    engine_result(result, ENGINE_OK);
+    if (count <= 0 || count > MAX_BATCH_ITEMS) {
+        return engine_result(result, ENGINE_BAD_BATCH_SIZE);
+    }
+
+    User *user = find_user(user_id);
+    if (user == NULL) {
+        return engine_result(result, ENGINE_USER_NOT_FOUND);
+    }
+    result->user = user;
+
+    // Resolve every item to one of the user's loans before returning anything
+    Loan **loans = result->item_loans;
+    for (int i = 0; i < count; i++) {
+        loans[i] = NULL;
+        result->item_status[i] = ENGINE_OK;
+        for (int j = 0; j < user->borrowed_count; j++) {
+            if (strcmp(user->borrowed_books[j], isbns[i]) == 0) {
+                loans[i] = user->loans[j];
+                break;
+            }
+        }
+        if (loans[i] == NULL) {
+            result->item_status[i] = ENGINE_NOT_BORROWED;
+        } else {
+            for (int j = 0; j < i; j++) {
+                if (loans[j] == loans[i]) {
+                    result->item_status[i] = ENGINE_SCANNED_TWICE;
+                    break;
+                }
+            }
+        }
+        if (result->item_status[i] != ENGINE_OK) {
+            result->count++;
+        }
+    }
+    if (result->count > 0) {
+        return engine_result(result, ENGINE_BATCH_REJECTED);
+    }
+
+    // Room for every return event before the first check-in
+    if (!history_reserve(engine_now(), user->id, count)) {
+        return engine_result(result, ENGINE_NO_MEMORY);
+    }
+
+    // Checking in frees each loan, so only the books are kept
+    Book **books = result->items;
+    for (int i = 0; i < count; i++) {
+        books[i] = loans[i]->book;
+        for (int j = 0; j < user->borrowed_count; j++) {
+            if (user->loans[j] == loans[i]) {
+                checkin_loan(user, j);
+                break;
+            }
+        }
+    }
+
+    result->count = count;
+
+    // Returned copies go straight to waiting patrons
+    for (int i = 0; i < count; i++) {
+        if (books[i] != NULL && books[i]->hold_head != NULL &&
+            (result->served[result->served_count] = serve_next_hold(books[i])) != NULL) {
+            result->served_count++;
+        }
+    }
+    return ENGINE_OK;
+}
+
+// --- Loan Timing Wheel Functions ---
+
+// Allocate a loan and register it in the timing wheel
+Loan* create_loan(User *user, Book *book, time_t issue_time, time_t due_time) {
+    Loan *loan = (Loan*)lib_malloc(ALLOC_LOANS, sizeof(Loan));
+    if (loan == NULL || !active_loans_reserve(1)) {
+        lib_free(loan);
+        return NULL;
+    }
+
+    init_loan(loan, user, book, issue_time, due_time);
+    return loan;
+}
+
+// Fill in a loan and register it (the caller has reserved its active-loan slot)
+void init_loan(Loan *loan, User *user, Book *book, time_t issue_time, time_t due_time) {
+    loan->user = user;
+    loan->book = book;
+    loan->copy_index = -1;
+    strcpy(loan->isbn, book != NULL ? book->isbn : "");
+    loan->issue_time = issue_time;
+    loan->due_time = due_time;
+    loan->rate_class = (book != NULL && book->hold_count > 0) ? FINE_CLASS_HIGH_DEMAND : FINE_CLASS_STANDARD;
+    loan->active_index = -1;
+    loan->bucket = NULL;
+    loan->prev = NULL;
+    loan->next = NULL;
+
+    active_loans_add(loan);
+    wheel_advance(engine_now());
+    wheel_place(loan);
+}
+
+// Remove a loan from the wheel and free it (O(1))
+void cancel_loan(Loan *loan) {
+    if (loan == NULL) {
+        return;
+    }
+    loan_list_unlink(loan);
+    active_loans_remove(loan);
+    lib_free(loan);
+}
+
+// Append a loan to the tail of a wheel bucket
+void loan_list_append(LoanList *list, Loan *loan) {
+    loan->bucket = list;
+    loan->next = NULL;
+    loan->prev = list->tail;
+    if (list->tail != NULL) {
+        list->tail->next = loan;
+    } else {
+        list->head = loan;
+    }
+    list->tail = loan;
+    list->count++;
+}
+
+// Unlink a loan from whichever bucket holds it
+void loan_list_unlink(Loan *loan) {
+    LoanList *list = loan->bucket;
+    if (list == NULL) {
+        return;
+    }
+    if (loan == overdue_sweep_next) {
+        overdue_sweep_next = loan->next; // Keep a yielded sweep's resume point valid
+    }
+
+    if (loan->prev != NULL) {
+        loan->prev->next = loan->next;
+    } else {
+        list->head = loan->next;
+    }
+    if (loan->next != NULL) {
+        loan->next->prev = loan->prev;
+    } else {
+        list->tail = loan->prev;
+    }
+    list->count--;
+
+    loan->bucket = NULL;
+    loan->prev = NULL;
+    loan->next = NULL;
+}
+
+// Put a loan into the bucket matching its due time relative to the wheel position
+void wheel_place(Loan *loan) {
+    long due_hour = (long)(loan->due_time / SECONDS_PER_HOUR);
+
+    if (due_hour < wheel_current_hour) {
+        loan_list_append(&overdue_loans, loan);
+    } else if (due_hour - wheel_current_hour < WHEEL_HOUR_SLOTS) {
+        loan_list_append(&wheel_hours[due_hour % WHEEL_HOUR_SLOTS], loan);
+    } else {
+        long due_day = due_hour / 24;
+        if (due_day - wheel_current_hour / 24 < WHEEL_DAY_SLOTS) {
+            loan_list_append(&wheel_days[due_day % WHEEL_DAY_SLOTS], loan);
+        } else {
+            loan_list_append(&wheel_far, loan);
+        }
+    }
+}
+
+// Re-place every loan of a bucket against the current wheel position
+void wheel_replace_bucket(LoanList *list) {
+    Loan *current = list->head;
+    list->head = NULL;
+    list->tail = NULL;
+    list->count = 0;
+
+    while (current != NULL) {
+        Loan *next = current->next;
+        wheel_place(current);
+        current = next;
+    }
+}
+
+// Advance the wheel to the given time, expiring and cascading buckets as needed
+void wheel_advance(time_t now) {
+    long target_hour = (long)(now / SECONDS_PER_HOUR);
+
+    if (wheel_current_hour < 0) {
+        wheel_current_hour = target_hour;
+        return;
+    }
+    if (target_hour <= wheel_current_hour) {
+        return;
+    }
+
+    // After a long gap (e.g. the program was not running), redistributing is cheaper than ticking
+    if (target_hour - wheel_current_hour > (long)WHEEL_DAY_SLOTS * 24) {
+        LoanList pending = {NULL, NULL, 0};
+        LoanList *lists[WHEEL_HOUR_SLOTS + WHEEL_DAY_SLOTS + 1];
+        int list_count = 0;
+        for (int i = 0; i < WHEEL_HOUR_SLOTS; i++) lists[list_count++] = &wheel_hours[i];
+        for (int i = 0; i < WHEEL_DAY_SLOTS; i++) lists[list_count++] = &wheel_days[i];
+        lists[list_count++] = &wheel_far;
+
+        for (int i = 0; i < list_count; i++) {
+            while (lists[i]->head != NULL) {
+                Loan *loan = lists[i]->head;
+                loan_list_unlink(loan);
+                loan_list_append(&pending, loan);
+            }
+        }
+
+        wheel_current_hour = target_hour;
+        wheel_replace_bucket(&pending);
+        return;
+    }
+
+    while (wheel_current_hour < target_hour) {
+        // Everything in the hour slot being left behind is now overdue
+        LoanList *slot = &wheel_hours[wheel_current_hour % WHEEL_HOUR_SLOTS];
+        while (slot->head != NULL) {
+            Loan *loan = slot->head;
+            loan_list_unlink(loan);
+            loan_list_append(&overdue_loans, loan);
+        }
+        wheel_current_hour++;
+
+        // At each day boundary, cascade that day's bucket (and periodically the far list) down
+        if (wheel_current_hour % 24 == 0) {
+            long day = wheel_current_hour / 24;
+            if (day % WHEEL_DAY_SLOTS == 0) {
+                wheel_replace_bucket(&wheel_far);
+            }
+            wheel_replace_bucket(&wheel_days[day % WHEEL_DAY_SLOTS]);
+        }
+    }
+}
+
+// --- Fine Assessment Functions ---
+
+// Make room for `extra` more active loans so later adds cannot fail
+int active_loans_reserve(int extra) {
+    if (active_loan_count + extra > active_loan_capacity) {
+        int new_capacity = active_loan_capacity > 0 ? active_loan_capacity * 2 : 256;
+        while (new_capacity < active_loan_count + extra) {
+            new_capacity *= 2;
+        }
+        uint32_t *due = (uint32_t*)lib_realloc(ALLOC_LOANS, active_due_times, new_capacity * sizeof(uint32_t));
+        if (due == NULL) return 0;
+        active_due_times = due;
+        uint16_t *rates = (uint16_t*)lib_realloc(ALLOC_LOANS, active_daily_rates, new_capacity * sizeof(uint16_t));
+        if (rates == NULL) return 0;
+        active_daily_rates = rates;
+        int32_t *users = (int32_t*)lib_realloc(ALLOC_LOANS, active_user_ids, new_capacity * sizeof(int32_t));
+        if (users == NULL) return 0;
+        active_user_ids = users;
+        Loan **loans = (Loan**)lib_realloc(ALLOC_LOANS, active_loans, new_capacity * sizeof(Loan*));
+        if (loans == NULL) return 0;
+        active_loans = loans;
+        active_loan_capacity = new_capacity;
+    }
+    return 1;
+}
+
+// Append a loan to the dense active-loan arrays
+int active_loans_add(Loan *loan) {
+    if (!active_loans_reserve(1)) {
+        return 0;
+    }
+
+    int index = active_loan_count++;
+    active_due_times[index] = (uint32_t)loan->due_time;
+    active_daily_rates[index] = loan->rate_class == FINE_CLASS_HIGH_DEMAND ? FINE_RATE_HIGH_DEMAND_CENTS
+                                                                           : FINE_RATE_STANDARD_CENTS;
+    active_user_ids[index] = loan->user != NULL ? loan->user->id : 0;
+    active_loans[index] = loan;
+    loan->active_index = index;
+    return 1;
+}
+
+// Remove a loan from the dense arrays by moving the last entry into its slot (O(1))
+void active_loans_remove(Loan *loan) {
+    int index = loan->active_index;
+    if (index < 0) {
+        return;
+    }
+
+    int last = --active_loan_count;
+    if (index != last) {
+        active_due_times[index] = active_due_times[last];
+        active_daily_rates[index] = active_daily_rates[last];
+        active_user_ids[index] = active_user_ids[last];
+        active_loans[index] = active_loans[last];
+        active_loans[index]->active_index = index;
+    }
+    loan->active_index = -1;
+}
+
+// Fine per loan: full days late times the daily rate, capped. Branch-free so it vectorizes
+void compute_fines(const uint32_t *restrict due_times, const uint16_t *restrict daily_rates,
+                   uint32_t *restrict fines, int count, uint32_t now) {
+    for (int i = 0; i < count; i++) {
+        int32_t late = (int32_t)(now - due_times[i]);
+        uint32_t late_seconds = late > 0 ? (uint32_t)late : 0;
+        uint32_t fine = (late_seconds / SECONDS_PER_DAY) * daily_rates[i];
+        fines[i] = fine < FINE_CAP_CENTS ? fine : FINE_CAP_CENTS;
+    }
+}
+
+// Work split for one assessment thread
+typedef struct FineWorker {
+    int begin;
+    int end;
+    uint32_t now;
+    FineRun *run;         // Input arrays and the shared fines output; each worker writes only [begin, end)
+    int64_t *user_totals; // Per-worker totals indexed by user ID
+    int32_t *user_overdue;
+    int id_range;
+} FineWorker;
+
+// Compute one range of fines, then fold them into this worker's per-user totals
+void* fine_worker_run(void *arg) {
+    FineWorker *worker = (FineWorker*)arg;
+    FineRun *run = worker->run;
+    int n = worker->end - worker->begin;
+
+    compute_fines(run->due_times + worker->begin, run->daily_rates + worker->begin,
+                  run->fines + worker->begin, n, worker->now);
+
+    for (int i = worker->begin; i < worker->end; i++) {
+        uint32_t fine = run->fines[i];
+        int32_t user_id = run->user_ids[i];
+        if (fine > 0 && user_id >= 0 && user_id < worker->id_range) {
+            worker->user_totals[user_id] += fine;
+            worker->user_overdue[user_id]++;
+        }
+    }
+    return NULL;
+}
+
+// Set up an assessment of every active loan. With snapshot set the loan arrays are copied,
+// so fine_run_compute can run after the engine lock is released; returns 0 on allocation failure
+int fine_run_begin(FineRun *run, time_t now, int snapshot) {
+    memset(run, 0, sizeof(FineRun));
+    int n = active_loan_count;
+    run->count = n;
+    run->id_range = next_user_id;
+    run->now = now;
+
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    int threads = cores > 0 ? (int)cores : 1;
+    if (threads > MAX_FINE_THREADS) threads = MAX_FINE_THREADS;
+    if (threads > n / 65536 + 1) threads = n / 65536 + 1; // Small batches are not worth a thread
+    run->threads = threads;
+
+    run->fines = (uint32_t*)lib_malloc(ALLOC_LOANS, (n > 0 ? n : 1) * sizeof(uint32_t));
+    run->totals = (int64_t*)lib_calloc(ALLOC_LOANS, (size_t)threads * run->id_range, sizeof(int64_t));
+    run->overdue = (int32_t*)lib_calloc(ALLOC_LOANS, (size_t)threads * run->id_range, sizeof(int32_t));
+    if (snapshot) {
+        run->owned = 1;
+        run->due_times = (uint32_t*)lib_malloc(ALLOC_LOANS, (n > 0 ? n : 1) * sizeof(uint32_t));
+        run->daily_rates = (uint16_t*)lib_malloc(ALLOC_LOANS, (n > 0 ? n : 1) * sizeof(uint16_t));
+        run->user_ids = (int32_t*)lib_malloc(ALLOC_LOANS, (n > 0 ? n : 1) * sizeof(int32_t));
+    } else {
+        run->due_times = active_due_times;
+        run->daily_rates = active_daily_rates;
+        run->user_ids = active_user_ids;
+    }
+    if (run->fines == NULL || run->totals == NULL || run->overdue == NULL ||
+        (n > 0 && (run->due_times == NULL || run->daily_rates == NULL || run->user_ids == NULL))) {
+        fine_run_end(run);
+        return 0;
+    }
+    if (snapshot && n > 0) {
+        memcpy(run->due_times, active_due_times, n * sizeof(uint32_t));
+        memcpy(run->daily_rates, active_daily_rates, n * sizeof(uint16_t));
+        memcpy(run->user_ids, active_user_ids, n * sizeof(int32_t));
+    }
+    return 1;
+}
+
+// Compute every fine and the per-worker user totals across all cores
+void fine_run_compute(FineRun *run) {
+    int n = run->count;
+    int threads = run->threads;
+    FineWorker workers[MAX_FINE_THREADS];
+    pthread_t thread_ids[MAX_FINE_THREADS];
+    int chunk = (n + threads - 1) / threads;
+    for (int t = 0; t < threads; t++) {
+        workers[t].begin = t * chunk < n ? t * chunk : n;
+        workers[t].end = (t + 1) * chunk < n ? (t + 1) * chunk : n;
+        workers[t].now = (uint32_t)run->now;
+        workers[t].run = run;
+        workers[t].user_totals = run->totals + (size_t)t * run->id_range;
+        workers[t].user_overdue = run->overdue + (size_t)t * run->id_range;
+        workers[t].id_range = run->id_range;
+    }
+
+    // Worker 0 runs on the calling thread
+    int started = 1;
+    for (int t = 1; t < threads; t++) {
+        if (pthread_create(&thread_ids[t], NULL, fine_worker_run, &workers[t]) != 0) {
+            break;
+        }
+        started++;
+    }
+    fine_worker_run(&workers[0]);
+    for (int t = 1; t < started; t++) {
+        pthread_join(thread_ids[t], NULL);
+    }
+    for (int t = started; t < threads; t++) {
+        fine_worker_run(&workers[t]); // Thread creation failed; finish inline
+    }
+}
+
+// Store one user's merged totals; returns the user's fine in cents
+long fine_run_merge_user(FineRun *run, User *user) {
+    user->fine_cents = 0;
+    user->overdue_count = 0;
+    if (user->id < 0 || user->id >= run->id_range) {
+        return 0; // Registered after the assessment started
+    }
+    for (int t = 0; t < run->threads; t++) {
+        user->fine_cents += run->totals[(size_t)t * run->id_range + user->id];
+        user->overdue_count += run->overdue[(size_t)t * run->id_range + user->id];
+    }
+    return user->fine_cents;
+}
+
+void fine_run_end(FineRun *run) {
+    lib_free(run->fines);
+    lib_free(run->totals);
+    lib_free(run->overdue);
+    if (run->owned) {
+        lib_free(run->due_times);
+        lib_free(run->daily_rates);
+        lib_free(run->user_ids);
+    }
+    memset(run, 0, sizeof(FineRun));
+}
+
+// Assess fines on every active loan across all cores; returns the total in cents, -1 if out of memory
+long assess_overdue_fines(time_t now) {
+    FineRun run;
+    if (!fine_run_begin(&run, now, 0)) {
+        return -1;
+    }
+    fine_run_compute(&run);
+
+    long total = 0;
+    for (User *user = user_list; user != NULL; user = user->next) {
+        total += fine_run_merge_user(&run, user);
+    }
+
+    last_fine_assessment = now;
+    fine_run_end(&run);
+    return total;
+}
+
+// Print the per-user summary from the last assessment
+void list_fine_summary() {
+    printf("\n===== Overdue Fines =====\n");
+    printf("%-5s | %-20s | %-10s | %-10s\n", "ID", "Name", "Overdue", "Fine");
+    printf("------------------------------------------------------\n");
+
+    long total = 0;
+    int count = 0;
+    for (User *user = user_list; user != NULL; user = user->next) {
+        if (user->fine_cents > 0) {
+            printf("%-5d | %-20s | %-10d | %ld.%02ld\n", user->id, user->name,
+                   user->overdue_count, user->fine_cents / 100, user->fine_cents % 100);
+            total += user->fine_cents;
+            count++;
+        }
+    }
+
+    if (count == 0) {
+        printf("No outstanding fines.\n");
+    } else {
+        printf("Total: %ld.%02ld across %d users\n", total / 100, total % 100, count);
+    }
+}
+
+// --- Background Scheduler Functions ---
+
+void engine_lock() {
+    pthread_mutex_lock(&engine_mutex);
+}
+
+void engine_unlock() {
+    pthread_mutex_unlock(&engine_mutex);
+}
+
+// Let background jobs in while the menu waits on the operator
+void engine_unlock_for_input() {
+    pthread_mutex_unlock(&engine_mutex);
+}
+
+// Take the engine back; running jobs see the flag and yield at their next check
+// The wait and whoever held the engine are kept for the slow log.
+void engine_relock_after_input() {
+    input_lock_holder = atomic_load(&engine_job_running);
+    input_wait_saw_save = atomic_load(&save_in_progress);
+    uint64_t waited = monotonic_ns();
+    atomic_store(&circulation_waiting, 1);
+    pthread_mutex_lock(&engine_mutex);
+    atomic_store(&circulation_waiting, 0);
+    input_lock_wait_ns = monotonic_ns() - waited;
+}
+
+// Should a chunked job stop now: circulation is waiting or its budget is spent
+int job_should_yield(Job *job) {
+    return atomic_load(&circulation_waiting) || monotonic_ns() > job->deadline_ns;
+}
+
+// Let circulation in while a job works on data it has copied out of the engine
+void job_release_engine(Job *job) {
+    atomic_store(&engine_job_running, NULL);
+    engine_unlock();
+    job->released_ns = monotonic_ns();
+}
+
+void job_reacquire_engine(Job *job) {
+    engine_lock();
+    job->unlocked_ns += monotonic_ns() - job->released_ns;
+    atomic_store(&engine_job_running, job->name);
+}
+
+// Wall clock for engine operations; replay pins it to each operation's recorded time
+time_t engine_now() {
+    return engine_clock_pin != 0 ? engine_clock_pin : time(NULL);
+}
+
+uint64_t monotonic_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+// Register a job to first run after delay_ms, then every period_ms (0 = once)
+Job* schedule_job(const char *name, JobFunction run, int priority, long delay_ms, long period_ms, long budget_ms) {
+    pthread_mutex_lock(&sched_mutex);
+    if (sched_job_count == SCHED_MAX_JOBS) {
+        pthread_mutex_unlock(&sched_mutex);
+        return NULL;
+    }
+
+    Job *job = &sched_jobs[sched_job_count++];
+    memset(job, 0, sizeof(Job));
+    job->name = name;
+    job->run = run;
+    job->priority = priority;
+    job->period_ms = period_ms;
+    job->budget_ms = budget_ms;
+    job->next_run_ns = monotonic_ns() + (uint64_t)delay_ms * 1000000ULL;
+    job->active = 1;
+
+    sched_heap_push(job);
+    pthread_cond_signal(&sched_cond);
+    pthread_mutex_unlock(&sched_mutex);
+    return job;
+}
+
+// Heap order: earlier next_run first, then better priority
+int sched_job_before(Job *a, Job *b) {
+    if (a->next_run_ns != b->next_run_ns) {
+        return a->next_run_ns < b->next_run_ns;
+    }
+    return a->priority < b->priority;
+}
+
+// Push onto the timer heap (sched_mutex held)
+void sched_heap_push(Job *job) {
+    int i = sched_heap_size++;
+    while (i > 0) {
+        int parent = (i - 1) / 2;
+        if (!sched_job_before(job, sched_heap[parent])) {
+            break;
+        }
+        sched_heap[i] = sched_heap[parent];
+        i = parent;
+    }
+    sched_heap[i] = job;
+}
+
+// Pop the earliest job from the timer heap (sched_mutex held)
+Job* sched_heap_pop() {
+    if (sched_heap_size == 0) {
+        return NULL;
+    }
+
+    Job *top = sched_heap[0];
+    Job *last = sched_heap[--sched_heap_size];
+    int i = 0;
+    while (1) {
+        int child = 2 * i + 1;
+        if (child >= sched_heap_size) {
+            break;
+        }
+        if (child + 1 < sched_heap_size && sched_job_before(sched_heap[child + 1], sched_heap[child])) {
+            child++;
+        }
+        if (!sched_job_before(sched_heap[child], last)) {
+            break;
+        }
+        sched_heap[i] = sched_heap[child];
+        i = child;
+    }
+    if (sched_heap_size > 0) {
+        sched_heap[i] = last;
+    }
+    return top;
+}
+
+// Worker loop: sleep until the earliest job is due, run the most urgent due job, requeue it
+void* sched_worker_run(void *arg) {
+    (void)arg;
+    trace_set_thread_name("scheduler");
+    pthread_mutex_lock(&sched_mutex);
+
+    while (!sched_stopping) {
+        if (sched_heap_size == 0) {
+            pthread_cond_wait(&sched_cond, &sched_mutex);
+            continue;
+        }
+
+        uint64_t now = monotonic_ns();
+        if (sched_heap[0]->next_run_ns > now) {
+            uint64_t wake = sched_heap[0]->next_run_ns;
+            struct timespec until = {(time_t)(wake / 1000000000ULL), (long)(wake % 1000000000ULL)};
+            pthread_cond_timedwait(&sched_cond, &sched_mutex, &until);
+            continue;
+        }
+
+        // Among the jobs due now, run the one with the best priority
+        Job *due[SCHED_MAX_JOBS] = {NULL};
+        int due_count = 0;
+        while (sched_heap_size > 0 && sched_heap[0]->next_run_ns <= now) {
+            due[due_count++] = sched_heap_pop();
+        }
+        int best = 0;
+        for (int i = 1; i < due_count; i++) {
+            if (due[i]->priority < due[best]->priority) {
+                best = i;
+            }
+        }
+        for (int i = 0; i < due_count; i++) {
+            if (i != best) {
+                sched_heap_push(due[i]);
+            }
+        }
+        Job *job = due[best];
+        pthread_mutex_unlock(&sched_mutex);
+
+        // Run under the engine lock, within the job's budget
+        trace_begin("engine_lock_wait", "scheduler");
+        engine_lock();
+        trace_end("engine_lock_wait", "scheduler");
+        atomic_store(&engine_job_running, job->name);
+        trace_begin(job->name, "job");
+        uint64_t start = monotonic_ns();
+        job->deadline_ns = start + (uint64_t)job->budget_ms * 1000000ULL;
+        job->unlocked_ns = 0;
+        if (job->cursor == 0) {
+            job->last_run_wall = time(NULL);
+        }
+        int finished = job->run(job);
+        uint64_t elapsed = monotonic_ns() - start - job->unlocked_ns; // Time holding the engine
+        trace_end(job->name, "job");
+        metrics_publish();
+        atomic_store(&engine_job_running, NULL);
+        engine_unlock();
+
+        pthread_mutex_lock(&sched_mutex);
+        job->last_duration_ns = elapsed;
+        if (elapsed > job->max_duration_ns) {
+            job->max_duration_ns = elapsed;
+        }
+        if (elapsed > (uint64_t)job->budget_ms * 1000000ULL) {
+            job->overrun_count++;
+        }
+
+        if (!finished) {
+            // Resume right away, behind anything circulation queued up meanwhile
+            job->yield_count++;
+            job->next_run_ns = monotonic_ns() + 1000000ULL;
+            sched_heap_push(job);
+        } else {
+            job->run_count++;
+            job->cursor = 0;
+            if (job->period_ms > 0) {
+                job->next_run_ns = start + (uint64_t)job->period_ms * 1000000ULL;
+                sched_heap_push(job);
+            } else {
+                job->active = 0;
+            }
+        }
+        pthread_cond_signal(&sched_cond);
+    }
+
+    pthread_mutex_unlock(&sched_mutex);
+    return NULL;
+}
+
+// Register the maintenance jobs and start the worker threads
+void scheduler_start() {
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&sched_cond, &attr);
+    pthread_condattr_destroy(&attr);
+
+    // Nightly fine assessment runs at the next local midnight, then every 24 hours
+    time_t now = time(NULL);
+    struct tm midnight = *localtime(&now);
+    midnight.tm_hour = 24;
+    midnight.tm_min = 0;
+    midnight.tm_sec = 0;
+    midnight.tm_isdst = -1;
+    long until_midnight_ms = (long)difftime(mktime(&midnight), now) * 1000;
+
+    schedule_job("overdue-sweep", job_overdue_sweep, 1, 0, OVERDUE_SWEEP_INTERVAL_SEC * 1000L, 5);
+    schedule_job("stats-rollup", job_stats_rollup, 2, 0, STATS_ROLLUP_INTERVAL_SEC * 1000L, 5);
+    schedule_job("fine-assessment", job_fine_assessment, 3, until_midnight_ms, SECONDS_PER_DAY * 1000L, 1000);
+    schedule_job("checkpoint", job_checkpoint, 4, CHECKPOINT_INTERVAL_SEC * 1000L, CHECKPOINT_INTERVAL_SEC * 1000L, 500);
+
+    for (int i = 0; i < SCHED_WORKERS; i++) {
+        if (pthread_create(&sched_threads[sched_thread_count], NULL, sched_worker_run, NULL) == 0) {
+            sched_thread_count++;
+        }
+    }
+}
+
+// Stop the workers; the engine lock is dropped so a job in progress can finish
+void scheduler_stop() {
+    pthread_mutex_lock(&sched_mutex);
+    sched_stopping = 1;
+    pthread_cond_broadcast(&sched_cond);
+    pthread_mutex_unlock(&sched_mutex);
+
+    engine_unlock();
+    for (int i = 0; i < sched_thread_count; i++) {
+        pthread_join(sched_threads[i], NULL);
+    }
+    sched_thread_count = 0;
+    engine_lock();
+
+    fine_run_end(&fine_job_run); // Yielded jobs that will not resume
+    checkpoint_discard(&checkpoint_run);
+    fine_merge_next = NULL;
+    overdue_sweep_next = NULL;
+}
+
+// Show each job's schedule and run statistics
+void list_background_jobs() {
+    printf("\n===== Background Jobs =====\n");
+    printf("%-16s | %-3s | %-8s | %-6s | %-16s | %-10s | %-10s | %-5s | %-6s | %-8s\n",
+           "Job", "Pri", "Period", "Runs", "Last Run", "Last (ms)", "Max (ms)", "Over", "Yields", "Next In");
+    printf("-----------------------------------------------------------------------------------------------------------------------\n");
+
+    pthread_mutex_lock(&sched_mutex);
+    uint64_t now = monotonic_ns();
+    for (int i = 0; i < sched_job_count; i++) {
+        Job *job = &sched_jobs[i];
+        char last_str[32] = "never";
+        if (job->last_run_wall != 0) {
+            format_time(job->last_run_wall, last_str, sizeof(last_str));
+        }
+        char period_str[24];
+        snprintf(period_str, sizeof(period_str), "%lds", job->period_ms / 1000);
+        char next_str[24] = "-";
+        if (job->active) {
+            long seconds = job->next_run_ns > now ? (long)((job->next_run_ns - now) / 1000000000ULL) : 0;
+            snprintf(next_str, sizeof(next_str), "%lds", seconds);
+        }
+        printf("%-16s | %-3d | %-8s | %-6ld | %-16s | %-10.3f | %-10.3f | %-5ld | %-6ld | %-8s\n",
+               job->name, job->priority, period_str, job->run_count, last_str,
+               job->last_duration_ns / 1e6, job->max_duration_ns / 1e6, job->overrun_count, job->yield_count, next_str);
+    }
+    pthread_mutex_unlock(&sched_mutex);
+
+    if (catalog_stats.computed_at != 0) {
+        char when[32];
+        format_time(catalog_stats.computed_at, when, sizeof(when));
+        printf("\nCatalog (as of %s): %ld titles, %ld/%ld copies available, %ld holds, %ld users (%ld active), %ld overdue loans\n",
+               when, catalog_stats.titles, catalog_stats.copies_available, catalog_stats.copies,
+               catalog_stats.holds, catalog_stats.users, catalog_stats.active_users, overdue_loan_count);
+    }
+}
+
+// Save everything to disk
+void save_all_data() {
+    atomic_store(&save_in_progress, 1);
+    uint64_t started = monotonic_ns();
+    trace_begin("save_all_data", "persistence");
+    trace_begin("save_books", "persistence");
+    save_books_to_file("books.dat");
+    trace_end("save_books", "persistence");
+    trace_begin("save_users", "persistence");
+    save_users_to_file("users.dat");
+    trace_end("save_users", "persistence");
+    trace_begin("save_holds", "persistence");
+    save_holds_to_file("holds.dat");
+    trace_end("save_holds", "persistence");
+    trace_begin("save_history", "persistence");
+    save_history_to_file("history.dat");
+    trace_end("save_history", "persistence");
+    trace_end("save_all_data", "persistence");
+    save_record_time(started);
+}
+
+// Account a finished save in the metrics and clear the in-progress flag
+void save_record_time(uint64_t started) {
+    uint64_t elapsed = monotonic_ns() - started;
+    atomic_store(&save_last_ns, elapsed);
+    atomic_fetch_add(&save_total_ns, elapsed);
+    atomic_fetch_add(&save_count, 1);
+    atomic_store(&save_last_completed, (int64_t)time(NULL));
+    atomic_store(&save_in_progress, 0);
+}
+
+// Free a checkpoint's memory streams and buffers
+void checkpoint_discard(CheckpointRun *run) {
+    for (int i = 0; i < CHECKPOINT_FILES; i++) {
+        if (run->streams[i] != NULL) {
+            fclose(run->streams[i]);
+        }
+        free(run->data[i]); // Allocated by open_memstream, not lib_malloc
+    }
+    int restarts = run->restarts;
+    memset(run, 0, sizeof(CheckpointRun));
+    run->restarts = restarts;
+}
+
+// Write a checkpoint file to a temporary name and rename it into place, so a crash
+// part way leaves the previous checkpoint intact
+int checkpoint_replace_file(const char *filename, const char *data, size_t length) {
+    char temp_name[512];
+    snprintf(temp_name, sizeof(temp_name), "%s.tmp", filename);
+    FILE *file = fopen(temp_name, "w");
+    if (file == NULL) {
+        return 0;
+    }
+    int ok = fwrite(data, 1, length, file) == length;
+    if (fclose(file) != 0 || !ok || rename(temp_name, filename) != 0) {
+        remove(temp_name);
+        return 0;
+    }
+    return 1;
+}
+
+// Append to an append-only checkpoint file; a failed write is cut back off so the
+// file never ends in a partial block that would hide later ones from the loader
+int checkpoint_append_file(const char *filename, const char *data, size_t length) {
+    FILE *file = fopen(filename, "ab");
+    if (file == NULL) {
+        return 0;
+    }
+    long start = fseek(file, 0, SEEK_END) == 0 ? ftell(file) : -1;
+    if (start < 0) {
+        fclose(file);
+        return 0;
+    }
+    int ok = fwrite(data, 1, length, file) == length;
+    ok &= fclose(file) == 0;
+    if (!ok && truncate(filename, (off_t)start) != 0) {
+        perror("Error trimming a failed history append");
+    }
+    return ok;
+}
+
+// Periodic checkpoint so a crash loses at most one interval of changes. Records are
+// serialized into memory in chunks, yielding in between; a change to saved state while
+// yielded starts it over so the files stay consistent with each other. The files are
+// written to disk after the engine lock is released; history events count as persisted
+// only once their append has succeeded.
+int job_checkpoint(Job *job) {
+    const char *names[CHECKPOINT_FILES] = {"books.dat", "users.dat", "holds.dat", "history.dat"};
+    CheckpointRun *run = &checkpoint_run;
+
+    if (job->cursor != 0 && (run->mutations != engine_mutation_count || run->resize_count != hash_resize_count)) {
+        checkpoint_discard(run);
+        run->restarts++;
+        job->cursor = 0;
+    }
+    if (job->cursor == 0) {
+        atomic_store(&save_in_progress, 1);
+        run->started = monotonic_ns();
+        for (int i = 0; i < CHECKPOINT_FILES; i++) {
+            run->streams[i] = open_memstream(&run->data[i], &run->lengths[i]);
+            if (run->streams[i] == NULL) {
+                printf("Memory allocation failed for checkpoint; it will be retried next interval.\n");
+                checkpoint_discard(run);
+                run->restarts = 0;
+                atomic_store(&save_in_progress, 0);
+                return 1;
+            }
+        }
+        run->mutations = engine_mutation_count;
+        run->resize_count = hash_resize_count;
+        run->user = user_list;
+        job->cursor = 1;
+    }
+    int may_yield = run->restarts < CHECKPOINT_MAX_RESTARTS; // Busy engine: finish in one go
+
+    trace_begin("checkpoint_snapshot", "persistence");
+    int written = 0;
+    while (run->stage < CHECKPOINT_FILES - 1) {
+        if (run->stage == 1) {
+            if (run->user == NULL) {
+                run->stage++;
+                continue;
+            }
+            write_user(run->streams[1], run->user);
+            run->user = run->user->next;
+            written++;
+        } else {
+            if (run->bucket == hash_capacity) {
+                run->stage++;
+                run->bucket = 0;
+                continue;
+            }
+            for (Book *book = hash_table[run->bucket]; book != NULL; book = book->next) {
+                if (run->stage == 0) {
+                    write_book(run->streams[0], book);
+                } else {
+                    write_book_holds(run->streams[2], book);
+                }
+                written++;
+            }
+            run->bucket++;
+        }
+        if (written >= CHECKPOINT_CHUNK) {
+            written = 0;
+            if (may_yield && job_should_yield(job)) {
+                trace_end("checkpoint_snapshot", "persistence");
+                return 0;
+            }
+        }
+    }
+
+    // History last, in the same stretch as the end of the snapshot; the counts it covers
+    // are noted so only those are marked persisted once the file is written
+    int ok = write_history(run->streams[CHECKPOINT_FILES - 1], 0);
+    run->history_last = history_tail;
+    run->history_last_count = history_tail != NULL ? history_tail->count : 0;
+    for (int i = 0; i < CHECKPOINT_FILES; i++) {
+        ok &= fclose(run->streams[i]) == 0;
+        run->streams[i] = NULL;
+    }
+    trace_end("checkpoint_snapshot", "persistence");
+    if (!ok) {
+        printf("Memory allocation failed for checkpoint; it will be retried next interval.\n");
+        checkpoint_discard(run);
+        run->restarts = 0;
+        atomic_store(&save_in_progress, 0);
+        return 1;
+    }
+
+    job_release_engine(job);
+    trace_begin("checkpoint_write", "persistence");
+    int history_saved = 1;
+    for (int i = 0; i < CHECKPOINT_FILES; i++) {
+        int history = i == CHECKPOINT_FILES - 1;
+        if (history && run->lengths[i] == 0) {
+            continue;
+        }
+        // History is append-only; the others are replaced whole
+        int saved = history ? checkpoint_append_file(names[i], run->data[i], run->lengths[i])
+                            : checkpoint_replace_file(names[i], run->data[i], run->lengths[i]);
+        if (!saved) {
+            printf("Checkpoint could not write %s; it will be retried next interval.\n", names[i]);
+            history_saved = !history;
+        }
+    }
+    trace_end("checkpoint_write", "persistence");
+    job_reacquire_engine(job);
+
+    if (history_saved) {
+        history_mark_persisted(run->history_last, run->history_last_count);
+    }
+
+    uint64_t started = run->started;
+    checkpoint_discard(run);
+    run->restarts = 0;
+    save_record_time(started);
+    return 1;
+}
+
+// Expire due hour slots into the overdue list, then count the late loans in the current
+// hour slot; both steps yield between chunks and the count resumes where it stopped
+int job_overdue_sweep(Job *job) {
+    time_t now = time(NULL);
+    if (job->cursor == 0) {
+        // One hour slot at a time, so catching up after a stall can yield between slots
+        long target_hour = (long)(now / SECONDS_PER_HOUR);
+        while (wheel_current_hour >= 0 && wheel_current_hour < target_hour &&
+               target_hour - wheel_current_hour <= (long)WHEEL_DAY_SLOTS * 24) {
+            wheel_advance((time_t)(wheel_current_hour + 1) * SECONDS_PER_HOUR);
+            if (job_should_yield(job)) {
+                return 0;
+            }
+        }
+        wheel_advance(now); // First run, or a gap past the day wheel: one redistribution
+
+        overdue_sweep_hour = wheel_current_hour;
+        overdue_sweep_next = wheel_hours[wheel_current_hour % WHEEL_HOUR_SLOTS].head;
+        overdue_sweep_late = 0;
+        job->cursor = 1;
+    }
+
+    // Circulation moved the wheel to a new hour while this job was yielded: start over
+    if (overdue_sweep_hour != wheel_current_hour) {
+        overdue_sweep_next = NULL;
+        job->cursor = 0;
+        return 0;
+    }
+
+    int scanned = 0;
+    while (overdue_sweep_next != NULL) {
+        Loan *loan = overdue_sweep_next;
+        overdue_sweep_late += loan->due_time < now;
+        overdue_sweep_next = loan->next;
+        if (++scanned >= OVERDUE_SWEEP_CHUNK && overdue_sweep_next != NULL && job_should_yield(job)) {
+            return 0;
+        }
+    }
+    overdue_loan_count = overdue_loans.count + overdue_sweep_late;
+    return 1;
+}
+
+// Nightly fine assessment over all active loans: the loan arrays are copied under the
+// engine lock, the fines are computed without it, and users are updated in chunks
+int job_fine_assessment(Job *job) {
+    if (job->cursor == 0) {
+        if (!fine_run_begin(&fine_job_run, time(NULL), 1)) {
+            printf("Memory allocation failed for fine assessment; it will be retried next interval.\n");
+            return 1;
+        }
+        job_release_engine(job);
+        fine_run_compute(&fine_job_run);
+        job_reacquire_engine(job);
+
+        fine_merge_next = user_list;
+        job->cursor = 1;
+    }
+
+    int merged = 0;
+    while (fine_merge_next != NULL) {
+        User *user = fine_merge_next;
+        fine_run_merge_user(&fine_job_run, user);
+        fine_merge_next = user->next;
+        if (++merged >= FINE_MERGE_CHUNK && fine_merge_next != NULL && job_should_yield(job)) {
+            return 0;
+        }
+    }
+
+    last_fine_assessment = fine_job_run.now;
+    fine_run_end(&fine_job_run);
+    return 1;
+}
+
+// Recompute catalog totals in chunks of hash buckets, yielding to circulation between chunks
+int job_stats_rollup(Job *job) {
+    if (job->cursor == 0) {
+        memset(&catalog_stats_partial, 0, sizeof(catalog_stats_partial));
+    }
+
+    // A resize while this job was yielded moves titles between buckets, so start over
+    if (job->cursor > 0 && stats_rollup_resize_count != hash_resize_count) {
+        memset(&catalog_stats_partial, 0, sizeof(catalog_stats_partial));
+        job->cursor = 0;
+    }
+    stats_rollup_resize_count = hash_resize_count;
+
+    int scanned = 0;
+    while (job->cursor < hash_capacity) {
+        for (Book *book = hash_table[job->cursor]; book != NULL; book = book->next) {
+            catalog_stats_partial.titles++;
+            catalog_stats_partial.copies += book->copy_count;
+            catalog_stats_partial.copies_available += book->available;
+            catalog_stats_partial.holds += book->hold_count;
+            scanned++;
+        }
+        job->cursor++;
+        if (scanned >= STATS_ROLLUP_CHUNK && job_should_yield(job)) {
+            return 0;
+        }
+    }
+
+    for (User *user = user_list; user != NULL; user = user->next) {
+        catalog_stats_partial.users++;
+        catalog_stats_partial.active_users += user->borrowed_count > 0;
+    }
+
+    catalog_stats_partial.computed_at = time(NULL);
+    catalog_stats = catalog_stats_partial;
+    return 1;
+}
+
+// --- Hash Diagnostics Functions ---
+
+// Report: shape of the ISBN hash index plus live probe counts
+void list_isbn_index_diagnostics() {
+    long histogram[CHAIN_HISTOGRAM_MAX + 1] = {0};
+    long titles = 0;
+    long max_chain = 0;
+    double hit_cost = 0.0; // Probes to find every title once
+
+    for (int i = 0; i < hash_capacity; i++) {
+        long length = 0;
+        for (Book *current = hash_table[i]; current != NULL; current = current->next) {
+            length++;
+        }
+        histogram[length < CHAIN_HISTOGRAM_MAX ? length : CHAIN_HISTOGRAM_MAX]++;
+        titles += length;
+        hit_cost += length * (length + 1) / 2.0;
+        if (length > max_chain) {
+            max_chain = length;
+        }
+    }
+
+    double load = (double)titles / hash_capacity;
+    printf("\n===== ISBN Index Diagnostics =====\n");
+    printf("Buckets: %d | Titles: %ld | Load factor: %.2f | Max chain: %ld | Resizes: %ld\n",
+           hash_capacity, titles, load, max_chain, hash_resize_count);
+    if (titles > 0) {
+        // A uniform hash would cost (n / 2m) * (n + 2m - 1) probes in total; 1.00 is ideal
+        double uniform_cost = titles / (2.0 * hash_capacity) * (titles + 2.0 * hash_capacity - 1);
+        printf("Expected probes per hit: %.2f | per miss: %.2f | Quality vs uniform: %.2f\n",
+               hit_cost / titles, load, hit_cost / uniform_cost);
+    }
+
+    printf("\n%-12s | %-10s\n", "Chain length", "Buckets");
+    printf("-------------------------\n");
+    for (int length = 0; length <= CHAIN_HISTOGRAM_MAX; length++) {
+        if (histogram[length] > 0) {
+            printf("%s%-10d | %-10ld\n", length == CHAIN_HISTOGRAM_MAX ? ">=" : "  ", length, histogram[length]);
+        }
+    }
+
+    printf("\nLive lookups: %ld hits (%.2f probes each), %ld misses (%.2f probes each)\n",
+           isbn_probe_stats.hits,
+           isbn_probe_stats.hits > 0 ? (double)isbn_probe_stats.hit_probes / isbn_probe_stats.hits : 0.0,
+           isbn_probe_stats.misses,
+           isbn_probe_stats.misses > 0 ? (double)isbn_probe_stats.miss_probes / isbn_probe_stats.misses : 0.0);
+}
+
+// Candidate hash functions for the offline evaluator
+uint32_t hash_isbn_low32(const char *key) {
+    return (uint32_t)hash_isbn(key); // The bits hash_function masks
+}
+
+uint32_t hash_djb2(const char *key) {
+    uint32_t hash = 5381;
+    while (*key) {
+        hash = hash * 33 + (unsigned char)*key++;
+    }
+    return hash;
+}
+
+uint32_t hash_fnv1a(const char *key) {
+    uint32_t hash = 2166136261u;
+    while (*key) {
+        hash ^= (unsigned char)*key++;
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+// The current polynomial followed by the MurmurHash3 finalizer
+uint32_t hash_poly31_mixed(const char *key) {
+    uint32_t hash = hash_poly31(key);
+    hash ^= hash >> 16;
+    hash *= 0x85ebca6bu;
+    hash ^= hash >> 13;
+    hash *= 0xc2b2ae35u;
+    hash ^= hash >> 16;
+    return hash;
+}
+
+// Distribute the keys over `buckets` chains with one candidate and print one result row
+void hash_evaluate(const char *name, HashCandidateFunction hash, char (*keys)[MAX_ISBN_LENGTH], long count, long buckets) {
+    long *lengths = (long*)lib_calloc(ALLOC_TOOLS, buckets, sizeof(long));
+    if (lengths == NULL) {
+        printf("Memory allocation failed for hash evaluation.\n");
+        return;
+    }
+    for (long i = 0; i < count; i++) {
+        lengths[hash(keys[i]) % buckets]++;
+    }
+
+    long max_chain = 0;
+    long empty = 0;
+    double hit_cost = 0.0;
+    for (long b = 0; b < buckets; b++) {
+        hit_cost += lengths[b] * (lengths[b] + 1) / 2.0;
+        if (lengths[b] > max_chain) {
+            max_chain = lengths[b];
+        }
+        empty += lengths[b] == 0;
+    }
+    double uniform_cost = count / (2.0 * buckets) * (count + 2.0 * buckets - 1);
+
+    // Throughput: hash the whole key set until ~50 ms have passed
+    uint64_t start = monotonic_ns();
+    uint64_t elapsed = 0;
+    long hashed = 0;
+    do {
+        for (long i = 0; i < count; i++) {
+            bench_sink += hash(keys[i]);
+        }
+        hashed += count;
+        elapsed = monotonic_ns() - start;
+    } while (elapsed < 50000000ULL);
+
+    printf("%-14s | %9ld | %9ld | %9ld | %8.2f | %8.2f | %7.2f | %7.1f\n",
+           name, buckets, max_chain, empty, hit_cost / count, (double)count / buckets,
+           hit_cost / uniform_cost, (double)elapsed / hashed);
+    lib_free(lengths);
+}
+
+// Entry point for `library --hash-eval [books.dat] [--buckets N]`
+int run_hash_evaluation(int argc, char *argv[]) {
+    const char *filename = "books.dat";
+    long buckets = 0;
+    for (int i = 0; i < argc; i++) {
+        if (strcmp(argv[i], "--buckets") == 0 && i + 1 < argc) {
+            buckets = atol(argv[++i]);
+        } else {
+            filename = argv[i];
+        }
+    }
+
+    FILE *file = fopen(filename, "r");
+    if (file == NULL) {
+        perror("Error opening books file");
+        return 1;
+    }
+
+    // Only the ISBN (first field) of each record matters here
+    char (*keys)[MAX_ISBN_LENGTH] = NULL;
+    long count = 0;
+    long capacity = 0;
+    static char line[65536];
+    while (fgets(line, sizeof(line), file) != NULL) {
+        size_t length = strcspn(line, "|\n");
+        if (length == 0 || length >= MAX_ISBN_LENGTH) {
+            continue;
+        }
+        if (count == capacity) {
+            capacity = capacity > 0 ? capacity * 2 : 1024;
+            void *grown = lib_realloc(ALLOC_TOOLS, keys, capacity * sizeof(*keys));
+            if (grown == NULL) {
+                printf("Memory allocation failed for hash evaluation.\n");
+                lib_free(keys);
+                fclose(file);
+                return 1;
+            }
+            keys = grown;
+        }
+        memcpy(keys[count], line, length);
+        keys[count][length] = '\0';
+        count++;
+    }
+    fclose(file);
+    if (count == 0) {
+        printf("No ISBNs found in %s.\n", filename);
+        lib_free(keys);
+        return 1;
+    }
+
+    // Default: the old fixed table size and the power of two the resizable index would use
+    long sizes[2] = {LEGACY_HASH_BUCKETS, 1};
+    int size_count = 2;
+    if (buckets > 0) {
+        sizes[0] = buckets;
+        size_count = 1;
+    } else {
+        while (sizes[1] < count) {
+            sizes[1] *= 2;
+        }
+    }
+
+    const char *names[] = {"poly31", "djb2", "fnv1a", "poly31+fmix32", "siphash13"};
+    HashCandidateFunction candidates[] = {hash_poly31, hash_djb2, hash_fnv1a, hash_poly31_mixed, hash_isbn_low32};
+    int candidate_count = sizeof(candidates) / sizeof(candidates[0]);
+
+    printf("Evaluating %d hash functions on %ld ISBNs from %s\n", candidate_count, count, filename);
+    printf("Quality is total hit probes relative to a uniform random hash (1.00 is ideal).\n\n");
+    printf("%-14s | %9s | %9s | %9s | %8s | %8s | %7s | %7s\n",
+           "Hash", "Buckets", "Max chain", "Empty", "Hit", "Miss", "Quality", "ns/hash");
+    printf("------------------------------------------------------------------------------------------\n");
+    for (int s = 0; s < size_count; s++) {
+        for (int c = 0; c < candidate_count; c++) {
+            hash_evaluate(names[c], candidates[c], keys, count, sizes[s]);
+        }
+    }
+
+    lib_free(keys);
+    return 0;
+}
+
+
+// --- Trace Functions ---
+
+// Turn tracing on; must happen before other threads start
+void trace_start() {
+    trace_start_ns = monotonic_ns();
+    trace_enabled = 1;
+}
+
+// The calling thread's ring, registered on first use
+TraceRing* trace_ring() {
+    if (trace_local == NULL) {
+        TraceRing *ring = (TraceRing*)lib_calloc(ALLOC_TOOLS, 1, sizeof(TraceRing));
+        if (ring == NULL) {
+            return NULL;
+        }
+        ring->thread_name = trace_local_name;
+        pthread_mutex_lock(&trace_mutex);
+        ring->tid = ++trace_ring_count;
+        ring->next = trace_rings;
+        trace_rings = ring;
+        pthread_mutex_unlock(&trace_mutex);
+        trace_local = ring;
+    }
+    return trace_local;
+}
+
+void trace_event(const char *name, const char *category, char phase) {
+    TraceRing *ring = trace_ring();
+    if (ring == NULL) {
+        return;
+    }
+    TraceEvent *event = &ring->events[ring->written % TRACE_RING_EVENTS];
+    event->ts_ns = monotonic_ns() - trace_start_ns;
+    event->name = name;
+    event->category = category;
+    event->phase = phase;
+    ring->written++;
+}
+
+// Span markers; a single predictable branch when tracing is off
+void trace_begin(const char *name, const char *category) {
+    if (trace_enabled) {
+        trace_event(name, category, 'B');
+    }
+}
+
+void trace_end(const char *name, const char *category) {
+    if (trace_enabled) {
+        trace_event(name, category, 'E');
+    }
+}
+
+// Label the calling thread in the trace viewer
+void trace_set_thread_name(const char *name) {
+    trace_local_name = name;
+    if (trace_local != NULL) {
+        trace_local->thread_name = name;
+    }
+}
+
+// Write every ring as Chrome trace JSON (opens in Perfetto or chrome://tracing)
+void trace_flush(const char *filename) {
+    FILE *file = fopen(filename, "w");
+    if (file == NULL) {
+        perror("Error opening trace file for writing");
+        return;
+    }
+
+    long written = 0;
+    fprintf(file, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[");
+    pthread_mutex_lock(&trace_mutex);
+    for (TraceRing *ring = trace_rings; ring != NULL; ring = ring->next) {
+        fprintf(file, "%s\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"%s\"}}",
+                written > 0 ? "," : "", ring->tid, ring->thread_name);
+        written++;
+        uint64_t first = ring->written > TRACE_RING_EVENTS ? ring->written - TRACE_RING_EVENTS : 0;
+        for (uint64_t i = first; i < ring->written; i++) {
+            TraceEvent *event = &ring->events[i % TRACE_RING_EVENTS];
+            fprintf(file, ",\n{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"%c\",\"ts\":%.3f,\"pid\":1,\"tid\":%d}",
+                    event->name, event->category, event->phase, event->ts_ns / 1e3, ring->tid);
+            written++;
+        }
+    }
+    pthread_mutex_unlock(&trace_mutex);
+    fprintf(file, "\n]}\n");
+    fclose(file);
+    printf("Trace with %ld events written to %s.\n", written, filename);
+}
+
+void free_trace_rings() {
+    pthread_mutex_lock(&trace_mutex);
+    TraceRing *ring = trace_rings;
+    while (ring != NULL) {
+        TraceRing *next = ring->next;
+        lib_free(ring);
+        ring = next;
+    }
+    trace_rings = NULL;
+    trace_local = NULL;
+    pthread_mutex_unlock(&trace_mutex);
+}
+
+
+// --- Latency Histogram Functions ---
+
+const char *latency_op_names[LATENCY_OPS] = {
+    "add_book", "remove_book", "add_copies", "add_user", "remove_user", "issue_book", "return_book",
+    "place_hold", "cancel_hold", "kiosk_checkout", "kiosk_return", "search_isbn", "search_title", "search_author"
+};
+
+// Log-linear bucket: exact below 64 ns, then LATENCY_SUB_BUCKETS per power of two
+int latency_bucket(uint64_t ns) {
+    if (ns < LATENCY_LINEAR_BUCKETS) {
+        return (int)ns;
+    }
+    int exponent = 63 - __builtin_clzll(ns); // At least 6 here
+    if (exponent > LATENCY_MAX_EXPONENT) {
+        return LATENCY_BUCKETS - 1;
+    }
+    return LATENCY_LINEAR_BUCKETS + (exponent - 6) * LATENCY_SUB_BUCKETS + (int)((ns >> (exponent - 5)) & 31);
+}
+
+// Largest latency that falls in a bucket
+uint64_t latency_bucket_upper(int bucket) {
+    if (bucket < LATENCY_LINEAR_BUCKETS) {
+        return (uint64_t)bucket;
+    }
+    int exponent = (bucket - LATENCY_LINEAR_BUCKETS) / LATENCY_SUB_BUCKETS + 6;
+    uint64_t sub = (uint64_t)((bucket - LATENCY_LINEAR_BUCKETS) % LATENCY_SUB_BUCKETS);
+    return (1ULL << exponent) + ((sub + 1) << (exponent - 5)) - 1;
+}
+
+// The calling thread's recorder, registered on first use
+LatencyRecorder* latency_recorder() {
+    if (latency_local == NULL) {
+        LatencyRecorder *recorder = (LatencyRecorder*)lib_calloc(ALLOC_TOOLS, 1, sizeof(LatencyRecorder));
+        if (recorder == NULL) {
+            return NULL;
+        }
+        pthread_mutex_lock(&latency_mutex);
+        recorder->next = latency_recorders;
+        latency_recorders = recorder;
+        pthread_mutex_unlock(&latency_mutex);
+        latency_local = recorder;
+    }
+    return latency_local;
+}
+
+// Record and return the time since start_ns. Single writer, so relaxed load+store needs no locked instruction.
+uint64_t latency_record(int op, uint64_t start_ns) {
+    uint64_t ns = monotonic_ns() - start_ns;
+    LatencyRecorder *recorder = latency_recorder();
+    if (recorder == NULL) {
+        return ns;
+    }
+    _Atomic uint64_t *count = &recorder->counts[op][latency_bucket(ns)];
+    atomic_store_explicit(count, atomic_load_explicit(count, memory_order_relaxed) + 1, memory_order_relaxed);
+    atomic_store_explicit(&recorder->total_ns[op],
+                          atomic_load_explicit(&recorder->total_ns[op], memory_order_relaxed) + ns,
+                          memory_order_relaxed);
+    if (ns > atomic_load_explicit(&recorder->max_ns[op], memory_order_relaxed)) {
+        atomic_store_explicit(&recorder->max_ns[op], ns, memory_order_relaxed);
+    }
+    return ns;
+}
+
+// Add heap calls made during one operation to the calling thread's totals
+void latency_record_allocs(int op, uint64_t allocs, uint64_t frees, uint64_t bytes) {
+    LatencyRecorder *recorder = latency_recorder();
+    if (recorder == NULL) {
+        return;
+    }
+    atomic_store_explicit(&recorder->allocs[op],
+                          atomic_load_explicit(&recorder->allocs[op], memory_order_relaxed) + allocs,
+                          memory_order_relaxed);
+    atomic_store_explicit(&recorder->frees[op],
+                          atomic_load_explicit(&recorder->frees[op], memory_order_relaxed) + frees,
+                          memory_order_relaxed);
+    atomic_store_explicit(&recorder->bytes[op],
+                          atomic_load_explicit(&recorder->bytes[op], memory_order_relaxed) + bytes,
+                          memory_order_relaxed);
+}
+
+// Bracket one engine operation: latency histogram, heap calls, trace span and slow log.
+// The arguments are only copied if the operation turns out slow, so they must outlive it.
+uint64_t engine_op_begin(int op, const char *text_arg, long number_arg) {
+    if (op < LATENCY_SEARCH_ISBN) {
+        engine_mutation_count++; // Everything before the searches can change saved state
+    }
+    if (capture_file != NULL) {
+        capture_record(op, text_arg, number_arg);
+    }
+    op_extra_count = 0;
+    trace_begin(latency_op_names[op], "engine");
+    op_alloc_start[op] = alloc_counters;
+    op_text_arg = text_arg;
+    op_number_arg = number_arg;
+    op_rehash_start_ns = thread_rehash_ns;
+    op_resize_start = hash_resize_count;
+    return monotonic_ns();
+}
+
+void engine_op_end(int op, uint64_t started) {
+    AllocCounters used = alloc_counters; // Taken first so registering a recorder is not charged to the op
+    uint64_t ns = latency_record(op, started);
+    used.allocs -= op_alloc_start[op].allocs;
+    used.frees -= op_alloc_start[op].frees;
+    used.bytes -= op_alloc_start[op].bytes;
+    latency_record_allocs(op, used.allocs, used.frees, used.bytes);
+    if (ns + input_lock_wait_ns >= slow_op_threshold_ns) {
+        slow_log_record(op, ns, &used);
+    }
+    input_lock_wait_ns = 0; // Charged to this operation only
+    metrics_publish();
+    trace_end(latency_op_names[op], "engine");
+}
+
+// Sum one operation's histograms over every thread
+void latency_merge(int op, LatencySummary *summary) {
+    memset(summary, 0, sizeof(*summary));
+    pthread_mutex_lock(&latency_mutex);
+    for (LatencyRecorder *recorder = latency_recorders; recorder != NULL; recorder = recorder->next) {
+        for (int b = 0; b < LATENCY_BUCKETS; b++) {
+            uint64_t count = atomic_load_explicit(&recorder->counts[op][b], memory_order_relaxed);
+            summary->counts[b] += count;
+            summary->count += count;
+        }
+        summary->total_ns += atomic_load_explicit(&recorder->total_ns[op], memory_order_relaxed);
+        summary->allocs += atomic_load_explicit(&recorder->allocs[op], memory_order_relaxed);
+        summary->frees += atomic_load_explicit(&recorder->frees[op], memory_order_relaxed);
+        summary->bytes += atomic_load_explicit(&recorder->bytes[op], memory_order_relaxed);
+        uint64_t max = atomic_load_explicit(&recorder->max_ns[op], memory_order_relaxed);
+        if (max > summary->max_ns) {
+            summary->max_ns = max;
+        }
+    }
+    pthread_mutex_unlock(&latency_mutex);
+}
+
+// Upper bound of the bucket holding the given quantile (0..1)
+uint64_t latency_percentile(LatencySummary *summary, double quantile) {
+    if (summary->count == 0) {
+        return 0;
+    }
+    uint64_t rank = (uint64_t)(quantile * summary->count);
+    if (rank >= summary->count) {
+        rank = summary->count - 1;
+    }
+    uint64_t seen = 0;
+    for (int b = 0; b < LATENCY_BUCKETS; b++) {
+        seen += summary->counts[b];
+        if (seen > rank) {
+            uint64_t upper = latency_bucket_upper(b);
+            return upper < summary->max_ns ? upper : summary->max_ns;
+        }
+    }
+    return summary->max_ns;
+}
+
+// Report: latency percentiles per engine operation since startup
+void list_operation_latency() {
+    printf("\n===== Operation Latency (microseconds) =====\n");
+    printf("%-15s | %8s | %9s | %9s | %9s | %9s | %9s | %9s | %8s | %8s | %9s\n",
+           "Operation", "Count", "Mean", "p50", "p90", "p99", "p99.9", "Max", "Allocs/op", "Frees/op", "Bytes/op");
+    printf("---------------------------------------------------------------------------------------------------------------------------------------\n");
+
+    LatencySummary summary;
+    int shown = 0;
+    for (int op = 0; op < LATENCY_OPS; op++) {
+        latency_merge(op, &summary);
+        if (summary.count == 0) {
+            continue;
+        }
+        printf("%-15s | %8llu | %9.2f | %9.2f | %9.2f | %9.2f | %9.2f | %9.2f | %9.2f | %8.2f | %9.1f\n",
+               latency_op_names[op], (unsigned long long)summary.count,
+               summary.total_ns / 1e3 / summary.count,
+               latency_percentile(&summary, 0.50) / 1e3, latency_percentile(&summary, 0.90) / 1e3,
+               latency_percentile(&summary, 0.99) / 1e3, latency_percentile(&summary, 0.999) / 1e3,
+               summary.max_ns / 1e3, (double)summary.allocs / summary.count,
+               (double)summary.frees / summary.count, (double)summary.bytes / summary.count);
+        shown++;
+    }
+
+    if (shown == 0) {
+        printf("No operations recorded yet.\n");
+    }
+    list_subsystem_allocations();
+}
+
+// Report: heap totals per subsystem since startup, all threads
+void list_subsystem_allocations() {
+    printf("\n===== Heap Use by Subsystem =====\n");
+    printf("%-12s | %10s | %10s | %14s | %14s\n", "Subsystem", "Allocs", "Frees", "Bytes", "Live bytes");
+    printf("---------------------------------------------------------------------\n");
+    for (int i = 0; i < ALLOC_SUBSYSTEMS; i++) {
+        SubsystemAllocStats *stats = &subsystem_allocs[i];
+        printf("%-12s | %10llu | %10llu | %14llu | %14lld\n", alloc_subsystem_names[i],
+               (unsigned long long)atomic_load_explicit(&stats->allocs, memory_order_relaxed),
+               (unsigned long long)atomic_load_explicit(&stats->frees, memory_order_relaxed),
+               (unsigned long long)atomic_load_explicit(&stats->bytes, memory_order_relaxed),
+               (long long)atomic_load_explicit(&stats->live_bytes, memory_order_relaxed));
+    }
+}
+
+// Write every non-empty histogram as JSON: percentiles plus [bucket upper bound ns, count] pairs
+void dump_latency_histograms(const char *filename) {
+    FILE *file = fopen(filename, "w");
+    if (file == NULL) {
+        perror("Error opening latency file for writing");
+        return;
+    }
+
+    LatencySummary summary;
+    fprintf(file, "{\"generated_at\":%ld,\"operations\":[", (long)time(NULL));
+    int written = 0;
+    for (int op = 0; op < LATENCY_OPS; op++) {
+        latency_merge(op, &summary);
+        if (summary.count == 0) {
+            continue;
+        }
+        fprintf(file, "%s\n{\"op\":\"%s\",\"count\":%llu,\"total_ns\":%llu,\"p50_ns\":%llu,\"p90_ns\":%llu,"
+                "\"p99_ns\":%llu,\"p999_ns\":%llu,\"max_ns\":%llu,\"allocs\":%llu,\"frees\":%llu,\"bytes\":%llu,"
+                "\"buckets\":[",
+                written > 0 ? "," : "", latency_op_names[op],
+                (unsigned long long)summary.count, (unsigned long long)summary.total_ns,
+                (unsigned long long)latency_percentile(&summary, 0.50),
+                (unsigned long long)latency_percentile(&summary, 0.90),
+                (unsigned long long)latency_percentile(&summary, 0.99),
+                (unsigned long long)latency_percentile(&summary, 0.999),
+                (unsigned long long)summary.max_ns, (unsigned long long)summary.allocs,
+                (unsigned long long)summary.frees, (unsigned long long)summary.bytes);
+        int first = 1;
+        for (int b = 0; b < LATENCY_BUCKETS; b++) {
+            if (summary.counts[b] > 0) {
+                fprintf(file, "%s[%llu,%llu]", first ? "" : ",",
+                        (unsigned long long)latency_bucket_upper(b), (unsigned long long)summary.counts[b]);
+                first = 0;
+            }
+        }
+        fprintf(file, "]}");
+        written++;
+    }
+    fprintf(file, "\n],\"subsystems\":[");
+    for (int i = 0; i < ALLOC_SUBSYSTEMS; i++) {
+        SubsystemAllocStats *stats = &subsystem_allocs[i];
+        fprintf(file, "%s\n{\"subsystem\":\"%s\",\"allocs\":%llu,\"frees\":%llu,\"bytes\":%llu,\"live_bytes\":%lld}",
+                i > 0 ? "," : "", alloc_subsystem_names[i],
+                (unsigned long long)atomic_load_explicit(&stats->allocs, memory_order_relaxed),
+                (unsigned long long)atomic_load_explicit(&stats->frees, memory_order_relaxed),
+                (unsigned long long)atomic_load_explicit(&stats->bytes, memory_order_relaxed),
+                (long long)atomic_load_explicit(&stats->live_bytes, memory_order_relaxed));
+    }
+    fprintf(file, "\n]}\n");
+    fclose(file);
+    printf("Latency histograms for %d operations written to %s.\n", written, filename);
+}
+
+// Free every thread's recorder (at exit, once no thread records any more)
+void free_latency_recorders() {
+    pthread_mutex_lock(&latency_mutex);
+    LatencyRecorder *recorder = latency_recorders;
+    while (recorder != NULL) {
+        LatencyRecorder *next = recorder->next;
+        lib_free(recorder);
+        recorder = next;
+    }
+    latency_recorders = NULL;
+    latency_local = NULL;
+    pthread_mutex_unlock(&latency_mutex);
+}
+
+
+// --- Slow Operation Log Functions ---
+
+// Capture a slow operation with its arguments, time breakdown and index state (engine lock held)
+void slow_log_record(int op, uint64_t ns, AllocCounters *used) {
+    pthread_mutex_lock(&slow_log_mutex);
+    SlowOpEntry *entry = &slow_log[slow_log_total % SLOW_LOG_ENTRIES];
+    memset(entry, 0, sizeof(*entry));
+    entry->when = time(NULL);
+    entry->op = op;
+    entry->thread_name = trace_local_name;
+    if (op_text_arg != NULL) {
+        snprintf(entry->text_arg, sizeof(entry->text_arg), "%s", op_text_arg);
+    }
+    entry->number_arg = op_number_arg;
+    entry->total_ns = ns + input_lock_wait_ns;
+    entry->lock_wait_ns = input_lock_wait_ns;
+    entry->rehash_ns = thread_rehash_ns - op_rehash_start_ns;
+    entry->allocs = used->allocs;
+    entry->alloc_bytes = used->bytes;
+    if (input_lock_holder != NULL) {
+        snprintf(entry->waited_on, sizeof(entry->waited_on), "%s", input_lock_holder);
+    }
+    entry->save_running = input_wait_saw_save;
+    entry->rehashed = hash_resize_count != op_resize_start;
+    entry->titles = hash_count;
+    entry->buckets = hash_capacity;
+    entry->resizes = hash_resize_count;
+    entry->probes_per_hit = isbn_probe_stats.hits > 0
+                            ? (double)isbn_probe_stats.hit_probes / isbn_probe_stats.hits : 0.0;
+    entry->active_loans = active_loan_count;
+    slow_log_total++;
+    pthread_mutex_unlock(&slow_log_mutex);
+}
+
+// Report: the slow-operation ring, newest first
+void list_slow_operations() {
+    pthread_mutex_lock(&slow_log_mutex);
+    long shown = slow_log_total < SLOW_LOG_ENTRIES ? slow_log_total : SLOW_LOG_ENTRIES;
+    printf("\n===== Slow Operations (over %.1f ms, %ld recorded, newest first) =====\n",
+           slow_op_threshold_ns / 1e6, slow_log_total);
+    if (shown == 0) {
+        printf("No slow operations recorded.\n");
+    }
+    for (long i = 0; i < shown; i++) {
+        SlowOpEntry *entry = &slow_log[(slow_log_total - 1 - i) % SLOW_LOG_ENTRIES];
+        char when[32];
+        strftime(when, sizeof(when), "%Y-%m-%d %H:%M:%S", localtime(&entry->when));
+        uint64_t run_ns = entry->total_ns - entry->lock_wait_ns;
+        printf("\n%s  %s on %s thread: %.3f ms\n", when, latency_op_names[entry->op], entry->thread_name,
+               entry->total_ns / 1e6);
+        printf("  args: \"%s\"", entry->text_arg);
+        if (entry->number_arg >= 0) {
+            printf(", %ld", entry->number_arg);
+        }
+        printf("\n  lock wait %.3f ms", entry->lock_wait_ns / 1e6);
+        if (entry->waited_on[0] != '\0') {
+            printf(" (behind %s)", entry->waited_on);
+        }
+        printf(", run %.3f ms (rehash %.3f ms), %llu allocs / %llu bytes\n", run_ns / 1e6, entry->rehash_ns / 1e6,
+               (unsigned long long)entry->allocs, (unsigned long long)entry->alloc_bytes);
+        printf("  index: %ld titles in %d buckets (load %.2f), %ld resizes, %.2f probes/hit, %d active loans\n",
+               entry->titles, entry->buckets, entry->buckets > 0 ? (double)entry->titles / entry->buckets : 0.0,
+               entry->resizes, entry->probes_per_hit, entry->active_loans);
+        printf("  concurrent: save %s, rehash %s\n", entry->save_running ? "yes" : "no",
+               entry->rehashed ? "yes" : "no");
+    }
+    pthread_mutex_unlock(&slow_log_mutex);
+}
+
+
+// --- Metrics Export Functions ---
+
+// Copy engine totals into the published gauges; called with the engine lock held after each change
+void metrics_publish() {
+    atomic_store_explicit(&metrics_gauges.titles, hash_count, memory_order_relaxed);
+    atomic_store_explicit(&metrics_gauges.users, registered_users, memory_order_relaxed);
+    atomic_store_explicit(&metrics_gauges.active_loans, active_loan_count, memory_order_relaxed);
+    atomic_store_explicit(&metrics_gauges.history_events, history_event_count, memory_order_relaxed);
+    atomic_store_explicit(&metrics_gauges.index_buckets, hash_capacity, memory_order_relaxed);
+    atomic_store_explicit(&metrics_gauges.index_resizes, hash_resize_count, memory_order_relaxed);
+}
+
+void metrics_family(FILE *out, const char *name, const char *type, const char *help) {
+    fprintf(out, "# HELP %s %s\n# TYPE %s %s\n", name, help, name, type);
+}
+
+// Write every metric in Prometheus text format. Reads only atomics and the latency recorders,
+// never the engine lock, so a scrape cannot hold up circulation.
+void metrics_render(FILE *out) {
+    static LatencySummary summaries[LATENCY_OPS]; // Only the exporter thread renders
+    for (int op = 0; op < LATENCY_OPS; op++) {
+        latency_merge(op, &summaries[op]);
+    }
+
+    metrics_family(out, "library_operations_total", "counter", "Engine operations completed.");
+    for (int op = 0; op < LATENCY_OPS; op++) {
+        fprintf(out, "library_operations_total{op=\"%s\"} %llu\n", latency_op_names[op],
+                (unsigned long long)summaries[op].count);
+    }
+    metrics_family(out, "library_operation_latency_seconds", "summary", "Engine operation latency since startup.");
+    const double quantiles[] = {0.5, 0.9, 0.99, 0.999};
+    for (int op = 0; op < LATENCY_OPS; op++) {
+        for (int q = 0; q < 4; q++) {
+            fprintf(out, "library_operation_latency_seconds{op=\"%s\",quantile=\"%g\"} %.9f\n",
+                    latency_op_names[op], quantiles[q], latency_percentile(&summaries[op], quantiles[q]) / 1e9);
+        }
+        fprintf(out, "library_operation_latency_seconds_sum{op=\"%s\"} %.9f\n", latency_op_names[op],
+                summaries[op].total_ns / 1e9);
+        fprintf(out, "library_operation_latency_seconds_count{op=\"%s\"} %llu\n", latency_op_names[op],
+                (unsigned long long)summaries[op].count);
+    }
+    metrics_family(out, "library_operation_allocations_total", "counter", "Heap allocations made by engine operations.");
+    for (int op = 0; op < LATENCY_OPS; op++) {
+        fprintf(out, "library_operation_allocations_total{op=\"%s\"} %llu\n", latency_op_names[op],
+                (unsigned long long)summaries[op].allocs);
+    }
+
+    metrics_family(out, "library_catalog_titles", "gauge", "Titles in the catalog.");
+    fprintf(out, "library_catalog_titles %ld\n", atomic_load_explicit(&metrics_gauges.titles, memory_order_relaxed));
+    metrics_family(out, "library_users", "gauge", "Registered users.");
+    fprintf(out, "library_users %ld\n", atomic_load_explicit(&metrics_gauges.users, memory_order_relaxed));
+    metrics_family(out, "library_active_loans", "gauge", "Copies currently on loan.");
+    fprintf(out, "library_active_loans %ld\n",
+            atomic_load_explicit(&metrics_gauges.active_loans, memory_order_relaxed));
+    metrics_family(out, "library_history_events", "gauge", "Loan history events held in memory.");
+    fprintf(out, "library_history_events %ld\n",
+            atomic_load_explicit(&metrics_gauges.history_events, memory_order_relaxed));
+    metrics_family(out, "library_isbn_index_buckets", "gauge", "Buckets in the ISBN hash index.");
+    fprintf(out, "library_isbn_index_buckets %ld\n",
+            atomic_load_explicit(&metrics_gauges.index_buckets, memory_order_relaxed));
+    metrics_family(out, "library_isbn_index_resizes_total", "counter", "Times the ISBN index has grown.");
+    fprintf(out, "library_isbn_index_resizes_total %ld\n",
+            atomic_load_explicit(&metrics_gauges.index_resizes, memory_order_relaxed));
+
+    metrics_family(out, "library_heap_live_bytes", "gauge", "Requested heap bytes not yet freed, by subsystem.");
+    for (int i = 0; i < ALLOC_SUBSYSTEMS; i++) {
+        fprintf(out, "library_heap_live_bytes{subsystem=\"%s\"} %lld\n", alloc_subsystem_names[i],
+                (long long)atomic_load_explicit(&subsystem_allocs[i].live_bytes, memory_order_relaxed));
+    }
+    metrics_family(out, "library_heap_allocations_total", "counter", "Heap allocations, by subsystem.");
+    for (int i = 0; i < ALLOC_SUBSYSTEMS; i++) {
+        fprintf(out, "library_heap_allocations_total{subsystem=\"%s\"} %llu\n", alloc_subsystem_names[i],
+                (unsigned long long)atomic_load_explicit(&subsystem_allocs[i].allocs, memory_order_relaxed));
+    }
+
+    metrics_family(out, "library_saves_total", "counter", "Completed saves (checkpoints and exit).");
+    fprintf(out, "library_saves_total %llu\n", (unsigned long long)atomic_load(&save_count));
+    metrics_family(out, "library_save_duration_seconds_total", "counter", "Time spent saving.");
+    fprintf(out, "library_save_duration_seconds_total %.6f\n", atomic_load(&save_total_ns) / 1e9);
+    metrics_family(out, "library_save_last_duration_seconds", "gauge", "Duration of the most recent save.");
+    fprintf(out, "library_save_last_duration_seconds %.6f\n", atomic_load(&save_last_ns) / 1e9);
+    metrics_family(out, "library_save_last_completed_timestamp_seconds", "gauge", "When the most recent save finished.");
+    fprintf(out, "library_save_last_completed_timestamp_seconds %lld\n", (long long)atomic_load(&save_last_completed));
+    metrics_family(out, "library_start_time_seconds", "gauge", "When the process started.");
+    fprintf(out, "library_start_time_seconds %lld\n", (long long)process_start_time);
+}
+
+// Write to a temporary file and rename it over the target, so readers never see half a scrape
+int metrics_write_file(const char *filename) {
+    char temp_name[512];
+    snprintf(temp_name, sizeof(temp_name), "%s.tmp", filename);
+    FILE *file = fopen(temp_name, "w");
+    if (file == NULL) {
+        return 0;
+    }
+    metrics_render(file);
+    if (fclose(file) != 0 || rename(temp_name, filename) != 0) {
+        remove(temp_name);
+        return 0;
+    }
+    return 1;
+}
+
+// Answer one HTTP request on the metrics socket
+void metrics_serve_client() {
+    int client = accept(metrics_listen_fd, NULL, NULL);
+    if (client < 0) {
+        return;
+    }
+    struct timeval timeout = {1, 0}; // A stalled client cannot hold up the exporter for long
+    setsockopt(client, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    setsockopt(client, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+
+    char request[1024];
+    ssize_t received = recv(client, request, sizeof(request) - 1, 0);
+    request[received > 0 ? received : 0] = '\0';
+    int found = strncmp(request, "GET /metrics", 12) == 0 || strncmp(request, "GET / ", 6) == 0;
+
+    char *body = NULL;
+    size_t body_length = 0;
+    FILE *stream = open_memstream(&body, &body_length);
+    if (stream == NULL) {
+        close(client);
+        return;
+    }
+    if (found) {
+        metrics_render(stream);
+    } else {
+        fprintf(stream, "Not found; metrics are at /metrics\n");
+    }
+    fclose(stream);
+
+    char header[256];
+    int header_length = snprintf(header, sizeof(header),
+                                 "HTTP/1.0 %s\r\nContent-Type: text/plain; version=0.0.4\r\n"
+                                 "Content-Length: %zu\r\nConnection: close\r\n\r\n",
+                                 found ? "200 OK" : "404 Not Found", body_length);
+    send(client, header, header_length, MSG_NOSIGNAL);
+    for (size_t sent = 0; sent < body_length;) {
+        ssize_t n = send(client, body + sent, body_length - sent, MSG_NOSIGNAL);
+        if (n <= 0) {
+            break;
+        }
+        sent += (size_t)n;
+    }
+    free(body); // Allocated by open_memstream, not lib_malloc
+    close(client);
+}
+
+// Exporter thread: rewrites the metrics file on its interval and answers scrapes in between
+void* metrics_run(void *arg) {
+    (void)arg;
+    trace_set_thread_name("metrics");
+    uint64_t next_write = 0;
+    while (!atomic_load(&metrics_stopping)) {
+        uint64_t now = monotonic_ns();
+        if (metrics_file != NULL && now >= next_write) {
+            if (!metrics_write_file(metrics_file)) {
+                fprintf(stderr, "Could not write metrics to %s.\n", metrics_file);
+            }
+            next_write = now + (uint64_t)METRICS_INTERVAL_SEC * 1000000000ULL;
+        }
+        if (metrics_listen_fd >= 0) {
+            struct pollfd listener = {metrics_listen_fd, POLLIN, 0};
+            if (poll(&listener, 1, METRICS_POLL_MS) > 0) {
+                metrics_serve_client();
+            }
+        } else {
+            usleep(METRICS_POLL_MS * 1000);
+        }
+    }
+    return NULL;
+}
+
+// Start the exporter for a file, a localhost port (0 for none), or both
+int metrics_start(const char *filename, int port) {
+    metrics_file = filename;
+    if (port > 0) {
+        metrics_listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+        struct sockaddr_in address;
+        memset(&address, 0, sizeof(address));
+        address.sin_family = AF_INET;
+        address.sin_port = htons((uint16_t)port);
+        address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        int reuse = 1;
+        if (metrics_listen_fd < 0 ||
+            setsockopt(metrics_listen_fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse)) != 0 ||
+            bind(metrics_listen_fd, (struct sockaddr*)&address, sizeof(address)) != 0 ||
+            listen(metrics_listen_fd, 8) != 0) {
+            perror("Could not open metrics port");
+            if (metrics_listen_fd >= 0) {
+                close(metrics_listen_fd);
+            }
+            metrics_listen_fd = -1;
+        }
+    }
+    if (metrics_file == NULL && metrics_listen_fd < 0) {
+        return 0;
+    }
+    if (pthread_create(&metrics_thread, NULL, metrics_run, NULL) != 0) {
+        printf("Could not start the metrics exporter.\n");
+        return 0;
+    }
+    metrics_running = 1;
+    return 1;
+}
+
+void metrics_stop() {
+    if (!metrics_running) {
+        return;
+    }
+    atomic_store(&metrics_stopping, 1);
+    pthread_join(metrics_thread, NULL);
+    metrics_running = 0;
+    if (metrics_file != NULL) {
+        metrics_write_file(metrics_file); // Final totals, including the exit save
+    }
+    if (metrics_listen_fd >= 0) {
+        close(metrics_listen_fd);
+        metrics_listen_fd = -1;
+    }
+}
+
+
+// --- Hardware Counter Functions ---
+
+const char *perf_op_names[PERF_OPS] = {
+    "search_isbn", "search_title", "find_user", "report_all_books", "report_available", "report_borrowed",
+    "report_most_borrowed", "report_active_users", "report_overdue", "report_due_soon",
+    "report_monthly_genre", "report_trending"
+};
+const char *perf_counter_names[PERF_COUNTERS] = {"cycles", "instructions", "cache_misses", "branch_misses"};
+
+int perf_open_event(uint32_t type, uint64_t config, int group_fd) {
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = type;
+    attr.config = config;
+    attr.disabled = group_fd < 0; // The leader starts the whole group
+    attr.exclude_kernel = 1;      // User-space only, allowed at perf_event_paranoid 2
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_GROUP;
+    return (int)syscall(SYS_perf_event_open, &attr, 0, -1, group_fd, 0);
+}
+
+// Open the calling thread's counter group; counters the CPU lacks are left out of the group
+int perf_thread_open() {
+    if (perf_group_fd >= 0) {
+        return 1;
+    }
+    static const uint64_t configs[PERF_COUNTERS] = {
+        PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS, PERF_COUNT_HW_CACHE_MISSES,
+        PERF_COUNT_HW_BRANCH_MISSES
+    };
+    perf_group_size = 0;
+    for (int c = 0; c < PERF_COUNTERS; c++) {
+        perf_group_slots[c] = -1;
+        int fd = perf_open_event(PERF_TYPE_HARDWARE, configs[c], perf_group_fd);
+        if (fd < 0) {
+            continue;
+        }
+        if (perf_group_fd < 0) {
+            perf_group_fd = fd;
+        }
+        perf_group_slots[c] = perf_group_size++;
+    }
+    if (perf_group_fd < 0) {
+        return 0;
+    }
+    ioctl(perf_group_fd, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+    ioctl(perf_group_fd, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+    return 1;
+}
+
+// Open counters for the process if the kernel lets us; otherwise explain and carry on without.
+// Callers set perf_enabled to measure regions call by call.
+int perf_start() {
+    if (!perf_thread_open()) {
+        fprintf(stderr, "Hardware counters unavailable (perf_event_open: %s); continuing without them. "
+                "Check /proc/sys/kernel/perf_event_paranoid or the container's seccomp profile.\n",
+                strerror(errno));
+        return 0;
+    }
+    for (int c = 0; c < PERF_COUNTERS; c++) {
+        perf_available[c] = perf_group_slots[c] >= 0;
+        if (!perf_available[c]) {
+            fprintf(stderr, "Hardware counter %s is not supported here; it will show as n/a.\n",
+                    perf_counter_names[c]);
+        }
+    }
+    return 1;
+}
+
+// Read every counter of the calling thread's group with one system call
+int perf_read(PerfSample *sample) {
+    uint64_t buffer[1 + PERF_COUNTERS];
+    memset(sample, 0, sizeof(*sample));
+    if (!perf_thread_open() || read(perf_group_fd, buffer, sizeof(buffer)) < (ssize_t)sizeof(uint64_t)) {
+        return 0;
+    }
+    for (int c = 0; c < PERF_COUNTERS; c++) {
+        if (perf_group_slots[c] >= 0 && (uint64_t)perf_group_slots[c] < buffer[0]) {
+            sample->values[c] = buffer[1 + perf_group_slots[c]];
+        }
+    }
+    return 1;
+}
+
+// Bracket a measured region; a single flag test when counters are off
+void perf_begin(int op) {
+    if (!perf_enabled) {
+        return;
+    }
+    perf_read(&perf_start_samples[op]);
+}
+
+void perf_end(int op) {
+    if (!perf_enabled) {
+        return;
+    }
+    PerfSample now;
+    if (!perf_read(&now)) {
+        return;
+    }
+    PerfOpStats *stats = &perf_stats[op];
+    atomic_fetch_add_explicit(&stats->calls, 1, memory_order_relaxed);
+    for (int c = 0; c < PERF_COUNTERS; c++) {
+        atomic_fetch_add_explicit(&stats->totals[c], now.values[c] - perf_start_samples[op].values[c],
+                                  memory_order_relaxed);
+    }
+}
+
+// Report: average counter deltas per call for each measured region
+void list_perf_counters() {
+    printf("\n===== Hardware Counters (per call, user space) =====\n");
+    if (!perf_enabled) {
+        printf("Counters are off. Start with --perf-counters to collect them.\n");
+        return;
+    }
+    printf("%-22s | %9s | %12s | %12s | %6s | %12s | %12s\n",
+           "Region", "Calls", "Cycles", "Instructions", "IPC", "Cache miss", "Branch miss");
+    printf("--------------------------------------------------------------------------------------------------------\n");
+    int shown = 0;
+    for (int op = 0; op < PERF_OPS; op++) {
+        uint64_t calls = atomic_load_explicit(&perf_stats[op].calls, memory_order_relaxed);
+        if (calls == 0) {
+            continue;
+        }
+        double per_call[PERF_COUNTERS];
+        char cells[PERF_COUNTERS][24];
+        for (int c = 0; c < PERF_COUNTERS; c++) {
+            per_call[c] = (double)atomic_load_explicit(&perf_stats[op].totals[c], memory_order_relaxed) / calls;
+            if (perf_available[c]) {
+                snprintf(cells[c], sizeof(cells[c]), "%.1f", per_call[c]);
+            } else {
+                snprintf(cells[c], sizeof(cells[c]), "n/a");
+            }
+        }
+        char ipc[16] = "n/a";
+        if (perf_available[0] && perf_available[1] && per_call[0] > 0.0) {
+            snprintf(ipc, sizeof(ipc), "%.2f", per_call[1] / per_call[0]);
+        }
+        printf("%-22s | %9llu | %12s | %12s | %6s | %12s | %12s\n", perf_op_names[op],
+               (unsigned long long)calls, cells[0], cells[1], ipc, cells[2], cells[3]);
+        shown++;
+    }
+    if (shown == 0) {
+        printf("No measured regions have run yet.\n");
+    }
+}
+
+
+// --- Hold Queue Functions ---
+
+// Place a hold on a borrowed book for a user
+int place_hold(int user_id, char *isbn, EngineResult *result) {
+    engine_result(result, ENGINE_OK);
+    User *user = find_user(user_id);
+    if (user == NULL) {
+        return engine_result(result, ENGINE_USER_NOT_FOUND);
+    }
+    result->user = user;
+
+    Book *book = search_book_by_isbn(isbn);
+    if (book == NULL) {
+        return engine_result(result, ENGINE_BOOK_NOT_FOUND);
+    }
+    result->book = book;
+
+    if (book->available > 0) {
+        return engine_result(result, ENGINE_COPIES_AVAILABLE);
+    }
+
+    for (int i = 0; i < user->borrowed_count; i++) {
+        if (strcmp(user->borrowed_books[i], isbn) == 0) {
+            return engine_result(result, ENGINE_ALREADY_BORROWED);
+        }
+    }
+
+    if (find_user_hold(user, book) != NULL) {
+        return engine_result(result, ENGINE_ALREADY_HELD);
+    }
+
+    Hold *hold = enqueue_hold(user, book, engine_now());
+    if (hold == NULL) {
+        return engine_result(result, ENGINE_NO_MEMORY);
+    }
+
+    result->count = book->hold_count; // New holds join the tail
+    return ENGINE_OK;
+}
+
+// Cancel a user's hold on a book
+int cancel_hold(int user_id, char *isbn, EngineResult *result) {
+    engine_result(result, ENGINE_OK);
+    User *user = find_user(user_id);
+    if (user == NULL) {
+        return engine_result(result, ENGINE_USER_NOT_FOUND);
+    }
+    result->user = user;
+
+    Book *book = search_book_by_isbn(isbn);
+    Hold *hold = book != NULL ? find_user_hold(user, book) : NULL;
+    if (hold == NULL) {
+        return engine_result(result, ENGINE_NO_HOLD);
+    }
+
+    remove_hold(hold);
+    result->book = book;
+    return ENGINE_OK;
+}
+
+// Append a hold to the tail of a book's queue and to the user's hold list
+Hold* enqueue_hold(User *user, Book *book, time_t placed_time) {
+    Hold *hold = (Hold*)lib_malloc(ALLOC_HOLDS, sizeof(Hold));
+    if (hold == NULL) {
+        return NULL;
+    }
+
+    hold->user = user;
+    hold->book = book;
+    hold->placed_time = placed_time;
+
+    hold->next_in_book = NULL;
+    hold->prev_in_book = book->hold_tail;
+    if (book->hold_tail != NULL) {
+        book->hold_tail->next_in_book = hold;
+    } else {
+        book->hold_head = hold;
+    }
+    book->hold_tail = hold;
+    book->hold_count++;
+
+    hold->prev_in_user = NULL;
+    hold->next_in_user = user->holds;
+    if (user->holds != NULL) {
+        user->holds->prev_in_user = hold;
+    }
+    user->holds = hold;
+    user->hold_count++;
+
+    return hold;
+}
+
+// Unlink a hold from both lists and free it (O(1))
+void remove_hold(Hold *hold) {
+    Book *book = hold->book;
+    User *user = hold->user;
+
+    if (hold->prev_in_book != NULL) {
+        hold->prev_in_book->next_in_book = hold->next_in_book;
+    } else {
+        book->hold_head = hold->next_in_book;
+    }
+    if (hold->next_in_book != NULL) {
+        hold->next_in_book->prev_in_book = hold->prev_in_book;
+    } else {
+        book->hold_tail = hold->prev_in_book;
+    }
+    book->hold_count--;
+
+    if (hold->prev_in_user != NULL) {
+        hold->prev_in_user->next_in_user = hold->next_in_user;
+    } else {
+        user->holds = hold->next_in_user;
+    }
+    if (hold->next_in_user != NULL) {
+        hold->next_in_user->prev_in_user = hold->prev_in_user;
+    }
+    user->hold_count--;
+
+    lib_free(hold);
+}
+
+// Find a user's hold on a book by walking only that user's holds
+Hold* find_user_hold(User *user, Book *book) {
+    for (Hold *hold = user->holds; hold != NULL; hold = hold->next_in_user) {
+        if (hold->book == book) {
+            return hold;
+        }
+    }
+    return NULL;
+}
+
+// 1-based position of a hold within its book's queue
+int hold_position(Hold *hold) {
+    int position = 1;
+    for (Hold *ahead = hold->prev_in_book; ahead != NULL; ahead = ahead->prev_in_book) {
+        position++;
+    }
+    return position;
+}
+
+// Drop every hold queued on a book
+void clear_book_holds(Book *book) {
+    while (book->hold_head != NULL) {
+        remove_hold(book->hold_head);
+    }
+}
+
+// Drop every hold a user has placed
+void clear_user_holds(User *user) {
+    while (user->holds != NULL) {
+        remove_hold(user->holds);
+    }
+}
+
+// Issue a just-returned book to the first eligible patron in its queue; returns the new loan or NULL
+// (if the loan cannot be allocated the hold stays queued and the copy stays on the shelf)
+Loan* serve_next_hold(Book *book) {
+    for (Hold *hold = book->hold_head; hold != NULL; hold = hold->next_in_book) {
+        User *user = hold->user;
+        if (user->borrowed_count >= MAX_BORROWED) {
+            continue; // Keeps their place until they have room
+        }
+        if (book->available == 0) {
+            return NULL;
+        }
+
+        Loan *loan = checkout_book(user, book);
+        if (loan != NULL) {
+            remove_hold(hold);
+        }
+        return loan;
+    }
+    return NULL;
+}
+
+// List the holds a user is waiting on, with queue positions
+void list_user_holds(int user_id) {
+    User *user = find_user(user_id);
+    if (user == NULL) {
+        printf("User ID %d not found.\n", user_id);
+        return;
+    }
+
+    printf("\n===== Holds for %s (ID: %d) =====\n", user->name, user->id);
+    printf("%-30s | %-15s | %-10s | %-16s\n", "Title", "ISBN", "Position", "Placed");
+    printf("-------------------------------------------------------------------------------\n");
+
+    if (user->holds == NULL) {
+        printf("No holds placed.\n");
+        return;
+    }
+
+    char placed_str[32];
+    for (Hold *hold = user->holds; hold != NULL; hold = hold->next_in_user) {
+        format_time(hold->placed_time, placed_str, sizeof(placed_str));
+        printf("%-30s | %-15s | %d of %-5d | %-16s\n",
+               hold->book->title, hold->book->isbn, hold_position(hold), hold->book->hold_count, placed_str);
+    }
+}
+
+// --- Loan History Functions ---
+
+// Allocate an empty history segment and link it at the tail
+// Only full-capacity segments are open for appends; smaller ones hold loaded blocks
+HistorySegment* history_new_segment(time_t base_time, int capacity) {
+    HistorySegment *segment = (HistorySegment*)lib_calloc(ALLOC_HISTORY, 1, sizeof(HistorySegment));
+    if (segment == NULL) {
+        return NULL;
+    }
+
+    int open = capacity == HISTORY_SEGMENT_CAPACITY;
+    segment->capacity = capacity;
+    segment->time_deltas = (uint16_t*)lib_malloc(ALLOC_HISTORY, capacity * sizeof(uint16_t));
+    segment->user_codes = (uint16_t*)lib_malloc(ALLOC_HISTORY, capacity * sizeof(uint16_t));
+    segment->book_ordinals = (uint32_t*)lib_malloc(ALLOC_HISTORY, capacity * sizeof(uint32_t));
+    segment->event_types = (uint8_t*)lib_malloc(ALLOC_HISTORY, capacity * sizeof(uint8_t));
+    segment->user_dict = (int*)lib_malloc(ALLOC_HISTORY, capacity * sizeof(int));
+    segment->user_dict_slots = open ? (int*)lib_malloc(ALLOC_HISTORY, 2 * HISTORY_SEGMENT_CAPACITY * sizeof(int)) : NULL;
+    if (segment->time_deltas == NULL || segment->user_codes == NULL || segment->book_ordinals == NULL ||
+        segment->event_types == NULL || segment->user_dict == NULL || (open && segment->user_dict_slots == NULL)) {
+        lib_free(segment->time_deltas);
+        lib_free(segment->user_codes);
+        lib_free(segment->book_ordinals);
+        lib_free(segment->event_types);
+        lib_free(segment->user_dict);
+        lib_free(segment->user_dict_slots);
+        lib_free(segment);
+        return NULL;
+    }
+    if (open) {
+        memset(segment->user_dict_slots, -1, 2 * HISTORY_SEGMENT_CAPACITY * sizeof(int));
+    }
+
+    segment->base_time = base_time;
+    segment->min_time = base_time;
+    segment->max_time = base_time;
+
+    if (history_tail != NULL) {
+        history_seal_segment(history_tail);
+        history_tail->next = segment;
+    } else {
+        history_head = segment;
+    }
+    history_tail = segment;
+    return segment;
+}
+
+// Stop appending to a segment: release its append-only lookup structures and trim the
+// columns to the events it holds, so quiet segments do not keep a full segment's memory
+void history_seal_segment(HistorySegment *segment) {
+    lib_free(segment->user_dict_slots);
+    segment->user_dict_slots = NULL;
+    if (segment->count == segment->capacity) {
+        return; // Full, or a loaded block sized exactly
+    }
+
+    size_t n = segment->count > 0 ? (size_t)segment->count : 1;
+    segment->time_deltas = (uint16_t*)history_shrink_column(segment->time_deltas, n * sizeof(uint16_t));
+    segment->user_codes = (uint16_t*)history_shrink_column(segment->user_codes, n * sizeof(uint16_t));
+    segment->book_ordinals = (uint32_t*)history_shrink_column(segment->book_ordinals, n * sizeof(uint32_t));
+    segment->event_types = (uint8_t*)history_shrink_column(segment->event_types, n * sizeof(uint8_t));
+    size_t users = segment->user_dict_count > 0 ? (size_t)segment->user_dict_count : 1;
+    segment->user_dict = (int*)history_shrink_column(segment->user_dict, users * sizeof(int));
+    segment->capacity = (int)n;
+}
+
+// Reallocate a column smaller; if that fails the original, larger one still works
+void* history_shrink_column(void *column, size_t bytes) {
+    void *shrunk = lib_realloc(ALLOC_HISTORY, column, bytes);
+    return shrunk != NULL ? shrunk : column;
+}
+
+// Dictionary-encode a user ID within the open segment; -1 when the dictionary is full
+int history_user_code(HistorySegment *segment, int user_id) {
+    unsigned int mask = 2 * HISTORY_SEGMENT_CAPACITY - 1;
+    unsigned int slot = ((unsigned int)user_id * 2654435761u) & mask;
+
+    while (segment->user_dict_slots[slot] >= 0) {
+        int code = segment->user_dict_slots[slot];
+        if (segment->user_dict[code] == user_id) {
+            return code;
+        }
+        slot = (slot + 1) & mask;
+    }
+
+    if (segment->user_dict_count >= 65535) {
+        return -1;
+    }
+    int code = segment->user_dict_count++;
+    segment->user_dict[code] = user_id;
+    segment->user_dict_slots[slot] = code;
+    return code;
+}
+
+// Make sure the next `events` appends for one user need no allocation: open a fresh
+// segment now if the tail is sealed, too full, or cannot encode the user, and make room
+// for escaped timestamps if the gap since the last event is too long for a delta
+int history_reserve(time_t when, int user_id, int events) {
+    HistorySegment *segment = history_tail;
+    if (segment != NULL && when < segment->max_time) {
+        when = segment->max_time;
+    }
+
+    if (segment == NULL || segment->user_dict_slots == NULL || segment->count + events > segment->capacity ||
+        history_user_code(segment, user_id) < 0) {
+        segment = history_new_segment(when, HISTORY_SEGMENT_CAPACITY);
+        if (segment == NULL) {
+            return 0;
+        }
+        history_user_code(segment, user_id);
+    }
+
+    if (segment->count > 0 && when - segment->max_time >= HISTORY_DELTA_ESCAPE &&
+        segment->wide_count + events > segment->wide_capacity) {
+        int capacity = segment->wide_capacity > 0 ? segment->wide_capacity * 2 : 8;
+        if (capacity < segment->wide_count + events) {
+            capacity = segment->wide_count + events;
+        }
+        time_t *wide = (time_t*)lib_realloc(ALLOC_HISTORY, segment->wide_times, capacity * sizeof(time_t));
+        if (wide == NULL) {
+            return 0;
+        }
+        segment->wide_times = wide;
+        segment->wide_capacity = capacity;
+    }
+    return 1;
+}
+
+// Record one circulation event; 0 if out of memory (callers reserve first so it cannot fail)
+int history_append(time_t when, int user_id, int book_ordinal, int event_type) {
+    HistorySegment *segment = history_tail;
+
+    // Timestamps never go backwards within the log so range scans can walk months in order
+    if (segment != NULL && when < segment->max_time) {
+        when = segment->max_time;
+    }
+
+    // A new segment when the current one is sealed, full, or its dictionary is
+    if (!history_reserve(when, user_id, 1)) {
+        return 0;
+    }
+    segment = history_tail;
+
+    int i = segment->count++;
+    time_t gap = i == 0 ? 0 : when - segment->max_time;
+    if (gap >= HISTORY_DELTA_ESCAPE) {
+        segment->time_deltas[i] = HISTORY_DELTA_ESCAPE; // Long gaps (nights, closures) stay in the segment
+        segment->wide_times[segment->wide_count++] = when;
+    } else {
+        segment->time_deltas[i] = (uint16_t)gap;
+    }
+    segment->user_codes[i] = (uint16_t)history_user_code(segment, user_id);
+    segment->book_ordinals[i] = (uint32_t)book_ordinal;
+    segment->event_types[i] = (uint8_t)event_type;
+    segment->max_time = when;
+    history_event_count++;
+    return 1;
+}
+
+// Timestamp of event i given t, the timestamp of event i - 1 (base_time for the first);
+// *wide walks the escaped timestamps and must start at 0
+time_t history_event_time(const HistorySegment *segment, int i, time_t t, int *wide) {
+    if (segment->time_deltas[i] == HISTORY_DELTA_ESCAPE) {
+        return segment->wide_times[(*wide)++];
+    }
+    return t + segment->time_deltas[i];
+}
+
+// Count events of a type (0 for any) in [from, to), skipping segments outside the range
+long history_count_events(time_t from, time_t to, int event_type) {
+    long total = 0;
+
+    for (HistorySegment *segment = history_head; segment != NULL; segment = segment->next) {
+        if (segment->max_time < from || segment->min_time >= to) {
+            continue;
+        }
+
+        // Whole segment inside the range: only the type column is needed
+        int inside = segment->min_time >= from && segment->max_time < to;
+        time_t t = segment->base_time;
+        int wide = 0;
+        for (int i = 0; i < segment->count; i++) {
+            t = history_event_time(segment, i, t, &wide);
+            if (!inside && (t < from || t >= to)) {
+                continue;
+            }
+            total += (event_type == 0 || segment->event_types[i] == event_type);
+        }
+    }
+    return total;
+}
+
+// Print issue counts per calendar month per genre over an inclusive month range
+void report_loans_by_month_and_genre(int start_year, int start_month, int end_year, int end_month) {
+    int month_count = (end_year - start_year) * 12 + (end_month - start_month) + 1;
+    if (month_count <= 0 || month_count > HISTORY_MAX_MONTHS) {
+        printf("Invalid month range (at most %d months).\n", HISTORY_MAX_MONTHS);
+        return;
+    }
+
+    // Month boundaries in local time; boundaries[m] .. boundaries[m + 1] is month m
+    time_t boundaries[HISTORY_MAX_MONTHS + 1];
+    for (int m = 0; m <= month_count; m++) {
+        struct tm tm_month;
+        memset(&tm_month, 0, sizeof(tm_month));
+        tm_month.tm_year = start_year - 1900;
+        tm_month.tm_mon = start_month - 1 + m;
+        tm_month.tm_mday = 1;
+        tm_month.tm_isdst = -1;
+        boundaries[m] = mktime(&tm_month);
+    }
+
+    // Dictionary-encode genres by book ordinal; removed titles share one bucket
+    char genre_names[MAX_GENRES][MAX_GENRE_LENGTH];
+    int genre_count = 1;
+    strcpy(genre_names[0], "(removed)");
+
+    int *genre_of = (int*)lib_calloc(ALLOC_HISTORY, next_book_ordinal > 0 ? next_book_ordinal : 1, sizeof(int));
+    long *counts = (long*)lib_calloc(ALLOC_HISTORY, (size_t)month_count * MAX_GENRES, sizeof(long));
+    if (genre_of == NULL || counts == NULL) {
+        printf("Memory allocation failed for history report.\n");
+        lib_free(genre_of);
+        lib_free(counts);
+        return;
+    }
+
+    for (int ordinal = 1; ordinal < next_book_ordinal && ordinal < book_ordinal_capacity; ordinal++) {
+        Book *book = book_by_ordinal[ordinal];
+        if (book == NULL) {
+            continue;
+        }
+        int g = 1;
+        while (g < genre_count && strcmp(genre_names[g], book->genre) != 0) {
+            g++;
+        }
+        if (g == genre_count) {
+            if (genre_count == MAX_GENRES) {
+                g = 0;
+            } else {
+                strcpy(genre_names[genre_count++], book->genre);
+            }
+        }
+        genre_of[ordinal] = g;
+    }
+
+    time_t from = boundaries[0];
+    time_t to = boundaries[month_count];
+    for (HistorySegment *segment = history_head; segment != NULL; segment = segment->next) {
+        if (segment->max_time < from || segment->min_time >= to) {
+            continue; // Pruned by the segment's time range
+        }
+
+        int month = 0;
+        time_t t = segment->base_time;
+        int wide = 0;
+        for (int i = 0; i < segment->count; i++) {
+            t = history_event_time(segment, i, t, &wide);
+            if (t < from || t >= to || segment->event_types[i] != HISTORY_EVENT_ISSUE) {
+                continue;
+            }
+            // Events are in time order, so the month cursor only moves forward
+            while (t >= boundaries[month + 1]) {
+                month++;
+            }
+            uint32_t ordinal = segment->book_ordinals[i];
+            int g = (ordinal < (uint32_t)next_book_ordinal) ? genre_of[ordinal] : 0;
+            counts[(size_t)month * MAX_GENRES + g]++;
+        }
+    }
+
+    printf("\n===== Loans per Month per Genre =====\n");
+    printf("%-8s | %-30s | %-10s\n", "Month", "Genre", "Loans");
+    printf("------------------------------------------------------\n");
+
+    int printed = 0;
+    for (int m = 0; m < month_count; m++) {
+        int year = start_year + (start_month - 1 + m) / 12;
+        int mon = (start_month - 1 + m) % 12 + 1;
+        for (int g = 0; g < genre_count; g++) {
+            long n = counts[(size_t)m * MAX_GENRES + g];
+            if (n > 0) {
+                printf("%04d-%02d  | %-30s | %-10ld\n", year, mon, genre_names[g], n);
+                printed = 1;
+            }
+        }
+    }
+
+    if (!printed) {
+        printf("No loans recorded in this period.\n");
+    }
+
+    lib_free(genre_of);
+    lib_free(counts);
+}
+
+// --- Reading History Functions ---
+
+// Bloom filter bit positions for an ordinal (two probes, masked to the filter size)
+#define READ_FILTER_BIT1(ordinal, mask) ((uint32_t)(((uint64_t)(uint32_t)(ordinal) * 0x9E3779B97F4A7C15ULL) >> 32) & (mask))
+#define READ_FILTER_BIT2(ordinal, mask) ((uint32_t)(((uint64_t)(uint32_t)(ordinal) * 0xC2B2AE3D27D4EB4FULL) >> 32) & (mask))
+
+// Set both probe bits for an ordinal
+void read_filter_add(uint64_t *filter, int words, uint32_t ordinal) {
+    uint32_t mask = (uint32_t)words * 64 - 1;
+    uint32_t bit1 = READ_FILTER_BIT1(ordinal, mask);
+    uint32_t bit2 = READ_FILTER_BIT2(ordinal, mask);
+    filter[bit1 >> 6] |= 1ULL << (bit1 & 63);
+    filter[bit2 >> 6] |= 1ULL << (bit2 & 63);
+}
+
+// Size the filter for the given number of titles, rebuilding it from the history.
+// On allocation failure the old filter stays: fuller, but it never reports a miss wrongly
+int user_grow_read_filter(User *user, int titles) {
+    if (user->read_filter != NULL && (long)titles * READ_FILTER_BITS_PER_TITLE <= (long)user->read_filter_words * 64) {
+        return 1;
+    }
+    int words = user->read_filter_words > 0 ? user->read_filter_words : READ_FILTER_MIN_WORDS;
+    while ((long)titles * READ_FILTER_BITS_PER_TITLE > (long)words * 64) {
+        words *= 2;
+    }
+    uint64_t *filter = (uint64_t*)lib_calloc(ALLOC_READING, words, sizeof(uint64_t));
+    if (filter == NULL) {
+        return 0;
+    }
+
+    uint32_t value = 0;
+    int pos = 0;
+    while (pos < user->read_history_bytes) {
+        uint32_t gap = 0;
+        int shift = 0;
+        uint8_t byte;
+        do {
+            byte = user->read_history[pos++];
+            gap |= (uint32_t)(byte & 0x7f) << shift;
+            shift += 7;
+        } while (byte & 0x80);
+        value += gap;
+        read_filter_add(filter, words, value);
+    }
+
+    lib_free(user->read_filter);
+    user->read_filter = filter;
+    user->read_filter_words = words;
+    return 1;
+}
+
+// Has the user ever borrowed this title? Most misses stop at the Bloom filter
+int user_has_read(User *user, int book_ordinal) {
+    if (user->read_count == 0) {
+        return 0;
+    }
+    if (user->read_filter != NULL) { // Without one (an allocation failed) the walk below is still exact
+        uint32_t mask = (uint32_t)user->read_filter_words * 64 - 1;
+        uint32_t bit1 = READ_FILTER_BIT1(book_ordinal, mask);
+        uint32_t bit2 = READ_FILTER_BIT2(book_ordinal, mask);
+        if (!(user->read_filter[bit1 >> 6] & (1ULL << (bit1 & 63))) ||
+            !(user->read_filter[bit2 >> 6] & (1ULL << (bit2 & 63)))) {
+            return 0;
+        }
+    }
+
+    // Walk the sorted gap list, stopping once past the target
+    uint32_t value = 0;
+    int pos = 0;
+    while (pos < user->read_history_bytes) {
+        uint32_t gap = 0;
+        int shift = 0;
+        uint8_t byte;
+        do {
+            byte = user->read_history[pos++];
+            gap |= (uint32_t)(byte & 0x7f) << shift;
+            shift += 7;
+        } while (byte & 0x80);
+
+        value += gap;
+        if (value >= (uint32_t)book_ordinal) {
+            return value == (uint32_t)book_ordinal;
+        }
+    }
+    return 0;
+}
+
+// Write one varint; returns its length in bytes
+int encode_varint(uint32_t value, uint8_t *out) {
+    int length = 0;
+    while (value >= 0x80) {
+        out[length++] = (uint8_t)(value | 0x80);
+        value >>= 7;
+    }
+    out[length++] = (uint8_t)value;
+    return length;
+}
+
+// Make room for `titles` more entries so recording them cannot fail. Each new entry
+// grows the gap list by at most one varint (its follower's gap only shrinks)
+int user_reserve_read(User *user, int titles) {
+    int needed = user->read_history_bytes + titles * 5;
+    if (needed > user->read_history_capacity) {
+        int new_capacity = user->read_history_capacity > 0 ? user->read_history_capacity * 2 : 16;
+        while (new_capacity < needed) {
+            new_capacity *= 2;
+        }
+        uint8_t *grown = (uint8_t*)lib_realloc(ALLOC_READING, user->read_history, new_capacity);
+        if (grown == NULL) {
+            return 0;
+        }
+        user->read_history = grown;
+        user->read_history_capacity = new_capacity;
+    }
+
+    user_grow_read_filter(user, user->read_count + titles); // Best effort: a fuller filter is still exact
+    return 1;
+}
+
+// Add a title to the user's reading history; returns 1 if it was new
+int user_record_read(User *user, int book_ordinal) {
+    if (book_ordinal <= 0 || user_has_read(user, book_ordinal)) {
+        return 0;
+    }
+
+    // Find the insertion point: the first stored ordinal above the new one
+    uint32_t target = (uint32_t)book_ordinal;
+    uint32_t prev_value = 0;
+    uint32_t next_value = 0;
+    int insert_pos = user->read_history_bytes;
+    int next_end = insert_pos;
+    int pos = 0;
+    while (pos < user->read_history_bytes) {
+        int start = pos;
+        uint32_t gap = 0;
+        int shift = 0;
+        uint8_t byte;
+        do {
+            byte = user->read_history[pos++];
+            gap |= (uint32_t)(byte & 0x7f) << shift;
+            shift += 7;
+        } while (byte & 0x80);
+
+        if (prev_value + gap > target) {
+            insert_pos = start;
+            next_end = pos;
+            next_value = prev_value + gap;
+            break;
+        }
+        prev_value += gap;
+    }
+
+    // Re-encode: new gap, then the follower's gap shrinks to be relative to the new entry
+    uint8_t encoded[10];
+    int encoded_length = encode_varint(target - prev_value, encoded);
+    if (insert_pos < user->read_history_bytes) {
+        encoded_length += encode_varint(next_value - target, encoded + encoded_length);
+    }
+    int replaced = next_end - insert_pos;
+    int new_bytes = user->read_history_bytes - replaced + encoded_length;
+
+    if (new_bytes > user->read_history_capacity && !user_reserve_read(user, 1)) {
+        return 0;
+    }
+
+    memmove(user->read_history + insert_pos + encoded_length, user->read_history + next_end,
+            user->read_history_bytes - next_end);
+    memcpy(user->read_history + insert_pos, encoded, encoded_length);
+    user->read_history_bytes = new_bytes;
+    user->read_count++;
+
+    // Growing rebuilds from the history, which already holds the new title
+    int had_room = user->read_filter != NULL &&
+                   (long)user->read_count * READ_FILTER_BITS_PER_TITLE <= (long)user->read_filter_words * 64;
+    if (had_room) {
+        read_filter_add(user->read_filter, user->read_filter_words, target);
+    } else if (!user_grow_read_filter(user, user->read_count) && user->read_filter != NULL) {
+        read_filter_add(user->read_filter, user->read_filter_words, target);
+    }
+    return 1;
+}
+
+// Rebuild every user's reading history from the issue events in the loan history
+void rebuild_reading_histories() {
+    // Direct ID -> user index for the replay (IDs are dense from 1001)
+    int id_range = next_user_id;
+    User **by_id = (User**)lib_calloc(ALLOC_READING, id_range, sizeof(User*));
+    if (by_id == NULL) {
+        printf("Memory allocation failed while rebuilding reading histories.\n");
+        return;
+    }
+    for (User *user = user_list; user != NULL; user = user->next) {
+        if (user->id >= 0 && user->id < id_range) {
+            by_id[user->id] = user;
+        }
+    }
+
+    for (HistorySegment *segment = history_head; segment != NULL; segment = segment->next) {
+        for (int i = 0; i < segment->count; i++) {
+            if (segment->event_types[i] != HISTORY_EVENT_ISSUE) {
+                continue;
+            }
+            int user_id = segment->user_dict[segment->user_codes[i]];
+            if (user_id >= 0 && user_id < id_range && by_id[user_id] != NULL) {
+                user_record_read(by_id[user_id], (int)segment->book_ordinals[i]);
+            }
+        }
+    }
+
+    lib_free(by_id);
+}
+
+// List every title a user has borrowed, in ordinal (catalog) order
+void list_user_reading_history(int user_id) {
+    User *user = find_user(user_id);
+    if (user == NULL) {
+        printf("User ID %d not found.\n", user_id);
+        return;
+    }
+
+    printf("\n===== Reading History for %s (ID: %d) =====\n", user->name, user->id);
+    printf("%-30s | %-20s | %-15s\n", "Title", "Author", "ISBN");
+    printf("--------------------------------------------------------------------\n");
+
+    if (user->read_count == 0) {
+        printf("No books borrowed yet.\n");
+        return;
+    }
+
+    uint32_t value = 0;
+    int pos = 0;
+    while (pos < user->read_history_bytes) {
+        uint32_t gap = 0;
+        int shift = 0;
+        uint8_t byte;
+        do {
+            byte = user->read_history[pos++];
+            gap |= (uint32_t)(byte & 0x7f) << shift;
+            shift += 7;
+        } while (byte & 0x80);
+        value += gap;
+
+        Book *book = value < (uint32_t)book_ordinal_capacity ? book_by_ordinal[value] : NULL;
+        if (book != NULL) {
+            printf("%-30s | %-20s | %-15s\n", book->title, book->author, book->isbn);
+        } else {
+            printf("%-30s | %-20s | %-15s\n", "(removed from catalog)", "", "");
+        }
+    }
+    printf("Distinct titles borrowed: %d\n", user->read_count);
+}
+
+// --- Co-occurrence Functions ---
+
+// Count one more co-borrower for (book, neighbor). A full row evicts its weakest
+// entry and the newcomer inherits that count (space-saving), so memory stays bounded
+void cooccur_add(Book *book, uint32_t neighbor_ordinal) {
+    if (book->cooccur == NULL) {
+        book->cooccur = (CooccurEntry*)lib_malloc(ALLOC_READING, COOCCUR_SLOTS * sizeof(CooccurEntry));
+        if (book->cooccur == NULL) {
+            return;
+        }
+        book->cooccur_count = 0;
+    }
+
+    int weakest = 0;
+    for (int i = 0; i < book->cooccur_count; i++) {
+        if (book->cooccur[i].ordinal == neighbor_ordinal) {
+            book->cooccur[i].count++;
+            return;
+        }
+        if (book->cooccur[i].count < book->cooccur[weakest].count) {
+            weakest = i;
+        }
+    }
+
+    if (book->cooccur_count < COOCCUR_SLOTS) {
+        book->cooccur[book->cooccur_count].ordinal = neighbor_ordinal;
+        book->cooccur[book->cooccur_count].count = 1;
+        book->cooccur_count++;
+    } else {
+        book->cooccur[weakest].ordinal = neighbor_ordinal;
+        book->cooccur[weakest].count++;
+    }
+}
+
+// Pair a title the user just read for the first time with everything else they have read
+void cooccur_link_reader(User *user, int book_ordinal) {
+    Book *book = (book_ordinal > 0 && book_ordinal < book_ordinal_capacity) ? book_by_ordinal[book_ordinal] : NULL;
+    if (book == NULL) {
+        return;
+    }
+
+    uint32_t value = 0;
+    int pos = 0;
+    while (pos < user->read_history_bytes) {
+        uint32_t gap = 0;
+        int shift = 0;
+        uint8_t byte;
+        do {
+            byte = user->read_history[pos++];
+            gap |= (uint32_t)(byte & 0x7f) << shift;
+            shift += 7;
+        } while (byte & 0x80);
+        value += gap;
+
+        if (value == (uint32_t)book_ordinal || value >= (uint32_t)book_ordinal_capacity) {
+            continue;
+        }
+        Book *other = book_by_ordinal[value];
+        if (other != NULL) {
+            cooccur_add(book, value);
+            cooccur_add(other, (uint32_t)book_ordinal);
+        }
+    }
+}
+
+// Rebuild all co-occurrence rows from the (already rebuilt) reading histories
+void rebuild_cooccurrence() {
+    uint32_t *ordinals = NULL;
+    int capacity = 0;
+
+    for (User *user = user_list; user != NULL; user = user->next) {
+        if (user->read_count < 2) {
+            continue;
+        }
+        if (user->read_count > capacity) {
+            uint32_t *grown = (uint32_t*)lib_realloc(ALLOC_READING, ordinals, user->read_count * sizeof(uint32_t));
+            if (grown == NULL) {
+                printf("Memory allocation failed while rebuilding recommendations.\n");
+                break;
+            }
+            ordinals = grown;
+            capacity = user->read_count;
+        }
+
+        // Decode once, then count every pair of still-catalogued titles in both directions
+        int n = 0;
+        uint32_t value = 0;
+        int pos = 0;
+        while (pos < user->read_history_bytes && n < capacity) {
+            uint32_t gap = 0;
+            int shift = 0;
+            uint8_t byte;
+            do {
+                byte = user->read_history[pos++];
+                gap |= (uint32_t)(byte & 0x7f) << shift;
+                shift += 7;
+            } while (byte & 0x80);
+            value += gap;
+            if (value < (uint32_t)book_ordinal_capacity && book_by_ordinal[value] != NULL) {
+                ordinals[n++] = value;
+            }
+        }
+
+        for (int i = 0; i < n; i++) {
+            for (int j = i + 1; j < n; j++) {
+                cooccur_add(book_by_ordinal[ordinals[i]], ordinals[j]);
+                cooccur_add(book_by_ordinal[ordinals[j]], ordinals[i]);
+            }
+        }
+    }
+
+    lib_free(ordinals);
+}
+
+// Fill `out` with up to `limit` titles most often co-borrowed with `book`; returns how many
+int cooccur_top(Book *book, Book **out, uint32_t *counts, int limit) {
+    int found = 0;
+
+    for (int i = 0; i < book->cooccur_count; i++) {
+        uint32_t ordinal = book->cooccur[i].ordinal;
+        uint32_t count = book->cooccur[i].count;
+        Book *other = ordinal < (uint32_t)book_ordinal_capacity ? book_by_ordinal[ordinal] : NULL;
+        if (other == NULL || (found == limit && count <= counts[found - 1])) {
+            continue;
+        }
+
+        int pos = found < limit ? found++ : limit - 1;
+        while (pos > 0 && counts[pos - 1] < count) {
+            out[pos] = out[pos - 1];
+            counts[pos] = counts[pos - 1];
+            pos--;
+        }
+        out[pos] = other;
+        counts[pos] = count;
+    }
+    return found;
+}
+
+// --- Trending Functions ---
+
+// Count an issue in the book's daily ring, clearing days that have rolled out of the window
+void trend_record(Book *book, time_t when) {
+    long day = (long)(when / SECONDS_PER_DAY);
+
+    if (day > book->trend_day) {
+        long gap = day - book->trend_day;
+        if (gap >= TREND_DAYS) {
+            memset(book->trend_buckets, 0, sizeof(book->trend_buckets));
+        } else {
+            for (long d = book->trend_day + 1; d <= day; d++) {
+                book->trend_buckets[d % TREND_DAYS] = 0;
+            }
+        }
+        book->trend_day = (int)day;
+    } else if (book->trend_day - day >= TREND_DAYS) {
+        return; // Older than the window
+    }
+
+    uint16_t *bucket = &book->trend_buckets[day % TREND_DAYS];
+    if (*bucket < UINT16_MAX) {
+        (*bucket)++;
+    }
+}
+
+// Issues over the last `days` days (at most TREND_DAYS) ending today
+long trend_score(Book *book, int days, long today) {
+    long newest = book->trend_day < today ? book->trend_day : today;
+    long oldest = today - days + 1;
+    if (oldest < book->trend_day - TREND_DAYS + 1) {
+        oldest = book->trend_day - TREND_DAYS + 1;
+    }
+
+    long score = 0;
+    for (long d = oldest; d <= newest; d++) {
+        score += book->trend_buckets[d % TREND_DAYS];
+    }
+    return score;
+}
+
+// Replay the last TREND_DAYS of issues from the loan history into the daily rings
+void rebuild_trending_from_history() {
+    time_t since = time(NULL) - (time_t)TREND_DAYS * SECONDS_PER_DAY;
+
+    for (HistorySegment *segment = history_head; segment != NULL; segment = segment->next) {
+        if (segment->max_time < since) {
+            continue; // Pruned by the segment's time range
+        }
+
+        time_t t = segment->base_time;
+        int wide = 0;
+        for (int i = 0; i < segment->count; i++) {
+            t = history_event_time(segment, i, t, &wide);
+            uint32_t ordinal = segment->book_ordinals[i];
+            if (t < since || segment->event_types[i] != HISTORY_EVENT_ISSUE ||
+                ordinal >= (uint32_t)book_ordinal_capacity || book_by_ordinal[ordinal] == NULL) {
+                continue;
+            }
+            trend_record(book_by_ordinal[ordinal], t);
+        }
+    }
+}
+
+// List the books issued most often over the last `days` days
+void list_trending_books(int days) {
+    printf("\n===== Trending: Last %d Days =====\n", days);
+    printf("%-30s | %-20s | %-15s | %-10s\n", "Title", "Author", "ISBN", "Loans");
+    printf("-------------------------------------------------------------------------------------\n");
+
+    long today = (long)(time(NULL) / SECONDS_PER_DAY);
+
+    // Keep the top entries in a small array sorted by descending score
+    Book *top[TREND_TOP_N];
+    long top_score[TREND_TOP_N];
+    int top_count = 0;
+
+    for (int i = 0; i < hash_capacity; i++) {
+        for (Book *book = hash_table[i]; book != NULL; book = book->next) {
+            if (today - book->trend_day >= days) {
+                continue; // Nothing issued inside the window
+            }
+            long score = trend_score(book, days, today);
+            if (score == 0 || (top_count == TREND_TOP_N && score <= top_score[top_count - 1])) {
+                continue;
+            }
+
+            int pos = top_count < TREND_TOP_N ? top_count++ : TREND_TOP_N - 1;
+            while (pos > 0 && top_score[pos - 1] < score) {
+                top[pos] = top[pos - 1];
+                top_score[pos] = top_score[pos - 1];
+                pos--;
+            }
+            top[pos] = book;
+            top_score[pos] = score;
+        }
+    }
+
+    if (top_count == 0) {
+        printf("No books have been borrowed in the last %d days.\n", days);
+        return;
+    }
+
+    for (int i = 0; i < top_count; i++) {
+        printf("%-30s | %-20s | %-15s | %-10ld\n",
+               top[i]->title, top[i]->author, top[i]->isbn, top_score[i]);
+    }
+}
+
+// --- Report Generation Functions ---
+
+// List the titles by one author; returns how many were found
+int list_books_by_author(char *author) {
+    printf("\nBooks by %s:\n", author);
+    printf("%-30s | %-15s | %-10s\n", "Title", "ISBN", "Available");
+    printf("------------------------------------------------------------\n");
+
+    int found = 0;
+    for (int i = 0; i < hash_capacity; i++) {
+        Book *current = hash_table[i];
+        while (current != NULL) {
+            if (strcmp(current->author, author) == 0) {
+                printf("%-30s | %-15s | %d/%d\n",
+                       current->title, current->isbn,
+                       current->available, current->copy_count);
+                found++;
+            }
+            current = current->next;
+        }
+    }
+
+    if (!found) {
+        printf("No books found by author '%s'.\n", author);
+    }
+    return found;
+}
+
+// List all books
+void list_all_books() {
+    printf("\n===== All Books =====\n");
+    printf("%-30s | %-20s | %-15s | %-10s\n", "Title", "Author", "ISBN", "Status");
+    printf("-------------------------------------------------------------------------------------\n");
+
+    if (title_bst_root == NULL) {
+        printf("No books in the library.\n");
+        return;
+    }
+    // Use BST inorder traversal for alphabetical listing
+    inorder_traversal(title_bst_root);
+}
+
+// List available books
+void list_available_books() {
+    printf("\n===== Available Books =====\n");
+    printf("%-30s | %-20s | %-15s | %-10s\n", "Title", "Author", "ISBN", "Copies");
+    printf("-------------------------------------------------------------------------------------\n");
+
+    int count = 0;
+    // Iterate through the hash table to find available books
+    for (int i = 0; i < hash_capacity; i++) {
+        Book *current = hash_table[i];
+        while (current != NULL) {
+            if (current->available > 0) {
+                printf("%-30s | %-20s | %-15s | %d/%d\n",
+                       current->title, current->author, current->isbn,
+                       current->available, current->copy_count);
+                count++;
+            }
+            current = current->next;
+        }
+    }
+
+    if (count == 0) {
+        printf("No available books in the library.\n");
+    }
+}
+
+// List borrowed books
+void list_borrowed_books() {
+    printf("\n===== Currently Borrowed Books =====\n");
+    printf("%-30s | %-20s | %-20s | %-20s\n", "Title", "Author", "Copy", "Borrowed By");
+    printf("------------------------------------------------------------------------------------------------\n");
+
+    int count = 0;
+    User *user = user_list;
+
+    while (user != NULL) {
+        for (int i = 0; i < user->borrowed_count; i++) {
+            Loan *loan = user->loans[i];
+            Book *book = loan->book;
+            if (book != NULL) { // Should always be set if the ISBN is valid
+                printf("%-30s | %-20s | %-20s | %-20s (ID: %d)\n",
+                       book->title, book->author,
+                       loan->copy_index >= 0 ? book->copies[loan->copy_index].barcode : book->isbn,
+                       user->name, user->id);
+                count++;
+            }
+        }
+        user = user->next;
+    }
+
+    if (count == 0) {
+        printf("No books are currently borrowed.\n");
+    }
+}
+
+// List the most borrowed books across the whole catalog
+void list_most_borrowed_books() {
+    printf("\n===== Most Borrowed Books =====\n");
+    printf("%-30s | %-20s | %-15s | %-10s\n", "Title", "Author", "ISBN", "Borrows");
+    printf("-------------------------------------------------------------------------------------\n");
+
+    if (hash_count == 0) {
+        printf("No books in the library.\n");
+        return;
+    }
+
+    // Keep the top entries in a small array sorted by descending borrow count
+    Book *top[MOST_BORROWED_TOP_N];
+    int top_count = 0;
+
+    for (int i = 0; i < hash_capacity; i++) {
+        for (Book *book = hash_table[i]; book != NULL; book = book->next) {
+            if (book->borrow_count == 0 ||
+                (top_count == MOST_BORROWED_TOP_N && !most_borrowed_before(book, top[top_count - 1]))) {
+                continue;
+            }
+
+            int pos = top_count < MOST_BORROWED_TOP_N ? top_count++ : MOST_BORROWED_TOP_N - 1;
+            while (pos > 0 && most_borrowed_before(book, top[pos - 1])) {
+                top[pos] = top[pos - 1];
+                pos--;
+            }
+            top[pos] = book;
+        }
+    }
+
+    if (top_count == 0) {
+        printf("No books have been borrowed yet.\n");
+        return;
+    }
+
+    for (int i = 0; i < top_count; i++) {
+        printf("%-30s | %-20s | %-15s | %-10d\n",
+               top[i]->title, top[i]->author, top[i]->isbn, top[i]->borrow_count);
+    }
+}
+
+// Ranking for the most borrowed report: more borrows first, ties by ISBN so the
+// result does not depend on hash order
+int most_borrowed_before(const Book *a, const Book *b) {
+    if (a->borrow_count != b->borrow_count) {
+        return a->borrow_count > b->borrow_count;
+    }
+    return strcmp(a->isbn, b->isbn) < 0;
+}
+
+// List every user with books out, most books first
+void list_active_users() {
+    printf("\n===== Active Users =====\n");
+    printf("%-5s | %-20s | %-15s\n", "ID", "Name", "Books Borrowed");
+    printf("--------------------------------------------\n");
+
+    int active_user_count = 0;
+    for (User *current = user_list; current != NULL; current = current->next) {
+        active_user_count += current->borrowed_count > 0;
+    }
+
+    if (active_user_count == 0) {
+        printf("No active users at the moment.\n");
+        return;
+    }
+
+    User **active_users = (User**)lib_malloc(ALLOC_USERS, active_user_count * sizeof(User*));
+    if (active_users == NULL) {
+        printf("Memory allocation failed for active users report.\n");
+        return;
+    }
+    int count = 0;
+    for (User *current = user_list; current != NULL; current = current->next) {
+        if (current->borrowed_count > 0) {
+            active_users[count++] = current;
+        }
+    }
+
+    qsort(active_users, count, sizeof(User*), active_user_compare);
+
+    for (int i = 0; i < count; i++) {
+        printf("%-5d | %-20s | %-15d\n",
+               active_users[i]->id, active_users[i]->name, active_users[i]->borrowed_count);
+    }
+    lib_free(active_users);
+}
+
+// qsort order for the active users report: most books borrowed first, then by ID
+int active_user_compare(const void *a, const void *b) {
+    const User *x = *(const User* const*)a;
+    const User *y = *(const User* const*)b;
+    if (x->borrowed_count != y->borrowed_count) {
+        return y->borrowed_count - x->borrowed_count;
+    }
+    return (x->id > y->id) - (x->id < y->id);
+}
+
+
+// List loans that are past their due time
+void list_overdue_loans() {
+    printf("\n===== Overdue Loans =====\n");
+    printf("%-30s | %-15s | %-20s | %-16s\n", "Title", "ISBN", "Borrowed By", "Due");
+    printf("-------------------------------------------------------------------------------------------\n");
+
+    time_t now = time(NULL);
+    wheel_advance(now);
+
+    // Expired buckets hold only overdue loans; the current hour may hold a few more
+    LoanList *sources[2] = {&overdue_loans, &wheel_hours[wheel_current_hour % WHEEL_HOUR_SLOTS]};
+    int count = 0;
+    char due_str[32];
+
+    for (int s = 0; s < 2; s++) {
+        for (Loan *loan = sources[s]->head; loan != NULL; loan = loan->next) {
+            if (loan->due_time >= now) {
+                continue;
+            }
+            format_time(loan->due_time, due_str, sizeof(due_str));
+            printf("%-30s | %-15s | %-20s | %-16s (%ld days late)\n",
+                   loan->book != NULL ? loan->book->title : "(unknown)", loan->isbn,
+                   loan->user->name, due_str, (long)((now - loan->due_time) / SECONDS_PER_DAY));
+            count++;
+        }
+    }
+
+    if (count == 0) {
+        printf("No overdue loans.\n");
+    }
+}
+
+// List loans falling due within the next 24 hours
+void list_loans_due_soon() {
+    printf("\n===== Loans Due in the Next 24 Hours =====\n");
+    printf("%-30s | %-15s | %-20s | %-16s\n", "Title", "ISBN", "Borrowed By", "Due");
+    printf("-------------------------------------------------------------------------------------------\n");
+
+    time_t now = time(NULL);
+    time_t horizon = now + SECONDS_PER_DAY;
+    wheel_advance(now);
+
+    // The window spans at most 25 hour slots, all within the hour wheel
+    int count = 0;
+    char due_str[32];
+    for (long hour = wheel_current_hour; hour <= wheel_current_hour + 24; hour++) {
+        for (Loan *loan = wheel_hours[hour % WHEEL_HOUR_SLOTS].head; loan != NULL; loan = loan->next) {
+            if (loan->due_time < now || loan->due_time >= horizon) {
+                continue;
+            }
+            format_time(loan->due_time, due_str, sizeof(due_str));
+            printf("%-30s | %-15s | %-20s | %-16s\n",
+                   loan->book != NULL ? loan->book->title : "(unknown)", loan->isbn,
+                   loan->user->name, due_str);
+            count++;
+        }
+    }
+
+    if (count == 0) {
+        printf("No loans due in the next 24 hours.\n");
+    }
+}
+
+
+// --- Result Rendering Functions ---
+
+// Print the outcome of a core operation; isbn and id are the arguments the menu passed in
+void render_result(int op, const char *isbn, int id, EngineResult *result) {
+    Book *book = result->book;
+    User *user = result->user;
+    char due_str[32];
+
+    switch (result->status) {
+        case ENGINE_OK:
+            break;
+        case ENGINE_NO_MEMORY:
+            if (op == LATENCY_ADD_COPIES) {
+                printf("Could not add %d copies to '%s'.\n", result->count, book->title);
+            } else {
+                printf("Memory allocation failed.\n");
+            }
+            return;
+        case ENGINE_BOOK_EXISTS:
+            printf("Book with ISBN %s already exists. Not adding duplicate.\n", isbn);
+            return;
+        case ENGINE_BOOK_NOT_FOUND:
+            printf("Book with ISBN %s not found.\n", isbn);
+            return;
+        case ENGINE_USER_NOT_FOUND:
+            printf("User ID %d not found.\n", id);
+            return;
+        case ENGINE_COPIES_ON_LOAN:
+            printf("Cannot remove book '%s' (ISBN: %s) as %d of its copies are currently borrowed.\n",
+                   book->title, isbn, result->count);
+            return;
+        case ENGINE_USER_HAS_LOANS:
+            printf("Cannot remove user '%s' (ID: %d) as they still have borrowed books.\n", user->name, user->id);
+            return;
+        case ENGINE_NONE_AVAILABLE:
+            printf("No copies of '%s' are available for borrowing. %d patron(s) waiting; you can place a hold.\n",
+                   book->title, book->hold_count);
+            return;
+        case ENGINE_ALREADY_BORROWED:
+            printf("User '%s' already has a copy of '%s'.\n", user->name, book->title);
+            return;
+        case ENGINE_BORROW_LIMIT:
+            printf("User '%s' has reached the maximum number of books that can be borrowed (%d).\n",
+                   user->name, MAX_BORROWED);
+            return;
+        case ENGINE_NOT_BORROWED:
+            printf("User '%s' has not borrowed book with ISBN %s.\n", user->name, isbn);
+            return;
+        case ENGINE_COPIES_AVAILABLE:
+            printf("%d copies of '%s' are available now; issue one instead of placing a hold.\n",
+                   book->available, book->title);
+            return;
+        case ENGINE_ALREADY_HELD:
+            printf("User '%s' already has a hold on '%s'.\n", user->name, book->title);
+            return;
+        case ENGINE_NO_HOLD:
+            printf("User '%s' has no hold on ISBN %s.\n", user->name, isbn);
+            return;
+        default:
+            printf("Operation failed (status %d).\n", result->status);
+            return;
+    }
+
+    switch (op) {
+        case LATENCY_ADD_BOOK:
+            printf("Book '%s' added successfully.\n", book->title);
+            break;
+        case LATENCY_REMOVE_BOOK:
+            printf("Book '%s' (ISBN: %s) removed successfully.\n", result->title, isbn);
+            break;
+        case LATENCY_ADD_COPIES:
+            printf("Added %d copies to '%s'. Now %d of %d available.\n",
+                   result->count, book->title, book->available, book->copy_count);
+            break;
+        case LATENCY_ADD_USER:
+            printf("User '%s' added successfully with ID: %d\n", user->name, user->id);
+            break;
+        case LATENCY_REMOVE_USER:
+            printf("User '%s' (ID: %d) removed successfully.\n", result->name, id);
+            break;
+        case LATENCY_ISSUE:
+            if (result->read_before) {
+                printf("Note: user '%s' has borrowed '%s' before.\n", user->name, book->title);
+            }
+            format_time(result->loan->due_time, due_str, sizeof(due_str));
+            printf("Book '%s' (copy %s) issued to user '%s' successfully. Due: %s\n",
+                   book->title, book->copies[result->loan->copy_index].barcode, user->name, due_str);
+            break;
+        case LATENCY_RETURN:
+            printf("Book '%s' returned by user '%s' successfully.\n", book->title, user->name);
+            render_served_holds(result);
+            break;
+        case LATENCY_PLACE_HOLD:
+            printf("Hold placed on '%s' for user '%s'. Position in queue: %d\n",
+                   book->title, user->name, result->count);
+            break;
+        case LATENCY_CANCEL_HOLD:
+            printf("Hold on '%s' cancelled for user '%s'.\n", book->title, user->name);
+            break;
+    }
+}
+
+// Print a kiosk transaction: every problem item when it was rejected, otherwise every item handled
+void render_batch_result(int op, int id, char isbns[][MAX_ISBN_LENGTH], int count, EngineResult *result) {
+    int checkout = op == LATENCY_KIOSK_CHECKOUT;
+    User *user = result->user;
+
+    switch (result->status) {
+        case ENGINE_OK:
+            break;
+        case ENGINE_BAD_BATCH_SIZE:
+            printf("A kiosk transaction takes between 1 and %d items.\n", MAX_BATCH_ITEMS);
+            return;
+        case ENGINE_USER_NOT_FOUND:
+            printf("User ID %d not found.\n", id);
+            return;
+        case ENGINE_BORROW_LIMIT:
+            printf("User '%s' can borrow %d more books; %d were scanned. Nothing was issued.\n",
+                   user->name, MAX_BORROWED - user->borrowed_count, count);
+            return;
+        case ENGINE_NO_MEMORY:
+            printf("Memory allocation failed for kiosk %s. Nothing was %s.\n", checkout ? "checkout" : "return",
+                   checkout ? "issued" : "returned");
+            return;
+        case ENGINE_BATCH_REJECTED:
+            for (int i = 0; i < count; i++) {
+                Book *book = result->items[i];
+                switch (result->item_status[i]) {
+                    case ENGINE_BOOK_NOT_FOUND:
+                        printf("  %s: not found\n", isbns[i]);
+                        break;
+                    case ENGINE_NONE_AVAILABLE:
+                        printf("  %s: no copies of '%s' available\n", isbns[i], book->title);
+                        break;
+                    case ENGINE_SCANNED_TWICE:
+                        printf("  %s: scanned twice\n", isbns[i]);
+                        break;
+                    case ENGINE_ALREADY_BORROWED:
+                        printf("  %s: user already has a copy of '%s'\n", isbns[i], book->title);
+                        break;
+                    case ENGINE_NOT_BORROWED:
+                        printf("  %s: not on loan to user '%s'\n", isbns[i], user->name);
+                        break;
+                }
+            }
+            printf("Kiosk %s rejected (%d problem(s)). Nothing was %s.\n", checkout ? "checkout" : "return",
+                   result->count, checkout ? "issued" : "returned");
+            return;
+        default:
+            printf("Operation failed (status %d).\n", result->status);
+            return;
+    }
+
+    if (checkout) {
+        char due_str[32];
+        format_time(result->item_loans[0]->due_time, due_str, sizeof(due_str));
+        printf("Issued %d books to user '%s'. Due: %s\n", count, user->name, due_str);
+        for (int i = 0; i < count; i++) {
+            Book *book = result->items[i];
+            printf("  %-30s copy %s%s\n", book->title, book->copies[result->item_loans[i]->copy_index].barcode,
+                   result->item_read_before[i] ? " (borrowed before)" : "");
+        }
+    } else {
+        printf("Returned %d books from user '%s'.\n", count, user->name);
+        for (int i = 0; i < count; i++) {
+            if (result->items[i] != NULL) {
+                printf("  %s\n", result->items[i]->title);
+            }
+        }
+        render_served_holds(result);
+    }
+}
+
+// Holds that returned copies were handed to
+void render_served_holds(EngineResult *result) {
+    char due_str[32];
+    for (int i = 0; i < result->served_count; i++) {
+        Loan *loan = result->served[i];
+        format_time(loan->due_time, due_str, sizeof(due_str));
+        printf("Hold fulfilled: book '%s' (copy %s) issued to user '%s' (ID: %d). Due: %s\n",
+               loan->book->title, loan->book->copies[loan->copy_index].barcode, loan->user->name,
+               loan->user->id, due_str);
+    }
+}
+
+
+// --- Menu Functions ---
+
+void display_menu() {
+    printf("\n===== Main Menu =====\n");
+    printf("1. Book Management\n");
+    printf("2. User Management\n");
+    printf("3. Issue/Return Books\n");
+    printf("4. Search\n");
+    printf("5. Reports\n");
+    printf("0. Exit\n");
+}
+
+void book_management_menu() {
+    int choice;
+
+    do {
+        printf("\n===== Book Management =====\n");
+        printf("1. Add New Book\n");
+        printf("2. Remove Book\n");
+        printf("3. List All Books\n");
+        printf("4. Add Copies to Existing Book\n");
+        printf("0. Back to Main Menu\n");
+        printf("Enter your choice: ");
+        read_int(&choice);
+
+        switch(choice) {
+            case 1: {
+                Book *new_book = (Book*)lib_calloc(ALLOC_CATALOG, 1, sizeof(Book)); // Zeroed: no holds queued
+                if (new_book == NULL) {
+                    printf("Memory allocation failed.\n");
+                    break;
+                }
+
+                printf("Enter ISBN: ");
+                read_isbn(new_book->isbn);
+
+                printf("Enter Title: ");
+                read_string(new_book->title, MAX_TITLE_LENGTH);
+
+                printf("Enter Author: ");
+                read_string(new_book->author, MAX_AUTHOR_LENGTH);
+
+                printf("Enter Genre: ");
+                read_string(new_book->genre, MAX_GENRE_LENGTH);
+
+                int copies;
+                printf("Enter Number of Copies: ");
+                if (!read_int(&copies) || copies < 1) {
+                    copies = 1;
+                }
+
+                new_book->borrow_count = 0;
+                new_book->free_copy = -1;
+                new_book->next = NULL;
+                if (add_copies(new_book, copies) != copies) {
+                    printf("Memory allocation failed.\n");
+                    lib_free(new_book->copies);
+                    lib_free(new_book);
+                    break;
+                }
+
+                char isbn[MAX_ISBN_LENGTH]; // insert_book frees a duplicate, so keep the argument apart
+                strcpy(isbn, new_book->isbn);
+                engine_op_extra(new_book->title);
+                engine_op_extra(new_book->author);
+                engine_op_extra(new_book->genre);
+                EngineResult result;
+                uint64_t started = engine_op_begin(LATENCY_ADD_BOOK, isbn, copies);
+                insert_book(new_book, &result);
+                engine_op_end(LATENCY_ADD_BOOK, started);
+                render_result(LATENCY_ADD_BOOK, isbn, copies, &result);
+                break;
+            }
+            case 2: {
+                char isbn[MAX_ISBN_LENGTH];
+                printf("Enter ISBN of the book to remove: ");
+                read_isbn(isbn);
+
+                EngineResult result;
+                uint64_t started = engine_op_begin(LATENCY_REMOVE_BOOK, isbn, -1);
+                remove_book(isbn, &result);
+                engine_op_end(LATENCY_REMOVE_BOOK, started);
+                render_result(LATENCY_REMOVE_BOOK, isbn, -1, &result);
+                break;
+            }
+            case 3:
+                list_all_books();
+                break;
+            case 4: {
+                char isbn[MAX_ISBN_LENGTH];
+                int copies;
+                printf("Enter ISBN: ");
+                read_isbn(isbn);
+
+                printf("Enter Number of Copies to Add: ");
+                read_int(&copies);
+
+                EngineResult result;
+                uint64_t started = engine_op_begin(LATENCY_ADD_COPIES, isbn, copies);
+                add_book_copies(isbn, copies, &result);
+                engine_op_end(LATENCY_ADD_COPIES, started);
+                render_result(LATENCY_ADD_COPIES, isbn, copies, &result);
+                break;
+            }
+            case 0:
+                printf("Returning to main menu.\n");
+                break;
+            default:
+                printf("Invalid choice. Please try again.\n");
+        }
+    } while(choice != 0);
+}
+
+void user_management_menu() {
+    int choice;
+
+    do {
+        printf("\n===== User Management =====\n");
+        printf("1. Add New User\n");
+        printf("2. Find User\n");
+        printf("3. Remove User\n");
+        printf("4. List All Users\n");
+        printf("5. View Reading History\n");
+        printf("0. Back to Main Menu\n");
+        printf("Enter your choice: ");
+        read_int(&choice);
+
+        switch(choice) {
+            case 1: {
+                char name[MAX_NAME_LENGTH];
+                printf("Enter user name: ");
+                read_string(name, MAX_NAME_LENGTH);
+                EngineResult result;
+                uint64_t started = engine_op_begin(LATENCY_ADD_USER, name, -1);
+                add_user(name, &result);
+                engine_op_end(LATENCY_ADD_USER, started);
+                render_result(LATENCY_ADD_USER, NULL, -1, &result);
+                break;
+            }
+            case 2: {
+                int id;
+                printf("Enter user ID: ");
+                read_int(&id);
+
+                User *user = find_user(id);
+                if (user != NULL) {
+                    printf("\nUser Found:\n");
+                    printf("ID: %d\n", user->id);
+                    printf("Name: %s\n", user->name);
+                    printf("Books borrowed: %d\n", user->borrowed_count);
+
+                    if (user->borrowed_count > 0) {
+                        printf("\nBorrowed Books:\n");
+                        for (int i = 0; i < user->borrowed_count; i++) {
+                            Book *book = search_book_by_isbn(user->borrowed_books[i]);
+                            if (book != NULL) {
+                                char due_str[32];
+                                format_time(user->loans[i]->due_time, due_str, sizeof(due_str));
+                                printf("%d. %s by %s (ISBN: %s) - Due: %s\n", i+1, book->title, book->author, book->isbn, due_str);
+                            }
+                        }
+                    }
+                } else {
+                    printf("User with ID %d not found.\n", id);
+                }
+                break;
+            }
+            case 3: {
+                int id;
+                printf("Enter user ID to remove: ");
+                read_int(&id);
+
+                EngineResult result;
+                uint64_t started = engine_op_begin(LATENCY_REMOVE_USER, NULL, id);
+                remove_user(id, &result);
+                engine_op_end(LATENCY_REMOVE_USER, started);
+                render_result(LATENCY_REMOVE_USER, NULL, id, &result);
+                break;
+            }
+            case 4: {
+                printf("\n===== All Users =====\n");
+                printf("%-5s | %-20s | %-15s\n", "ID", "Name", "Books Borrowed");
+                printf("--------------------------------------------\n");
+
+                User *current = user_list;
+                int count = 0;
+
+                if (user_list == NULL) {
+                    printf("No users registered in the system.\n");
+                    break;
+                }
+
+                while (current != NULL) {
+                    printf("%-5d | %-20s | %-15d\n",
+                           current->id, current->name, current->borrowed_count);
+                    count++;
+                    current = current->next;
+                }
+                break;
+            }
+            case 5: {
+                int id;
+                printf("Enter user ID: ");
+                read_int(&id);
+
+                list_user_reading_history(id);
+                break;
+            }
+            case 0:
+                printf("Returning to main menu.\n");
+                break;
+            default:
+                printf("Invalid choice. Please try again.\n");
+        }
+    } while(choice != 0);
+}
+
+void issue_return_menu() {
+    int choice;
+
+    do {
+        printf("\n===== Issue/Return Books =====\n");
+        printf("1. Issue Book\n");
+        printf("2. Return Book\n");
+        printf("3. Place Hold\n");
+        printf("4. Cancel Hold\n");
+        printf("5. View User Holds\n");
+        printf("6. Kiosk Checkout (multiple books)\n");
+        printf("7. Kiosk Return (multiple books)\n");
+        printf("0. Back to Main Menu\n");
+        printf("Enter your choice: ");
+        read_int(&choice);
+
+        switch(choice) {
+            case 1: {
+                int user_id;
+                char isbn[MAX_ISBN_LENGTH];
+
+                printf("Enter User ID: ");
+                read_int(&user_id);
+
+                printf("Enter ISBN of the book to issue: ");
+                read_isbn(isbn);
+
+                EngineResult result;
+                uint64_t started = engine_op_begin(LATENCY_ISSUE, isbn, user_id);
+                issue_book(user_id, isbn, &result);
+                engine_op_end(LATENCY_ISSUE, started);
+                render_result(LATENCY_ISSUE, isbn, user_id, &result);
+                break;
+            }
+            case 2: {
+                int user_id;
+                char isbn[MAX_ISBN_LENGTH];
+
+                printf("Enter User ID: ");
+                read_int(&user_id);
+
+                printf("Enter ISBN of the book to return: ");
+                read_isbn(isbn);
+
+                EngineResult result;
+                uint64_t started = engine_op_begin(LATENCY_RETURN, isbn, user_id);
+                return_book(user_id, isbn, &result);
+                engine_op_end(LATENCY_RETURN, started);
+                render_result(LATENCY_RETURN, isbn, user_id, &result);
+                break;
+            }
+            case 3: {
+                int user_id;
+                char isbn[MAX_ISBN_LENGTH];
+
+                printf("Enter User ID: ");
+                read_int(&user_id);
+
+                printf("Enter ISBN of the book to hold: ");
+                read_isbn(isbn);
+
+                EngineResult result;
+                uint64_t started = engine_op_begin(LATENCY_PLACE_HOLD, isbn, user_id);
+                place_hold(user_id, isbn, &result);
+                engine_op_end(LATENCY_PLACE_HOLD, started);
+                render_result(LATENCY_PLACE_HOLD, isbn, user_id, &result);
+                break;
+            }
+            case 4: {
+                int user_id;
+                char isbn[MAX_ISBN_LENGTH];
+
+                printf("Enter User ID: ");
+                read_int(&user_id);
+
+                printf("Enter ISBN of the hold to cancel: ");
+                read_isbn(isbn);
+
+                EngineResult result;
+                uint64_t started = engine_op_begin(LATENCY_CANCEL_HOLD, isbn, user_id);
+                cancel_hold(user_id, isbn, &result);
+                engine_op_end(LATENCY_CANCEL_HOLD, started);
+                render_result(LATENCY_CANCEL_HOLD, isbn, user_id, &result);
+                break;
+            }
+            case 5: {
+                int user_id;
+                printf("Enter User ID: ");
+                read_int(&user_id);
+
+                list_user_holds(user_id);
+                break;
+            }
+            case 6:
+            case 7: {
+                int user_id;
+                char isbns[MAX_BATCH_ITEMS][MAX_ISBN_LENGTH];
+                int count = 0;
+
+                printf("Enter User ID: ");
+                read_int(&user_id);
+
+                printf("Scan ISBNs, one per line (blank line to finish, at most %d):\n", MAX_BATCH_ITEMS);
+                while (count < MAX_BATCH_ITEMS) {
+                    read_isbn(isbns[count]);
+                    if (isbns[count][0] == '\0') {
+                        break;
+                    }
+                    count++;
+                }
+
+                int op = choice == 6 ? LATENCY_KIOSK_CHECKOUT : LATENCY_KIOSK_RETURN;
+                for (int i = 1; i < count; i++) {
+                    engine_op_extra(isbns[i]);
+                }
+                EngineResult result;
+                uint64_t started = engine_op_begin(op, count > 0 ? isbns[0] : NULL, user_id);
+                if (choice == 6) {
+                    issue_books_batch(user_id, isbns, count, &result);
+                } else {
+                    return_books_batch(user_id, isbns, count, &result);
+                }
+                engine_op_end(op, started);
+                render_batch_result(op, user_id, isbns, count, &result);
+                break;
+            }
+            case 0:
+                printf("Returning to main menu.\n");
+                break;
+            default:
+                printf("Invalid choice. Please try again.\n");
+        }
+    } while(choice != 0);
+}
+
+void search_menu() {
+    int choice;
+
+    do {
+        printf("\n===== Search =====\n");
+        printf("1. Search by ISBN\n");
+        printf("2. Search by Title\n");
+        printf("3. Search by Author\n");
+        printf("0. Back to Main Menu\n");
+        printf("Enter your choice: ");
+        read_int(&choice);
+
+        switch(choice) {
+            case 1: {
+                char isbn[MAX_ISBN_LENGTH];
+                printf("Enter ISBN: ");
+                read_isbn(isbn);
+
+                uint64_t started = engine_op_begin(LATENCY_SEARCH_ISBN, isbn, -1);
+                Book *book = search_book_by_isbn(isbn);
+                engine_op_end(LATENCY_SEARCH_ISBN, started);
+                if (book != NULL) {
+                    print_book_details(book);
+                } else {
+                    printf("Book with ISBN %s not found.\n", isbn);
+                }
+                break;
+            }
+            case 2: {
+                char title[MAX_TITLE_LENGTH];
+                printf("Enter Title: ");
+                read_string(title, MAX_TITLE_LENGTH);
+
+                uint64_t started = engine_op_begin(LATENCY_SEARCH_TITLE, title, -1);
+                TreeNode *result_node = search_by_title(title_bst_root, title);
+                engine_op_end(LATENCY_SEARCH_TITLE, started);
+                if (result_node != NULL && result_node->book != NULL) {
+                    print_book_details(result_node->book);
+                } else {
+                    printf("Book with title '%s' not found.\n", title);
+                }
+                break;
+            }
+            case 3: {
+                char author[MAX_AUTHOR_LENGTH];
+                printf("Enter Author: ");
+                read_string(author, MAX_AUTHOR_LENGTH);
+                uint64_t started = engine_op_begin(LATENCY_SEARCH_AUTHOR, author, -1);
+                list_books_by_author(author);
+                engine_op_end(LATENCY_SEARCH_AUTHOR, started);
+                break;
+            }
+            case 0:
+                printf("Returning to main menu.\n");
+                break;
+            default:
+                printf("Invalid choice. Please try again.\n");
+        }
+    } while(choice != 0);
+}
+
+void report_menu() {
+    int choice;
+
+    do {
+        printf("\n===== Reports =====\n");
+        printf("1. List All Books\n");
+        printf("2. List Available Books\n");
+        printf("3. List Borrowed Books\n");
+        printf("4. List Most Borrowed Books\n");
+        printf("5. List Active Users\n");
+        printf("6. List Overdue Loans\n");
+        printf("7. List Loans Due in Next 24 Hours\n");
+        printf("8. Loans per Month per Genre\n");
+        printf("9. Trending This Week\n");
+        printf("10. Trending This Month\n");
+        printf("11. Assess Overdue Fines\n");
+        printf("12. Background Jobs\n");
+        printf("13. Operation Latency\n");
+        printf("14. Export Latency Histograms (latency.json)\n");
+        printf("15. ISBN Index Diagnostics\n");
+        printf("16. Slow Operation Log\n");
+        printf("17. Hardware Counters\n");
+        printf("0. Back to Main Menu\n");
+        printf("Enter your choice: ");
+        read_int(&choice);
+
+        // Each report is one span in traces
+        const char *report_names[] = {NULL, "list_all_books", "list_available_books", "list_borrowed_books",
+                                      "list_most_borrowed_books", "list_active_users", "list_overdue_loans",
+                                      "list_loans_due_soon", "report_loans_by_month_and_genre", "trending_week",
+                                      "trending_month", "assess_overdue_fines", "list_background_jobs",
+                                      "list_operation_latency", "dump_latency_histograms",
+                                      "list_isbn_index_diagnostics", "list_slow_operations", "list_perf_counters"};
+        const char *report_name = choice > 0 && choice < (int)(sizeof(report_names) / sizeof(report_names[0]))
+                                  ? report_names[choice] : NULL;
+        if (report_name != NULL) {
+            trace_begin(report_name, "report");
+        }
+
+        // Catalog and loan scans are hardware-counter regions; the monthly report brackets only its scan
+        const int report_perf_ops[] = {-1, PERF_REPORT_ALL_BOOKS, PERF_REPORT_AVAILABLE, PERF_REPORT_BORROWED,
+                                       PERF_REPORT_MOST_BORROWED, PERF_REPORT_ACTIVE_USERS, PERF_REPORT_OVERDUE,
+                                       PERF_REPORT_DUE_SOON, -1, PERF_REPORT_TRENDING, PERF_REPORT_TRENDING};
+        int perf_op = choice > 0 && choice < (int)(sizeof(report_perf_ops) / sizeof(report_perf_ops[0]))
+                      ? report_perf_ops[choice] : -1;
+        if (perf_op >= 0) {
+            perf_begin(perf_op);
+        }
+
+        switch(choice) {
+            case 1:
+                list_all_books();
+                break;
+            case 2:
+                list_available_books();
+                break;
+            case 3:
+                list_borrowed_books();
+                break;
+            case 4:
+                list_most_borrowed_books();
+                break;
+            case 5:
+                list_active_users();
+                break;
+            case 6:
+                list_overdue_loans();
+                break;
+            case 7:
+                list_loans_due_soon();
+                break;
+            case 8: {
+                int start_year, start_month, end_year, end_month;
+                char month[16];
+                printf("Enter start month (YYYY-MM): ");
+                read_string(month, sizeof(month));
+                if (sscanf(month, "%d-%d", &start_year, &start_month) != 2) {
+                    printf("Invalid month.\n");
+                    break;
+                }
+                printf("Enter end month (YYYY-MM): ");
+                read_string(month, sizeof(month));
+                if (sscanf(month, "%d-%d", &end_year, &end_month) != 2) {
+                    printf("Invalid month.\n");
+                    break;
+                }
+
+                perf_begin(PERF_REPORT_MONTHLY_GENRE);
+                report_loans_by_month_and_genre(start_year, start_month, end_year, end_month);
+                perf_end(PERF_REPORT_MONTHLY_GENRE);
+                break;
+            }
+            case 9:
+                list_trending_books(7);
+                break;
+            case 10:
+                list_trending_books(TREND_DAYS);
+                break;
+            case 11: {
+                struct timespec start, end;
+                clock_gettime(CLOCK_MONOTONIC, &start);
+                long total = assess_overdue_fines(time(NULL));
+                clock_gettime(CLOCK_MONOTONIC, &end);
+                if (total < 0) {
+                    printf("Memory allocation failed for fine assessment.\n");
+                    break;
+                }
+                list_fine_summary();
+                printf("Assessed %d active loans in %.3f ms.\n", active_loan_count,
+                       (end.tv_sec - start.tv_sec) * 1e3 + (end.tv_nsec - start.tv_nsec) / 1e6);
+                break;
+            }
+            case 12:
+                list_background_jobs();
+                break;
+            case 13:
+                list_operation_latency();
+                break;
+            case 14:
+                dump_latency_histograms("latency.json");
+                break;
+            case 15:
+                list_isbn_index_diagnostics();
+                break;
+            case 16:
+                list_slow_operations();
+                break;
+            case 17:
+                list_perf_counters();
+                break;
+            case 0:
+                printf("Returning to main menu.\n");
+                break;
+            default:
+                printf("Invalid choice. Please try again.\n");
+        }
+        if (perf_op >= 0) {
+            perf_end(perf_op);
+        }
+        if (report_name != NULL) {
+            trace_end(report_name, "report");
+        }
+    } while(choice != 0);
+}
+
+// --- Helper Functions ---
+
+// Helper function to read a string with spaces
+// The engine lock is released while waiting for the operator, so background jobs run then
+void read_string(char *buffer, int length) {
+    engine_unlock_for_input();
+    if (fgets(buffer, length, stdin) == NULL) {
+        buffer[0] = '\0';
+    }
+    engine_relock_after_input();
+
+    // Remove trailing newline if present
+    int len = strlen(buffer);
+    if (len > 0 && buffer[len-1] == '\n') {
+        buffer[len-1] = '\0';
+    }
+}
+
+// Read an ISBN as the importer would store it: the 13-digit form when valid, else as typed.
+// Text that is already a catalog key is kept, so titles entered before normalization still match.
+void read_isbn(char *buffer) {
+    read_string(buffer, MAX_ISBN_LENGTH);
+
+    char normalized[MAX_ISBN_LENGTH];
+    if (!isbn_normalize(buffer, normalized) || strcmp(normalized, buffer) == 0) {
+        return;
+    }
+    for (Book *book = hash_table[hash_function(buffer)]; book != NULL; book = book->next) {
+        if (strcmp(book->isbn, buffer) == 0) {
+            return; // Probed directly so the check stays out of the ISBN lookup stats
+        }
+    }
+    strcpy(buffer, normalized);
+}
+
+// Helper function to read an integer line; on bad input *value is -1, at end of input 0
+int read_int(int *value) {
+    engine_unlock_for_input();
+    int matched = scanf("%d", value);
+    if (matched != EOF) {
+        clear_input_buffer();
+    }
+    engine_relock_after_input();
+
+    if (matched == 1) {
+        return 1;
+    }
+    *value = matched == EOF ? 0 : -1;
+    return 0;
+}
+
+// Helper function to clear input buffer
+void clear_input_buffer() {
+    int c;
+    while ((c = getchar()) != '\n' && c != EOF);
+}
+
+// Helper function to print the detail view of a title and its copies
+void print_book_details(Book *book) {
+    printf("\nBook Found:\n");
+    printf("ISBN: %s\n", book->isbn);
+    printf("Title: %s\n", book->title);
+    printf("Author: %s\n", book->author);
+    printf("Genre: %s\n", book->genre);
+    printf("Copies available: %d of %d\n", book->available, book->copy_count);
+    printf("Times borrowed: %d\n", book->borrow_count);
+    printf("Holds waiting: %d\n", book->hold_count);
+
+    for (int i = 0; i < book->copy_count; i++) {
+        BookCopy *copy = &book->copies[i];
+        if (copy->status == COPY_ON_LOAN) {
+            printf("  %-20s On loan (User ID: %d)\n", copy->barcode, copy->holder_id);
+        } else {
+            printf("  %-20s On shelf\n", copy->barcode);
+        }
+    }
+
+    Book *also[COOCCUR_TOP_N];
+    uint32_t also_counts[COOCCUR_TOP_N];
+    int also_count = cooccur_top(book, also, also_counts, COOCCUR_TOP_N);
+    if (also_count > 0) {
+        printf("\nPatrons who borrowed this also borrowed:\n");
+        for (int i = 0; i < also_count; i++) {
+            printf("  %-30s by %-20s (%u patrons)\n", also[i]->title, also[i]->author, also_counts[i]);
+        }
+    }
+}
+
+// Helper function to format a timestamp as local date and time
+void format_time(time_t t, char *buffer, size_t length) {
+    struct tm *tm_info = localtime(&t);
+    if (tm_info == NULL || strftime(buffer, length, "%Y-%m-%d %H:%M", tm_info) == 0) {
+        snprintf(buffer, length, "%ld", (long)t);
+    }
+}
+
+
+// --- File I/O Functions ---
+
+// Function to save all books to a file
+void save_books_to_file(const char *filename) {
+    FILE *file = fopen(filename, "w"); // Open in write mode, overwriting existing file
+    if (file == NULL) {
+        perror("Error opening books file for writing");
+        return;
+    }
+
+    write_books(file);
+    fclose(file);
+}
+
+// Write every book record to an open stream
+void write_books(FILE *file) {
+    for (int i = 0; i < hash_capacity; i++) {
+        for (Book *current = hash_table[i]; current != NULL; current = current->next) {
+            write_book(file, current);
+        }
+    }
+}
+
+// Write one book record (a checkpoint writes them in chunks)
+void write_book(FILE *file, Book *current) {
+    // Write book details in a delimited format (e.g., pipe '|')
+    fprintf(file, "%s|%s|%s|%s|%d|%d|%d|",
+            current->isbn,
+            current->title,
+            current->author,
+            current->genre,
+            current->available,
+            current->borrow_count,
+            current->copy_count);
+    // Copies as barcode:status:holder, separated by ';'
+    for (int c = 0; c < current->copy_count; c++) {
+        fprintf(file, "%s%s:%d:%d", c > 0 ? ";" : "",
+                current->copies[c].barcode, current->copies[c].status, current->copies[c].holder_id);
+    }
+    fprintf(file, "|%d\n", current->ordinal);
+}
+
+// Function to load books from a file
+void load_books_from_file(const char *filename) {
+    // Read the whole file first so I/O and parsing can be timed apart
+    char *data = slurp_file(filename, NULL);
+    if (data == NULL) {
+        return;
+    }
+
+    // Parse every record, then index them all at once
+    Book **parsed = NULL;
+    long parsed_count = 0;
+    long parsed_capacity = 0;
+    char *cursor = data;
+    char *line;
+    while ((line = next_buffered_line(&cursor)) != NULL) {
+        Book *new_book = (Book*)lib_calloc(ALLOC_CATALOG, 1, sizeof(Book)); // Zeroed: no holds queued
+        if (new_book == NULL) {
+            printf("Memory allocation failed during book loading.\n");
+            break;
+        }
+
+        // Parse the line using strtok
+        char *token = strtok(line, "|");
+        if (token != NULL) strcpy(new_book->isbn, token); else { lib_free(new_book); continue; }
+        token = strtok(NULL, "|");
+        if (token != NULL) strcpy(new_book->title, token); else { lib_free(new_book); continue; }
+        token = strtok(NULL, "|");
+        if (token != NULL) strcpy(new_book->author, token); else { lib_free(new_book); continue; }
+        token = strtok(NULL, "|");
+        if (token != NULL) strcpy(new_book->genre, token); else { lib_free(new_book); continue; }
+        token = strtok(NULL, "|");
+        if (token != NULL) new_book->available = atoi(token); else { lib_free(new_book); continue; }
+        token = strtok(NULL, "|");
+        if (token != NULL) new_book->borrow_count = atoi(token); else { lib_free(new_book); continue; }
+
+        // Copy inventory; older files have a single copy whose state is the availability flag
+        int on_shelf = new_book->available;
+        new_book->available = 0;
+        new_book->free_copy = -1;
+        token = strtok(NULL, "|"); // Copy count (informational)
+        char *copies_field = token != NULL ? strtok(NULL, "|") : NULL;
+        char *ordinal_field = copies_field != NULL ? strtok(NULL, "|") : NULL;
+        new_book->ordinal = ordinal_field != NULL ? atoi(ordinal_field) : 0;
+        if (copies_field != NULL) {
+            char *rest = copies_field;
+            char *entry;
+            while ((entry = strtok_r(rest, ";", &rest)) != NULL) {
+                char *barcode = strtok_r(entry, ":", &entry);
+                char *status = strtok_r(entry, ":", &entry);
+                char *holder = strtok_r(entry, ":", &entry);
+                if (barcode == NULL || add_copies(new_book, 1) != 1) {
+                    continue;
+                }
+                BookCopy *copy = &new_book->copies[new_book->copy_count - 1];
+                snprintf(copy->barcode, MAX_BARCODE_LENGTH, "%.*s", MAX_BARCODE_LENGTH - 1, barcode);
+                copy->status = status != NULL ? atoi(status) : COPY_ON_SHELF;
+                copy->holder_id = holder != NULL ? atoi(holder) : 0;
+            }
+        }
+        if (new_book->copy_count == 0) {
+            if (add_copies(new_book, 1) != 1) { lib_free(new_book); continue; }
+            new_book->copies[0].status = on_shelf ? COPY_ON_SHELF : COPY_ON_LOAN;
+        }
+        rebuild_free_copies(new_book);
+
+        if (parsed_count == parsed_capacity) {
+            long new_capacity = parsed_capacity > 0 ? parsed_capacity * 2 : 1024;
+            Book **grown = (Book**)lib_realloc(ALLOC_LOADING, parsed, new_capacity * sizeof(Book*));
+            if (grown == NULL) {
+                printf("Memory allocation failed during book loading.\n");
+                lib_free(new_book->copies);
+                lib_free(new_book);
+                break;
+            }
+            parsed = grown;
+            parsed_capacity = new_capacity;
+        }
+        parsed[parsed_count++] = new_book;
+    }
+    lib_free(data);
+
+    uint64_t index_start = monotonic_ns();
+    hash_table_reserve(hash_count + parsed_count);
+
+    for (long i = 0; i < parsed_count; i++) {
+        // Older files carry no ordinal; link_book assigns a fresh one
+        if (!link_book(parsed[i])) {
+            printf("Memory allocation failed during book loading.\n");
+            for (long j = i; j < parsed_count; j++) {
+                lib_free(parsed[j]->copies);
+                lib_free(parsed[j]);
+            }
+            break;
+        }
+    }
+    lib_free(parsed);
+
+    if (startup_current != NULL) {
+        startup_current->records += parsed_count;
+        startup_current->index_ns += monotonic_ns() - index_start;
+    }
+}
+
+// Function to save all users to a file
+void save_users_to_file(const char *filename) {
+    FILE *file = fopen(filename, "w");
+    if (file == NULL) {
+        perror("Error opening users file for writing");
+        return;
+    }
+
+    write_users(file);
+    fclose(file);
+}
+
+// Write every user and their loans to an open stream
+void write_users(FILE *file) {
+    for (User *current = user_list; current != NULL; current = current->next) {
+        write_user(file, current);
+    }
+}
+
+// Write one user record
+void write_user(FILE *file, User *current) {
+    // Write user details
+    fprintf(file, "%d|%s|%d", current->id, current->name, current->borrowed_count);
+    // Write borrowed books with their issue and due times and fine class
+    for (int i = 0; i < current->borrowed_count; i++) {
+        fprintf(file, "|%s,%ld,%ld,%d", current->borrowed_books[i],
+                (long)current->loans[i]->issue_time, (long)current->loans[i]->due_time,
+                current->loans[i]->rate_class);
+    }
+    fprintf(file, "\n");
+}
+
+// Function to load users from a file
+void load_users_from_file(const char *filename) {
+    char *data = slurp_file(filename, NULL);
+    if (data == NULL) {
+        return;
+    }
+
+    int current_max_id = 1000; // Track max ID to correctly set next_user_id
+    long loaded_users = 0;
+
+    // Initialize user_list to NULL
+    User *temp_user_list = NULL;
+
+    char *cursor = data;
+    char *line;
+    while ((line = next_buffered_line(&cursor)) != NULL) {
+        User *new_user = (User*)lib_calloc(ALLOC_USERS, 1, sizeof(User)); // Zeroed: empty reading history
+        if (new_user == NULL) {
+            printf("Memory allocation failed during user loading.\n");
+            break;
+        }
+        new_user->next = NULL;
+        new_user->holds = NULL;
+        new_user->hold_count = 0;
+
+        char *token;
+        char *rest_of_line = line; 
+
+        token = strtok_r(rest_of_line, "|", &rest_of_line);
+        if (token != NULL) new_user->id = atoi(token); else { lib_free(new_user); continue; }
+
+        token = strtok_r(rest_of_line, "|", &rest_of_line);
+        if (token != NULL) strcpy(new_user->name, token); else { lib_free(new_user); continue; }
+
+        token = strtok_r(rest_of_line, "|", &rest_of_line);
+        if (token != NULL) new_user->borrowed_count = atoi(token); else { lib_free(new_user); continue; }
+        if (new_user->borrowed_count < 0 || new_user->borrowed_count > MAX_BORROWED) { lib_free(new_user); continue; }
+
+        // Each borrowed entry is "isbn,issue_time,due_time,rate_class" (older files stop earlier)
+        int loaded = 0;
+        time_t now = time(NULL);
+        for (int i = 0; i < new_user->borrowed_count; i++) {
+            token = strtok_r(rest_of_line, "|", &rest_of_line);
+            if (token == NULL) {
+                break;
+            }
+
+            char *fields = token;
+            char *isbn = strtok_r(fields, ",", &fields);
+            char *issue_field = strtok_r(fields, ",", &fields);
+            char *due_field = strtok_r(fields, ",", &fields);
+            char *class_field = strtok_r(fields, ",", &fields);
+            if (isbn == NULL) {
+                break;
+            }
+
+            time_t issue_time = issue_field != NULL ? (time_t)atol(issue_field) : now;
+            time_t due_time = due_field != NULL ? (time_t)atol(due_field)
+                                                : issue_time + (time_t)LOAN_PERIOD_DAYS * SECONDS_PER_DAY;
+
+            strcpy(new_user->borrowed_books[loaded], isbn);
+            new_user->loans[loaded] = create_loan(new_user, search_book_by_isbn(isbn), issue_time, due_time);
+            if (new_user->loans[loaded] == NULL) {
+                break;
+            }
+            strcpy(new_user->loans[loaded]->isbn, isbn);
+            // Holds load after users, so the class set at issue time comes from the file
+            if (class_field != NULL && atoi(class_field) == FINE_CLASS_HIGH_DEMAND) {
+                new_user->loans[loaded]->rate_class = FINE_CLASS_HIGH_DEMAND;
+                active_daily_rates[new_user->loans[loaded]->active_index] = FINE_RATE_HIGH_DEMAND_CENTS;
+            }
+            if (new_user->loans[loaded]->book != NULL) {
+                new_user->loans[loaded]->copy_index = attach_loaded_copy(new_user->loans[loaded]->book, new_user->id);
+            }
+            loaded++;
+        }
+        new_user->borrowed_count = loaded;
+
+        // Add to the beginning of the temporary linked list
+        new_user->next = temp_user_list;
+        temp_user_list = new_user;
+        loaded_users++;
+
+        if (new_user->id > current_max_id) {
+            current_max_id = new_user->id;
+        }
+    }
+    next_user_id = current_max_id + 1; // Set next_user_id correctly
+
+    // Reverse the temporary list to maintain original order 
+    user_list = NULL;
+    User *current_temp = temp_user_list;
+    while(current_temp != NULL) {
+        User *node_to_move = current_temp;
+        current_temp = current_temp->next;
+
+        node_to_move->next = user_list;
+        user_list = node_to_move;
+    }
+    registered_users = loaded_users;
+
+    lib_free(data);
+    if (startup_current != NULL) {
+        startup_current->records += loaded_users;
+    }
+}
+
+
+// Function to save hold queues to a file, each book's queue in FIFO order
+void save_holds_to_file(const char *filename) {
+    FILE *file = fopen(filename, "w");
+    if (file == NULL) {
+        perror("Error opening holds file for writing");
+        return;
+    }
+
+    write_holds(file);
+    fclose(file);
+}
+
+// Write every hold queue to an open stream
+void write_holds(FILE *file) {
+    for (int i = 0; i < hash_capacity; i++) {
+        for (Book *book = hash_table[i]; book != NULL; book = book->next) {
+            write_book_holds(file, book);
+        }
+    }
+}
+
+// Write one book's hold queue in FIFO order
+void write_book_holds(FILE *file, Book *book) {
+    for (Hold *hold = book->hold_head; hold != NULL; hold = hold->next_in_book) {
+        fprintf(file, "%s|%d|%ld\n", book->isbn, hold->user->id, (long)hold->placed_time);
+    }
+}
+
+// Function to load hold queues from a file (books and users must already be loaded)
+void load_holds_from_file(const char *filename) {
+    FILE *file = fopen(filename, "r");
+    if (file == NULL) {
+        return;
+    }
+
+    char line[256];
+    long loaded_holds = 0;
+    while (fgets(line, sizeof(line), file) != NULL) {
+        line[strcspn(line, "\n")] = '\0';
+
+        char *rest_of_line = line;
+        char *isbn = strtok_r(rest_of_line, "|", &rest_of_line);
+        char *user_field = strtok_r(rest_of_line, "|", &rest_of_line);
+        char *placed_field = strtok_r(rest_of_line, "|", &rest_of_line);
+        if (isbn == NULL || user_field == NULL) {
+            continue;
+        }
+
+        Book *book = search_book_by_isbn(isbn);
+        User *user = find_user(atoi(user_field));
+        if (book == NULL || user == NULL || find_user_hold(user, book) != NULL) {
+            continue; // Stale entry: book or user no longer exists
+        }
+
+        if (enqueue_hold(user, book, placed_field != NULL ? (time_t)atol(placed_field) : time(NULL)) == NULL) {
+            printf("Memory allocation failed during hold loading.\n");
+            break;
+        }
+        loaded_holds++;
+    }
+
+    if (startup_current != NULL) {
+        startup_current->bytes += ftell(file);
+        startup_current->records += loaded_holds;
+    }
+
+    fclose(file);
+}
+
+
+// Function to append not-yet-persisted history events to the history file
+// Each block: count, base/min/max time, user dictionary, then one array per column
+void save_history_to_file(const char *filename) {
+    if (!history_has_unsaved()) {
+        return;
+    }
+
+    // Built in memory first so a failure part way never leaves a partial block in the file
+    char *data = NULL;
+    size_t length = 0;
+    FILE *stream = open_memstream(&data, &length);
+    if (stream == NULL) {
+        printf("Memory allocation failed while saving history.\n");
+        return;
+    }
+    HistorySegment *last = history_tail;
+    int last_count = last->count;
+    int ok = write_history(stream, 0);
+    ok &= fclose(stream) == 0;
+
+    // Append-only: earlier blocks are never rewritten
+    if (ok && checkpoint_append_file(filename, data, length)) {
+        history_mark_persisted(last, last_count);
+    } else {
+        printf("Error writing history file; unsaved events will be written next time.\n");
+    }
+    free(data); // Allocated by open_memstream, not lib_malloc
+}
+
+// Are there events the history file does not have yet?
+int history_has_unsaved() {
+    for (HistorySegment *segment = history_head; segment != NULL; segment = segment->next) {
+        if (segment->count > segment->persisted) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// Write the not-yet-persisted events as blocks to an open stream (every event with
+// everything set, for capture snapshots); the caller marks them persisted once saved.
+// 0 if memory for a block's dictionary ran out.
+int write_history(FILE *file, int everything) {
+    for (HistorySegment *segment = history_head; segment != NULL; segment = segment->next) {
+        int first = everything ? 0 : segment->persisted;
+        if (segment->count - first <= 0) {
+            continue;
+        }
+
+        time_t t = segment->base_time;
+        int wide = 0;
+        for (int i = 0; i <= first; i++) {
+            t = history_event_time(segment, i, t, &wide);
+        }
+
+        // One block per stretch without escaped gaps, so every delta fits the file's column;
+        // each block is rebased on the time of its first event
+        int start = first;
+        while (start < segment->count) {
+            time_t base = t;
+            int end = start + 1;
+            while (end < segment->count && segment->time_deltas[end] != HISTORY_DELTA_ESCAPE) {
+                t += segment->time_deltas[end++];
+            }
+            if (!write_history_block(file, segment, start, end - start, base, t)) {
+                return 0;
+            }
+            if (end < segment->count) {
+                t = history_event_time(segment, end, t, &wide);
+            }
+            start = end;
+        }
+    }
+    return 1;
+}
+
+// Write events [start, start + n) of a segment as one block. The block gets its own user
+// dictionary holding only the users it mentions, so small blocks stay small.
+int write_history_block(FILE *file, HistorySegment *segment, int start, int n, time_t base, time_t max_time) {
+    int *block_code = (int*)lib_malloc(ALLOC_HISTORY, segment->user_dict_count * sizeof(int));
+    int *dict = (int*)lib_malloc(ALLOC_HISTORY, n * sizeof(int));
+    uint16_t *codes = (uint16_t*)lib_malloc(ALLOC_HISTORY, n * sizeof(uint16_t));
+    if (block_code == NULL || dict == NULL || codes == NULL) {
+        lib_free(block_code);
+        lib_free(dict);
+        lib_free(codes);
+        return 0;
+    }
+    memset(block_code, -1, segment->user_dict_count * sizeof(int));
+
+    int dict_count = 0;
+    for (int i = 0; i < n; i++) {
+        int code = segment->user_codes[start + i];
+        if (block_code[code] < 0) {
+            block_code[code] = dict_count;
+            dict[dict_count++] = segment->user_dict[code];
+        }
+        codes[i] = (uint16_t)block_code[code];
+    }
+
+    int32_t header[2] = {n, dict_count};
+    int64_t times[3] = {(int64_t)base, (int64_t)base, (int64_t)max_time};
+    uint16_t zero = 0;
+
+    fwrite(header, sizeof(header), 1, file);
+    fwrite(times, sizeof(times), 1, file);
+    fwrite(dict, sizeof(int), dict_count, file);
+    fwrite(&zero, sizeof(uint16_t), 1, file);
+    fwrite(segment->time_deltas + start + 1, sizeof(uint16_t), n - 1, file);
+    fwrite(codes, sizeof(uint16_t), n, file);
+    fwrite(segment->book_ordinals + start, sizeof(uint32_t), n, file);
+    fwrite(segment->event_types + start, sizeof(uint8_t), n, file);
+
+    lib_free(block_code);
+    lib_free(dict);
+    lib_free(codes);
+    return 1;
+}
+
+// Mark events persisted up to `last` (all of the earlier, sealed segments) and the first
+// `last_count` events of `last`: the state a successful write_history covered
+void history_mark_persisted(HistorySegment *last, int last_count) {
+    if (last == NULL) {
+        return;
+    }
+    for (HistorySegment *segment = history_head; segment != NULL; segment = segment->next) {
+        int target = segment == last ? last_count : segment->count;
+        if (segment->persisted < target) {
+            segment->persisted = target;
+        }
+        if (segment == last) {
+            break;
+        }
+    }
+}
+
+// Function to load history blocks as sealed segments
+void load_history_from_file(const char *filename) {
+    FILE *file = fopen(filename, "rb");
+    if (file == NULL) {
+        return;
+    }
+
+    int32_t header[2];
+    int64_t times[3];
+    while (fread(header, sizeof(header), 1, file) == 1 && fread(times, sizeof(times), 1, file) == 1) {
+        int n = header[0];
+        int dict_count = header[1];
+        if (n <= 0 || n > HISTORY_SEGMENT_CAPACITY || dict_count < 0 || dict_count > UINT16_MAX) {
+            printf("History file is corrupt; ignoring the rest of it.\n");
+            break;
+        }
+
+        HistorySegment *segment = history_new_segment((time_t)times[0], n);
+        int *dict = segment != NULL && dict_count > n ?
+                    (int*)lib_realloc(ALLOC_HISTORY, segment->user_dict, dict_count * sizeof(int)) : NULL;
+        if (dict != NULL) {
+            segment->user_dict = dict; // Older partial blocks carry their segment's whole dictionary
+        }
+        if (segment == NULL || (dict_count > n && dict == NULL)) {
+            printf("Memory allocation failed during history loading.\n");
+            break;
+        }
+
+        if (fread(segment->user_dict, sizeof(int), dict_count, file) != (size_t)dict_count ||
+            fread(segment->time_deltas, sizeof(uint16_t), n, file) != (size_t)n ||
+            fread(segment->user_codes, sizeof(uint16_t), n, file) != (size_t)n ||
+            fread(segment->book_ordinals, sizeof(uint32_t), n, file) != (size_t)n ||
+            fread(segment->event_types, sizeof(uint8_t), n, file) != (size_t)n) {
+            printf("History file is truncated; ignoring the partial block.\n");
+            break;
+        }
+
+        segment->count = n;
+        segment->persisted = n;
+        segment->user_dict_count = dict_count;
+        segment->min_time = (time_t)times[1];
+        segment->max_time = (time_t)times[2];
+        history_event_count += n;
+        if (startup_current != NULL) {
+            startup_current->records += n;
+        }
+    }
+
+    // Loaded blocks are sealed (sized exactly); new events go to a fresh segment
+    if (startup_current != NULL) {
+        startup_current->bytes += ftell(file);
+    }
+    fclose(file);
+}
+
+
+// --- Startup Profiling Functions ---
+
+// Read a whole file into a NUL-terminated buffer (caller frees); NULL if it can't be read
+char* slurp_file(const char *filename, long *length) {
+    uint64_t start = monotonic_ns();
+    FILE *file = fopen(filename, "rb");
+    if (file == NULL) {
+        return NULL;
+    }
+
+    long size = 0;
+    if (fseek(file, 0, SEEK_END) == 0) {
+        size = ftell(file);
+        rewind(file);
+    }
+    char *data = size >= 0 ? (char*)lib_malloc(ALLOC_LOADING, size + 1) : NULL;
+    if (data == NULL || fread(data, 1, size, file) != (size_t)size) {
+        printf("Could not read %s.\n", filename);
+        lib_free(data);
+        fclose(file);
+        return NULL;
+    }
+    data[size] = '\0';
+    fclose(file);
+
+    if (length != NULL) {
+        *length = size;
+    }
+    if (startup_current != NULL) {
+        startup_current->bytes += size;
+        startup_current->io_ns += monotonic_ns() - start;
+    }
+    return data;
+}
+
+// Cut the next line out of a slurped buffer in place; NULL at the end
+char* next_buffered_line(char **cursor) {
+    char *line = *cursor;
+    if (*line == '\0') {
+        return NULL;
+    }
+    char *newline = strchr(line, '\n');
+    if (newline != NULL) {
+        *newline = '\0';
+        *cursor = newline + 1;
+    } else {
+        *cursor = line + strlen(line);
+    }
+    return line;
+}
+
+void startup_phase_begin(const char *name) {
+    if (startup_phase_count == STARTUP_MAX_PHASES) {
+        return;
+    }
+    StartupPhase *phase = &startup_phases[startup_phase_count++];
+    memset(phase, 0, sizeof(*phase));
+    phase->name = name;
+    phase->start_allocs = alloc_counters.allocs;
+    phase->start_ns = monotonic_ns();
+    startup_current = phase;
+    trace_begin(name, "startup");
+}
+
+void startup_phase_end() {
+    if (startup_current == NULL) {
+        return;
+    }
+    startup_current->ns = monotonic_ns() - startup_current->start_ns;
+    startup_current->allocs = alloc_counters.allocs - startup_current->start_allocs;
+    trace_end(startup_current->name, "startup");
+    startup_current = NULL;
+}
+
+// Height of the title BST (longest root-to-leaf path). Iterative: a degenerate tree is what this should reveal.
+int bst_height(TreeNode *root) {
+    typedef struct { TreeNode *node; int depth; } Pending;
+    Pending *stack = NULL;
+    int capacity = 0;
+    int top = 0;
+    int height = 0;
+
+    if (root != NULL) {
+        stack = (Pending*)lib_malloc(ALLOC_TOOLS, 64 * sizeof(Pending));
+        if (stack == NULL) {
+            return -1;
+        }
+        capacity = 64;
+        stack[top++] = (Pending){root, 1};
+    }
+    while (top > 0) {
+        Pending item = stack[--top];
+        if (item.depth > height) {
+            height = item.depth;
+        }
+        if (top + 2 > capacity) {
+            Pending *grown = (Pending*)lib_realloc(ALLOC_TOOLS, stack, capacity * 2 * sizeof(Pending));
+            if (grown == NULL) {
+                height = -1;
+                break;
+            }
+            stack = grown;
+            capacity *= 2;
+        }
+        if (item.node->left != NULL) {
+            stack[top++] = (Pending){item.node->left, item.depth + 1};
+        }
+        if (item.node->right != NULL) {
+            stack[top++] = (Pending){item.node->right, item.depth + 1};
+        }
+    }
+    lib_free(stack);
+    return height;
+}
+
+// Printed at launch with --verbose
+void print_startup_profile() {
+    uint64_t total = 0;
+    printf("\n===== Startup Profile =====\n");
+    printf("%-26s | %9s | %8s | %8s | %10s | %9s | %9s\n",
+           "Phase", "Total ms", "I/O ms", "Index ms", "Bytes", "Records", "Allocs");
+    printf("------------------------------------------------------------------------------------------------\n");
+    for (int i = 0; i < startup_phase_count; i++) {
+        StartupPhase *phase = &startup_phases[i];
+        printf("%-26s | %9.2f | %8.2f | %8.2f | %10ld | %9ld | %9llu\n",
+               phase->name, phase->ns / 1e6, phase->io_ns / 1e6, phase->index_ns / 1e6,
+               phase->bytes, phase->records, (unsigned long long)phase->allocs);
+        total += phase->ns;
+    }
+    printf("Total: %.2f ms | Titles: %ld | Hash buckets: %d | Title BST height: %d\n",
+           total / 1e6, hash_count, hash_capacity, bst_height(title_bst_root));
+}
+
+// Machine-readable copy of the startup profile, for tracking regressions
+void dump_startup_profile(const char *filename) {
+    FILE *file = fopen(filename, "w");
+    if (file == NULL) {
+        perror("Error opening startup profile for writing");
+        return;
+    }
+
+    uint64_t total = 0;
+    fprintf(file, "{\"started_at\":%ld,\"phases\":[", (long)time(NULL));
+    for (int i = 0; i < startup_phase_count; i++) {
+        StartupPhase *phase = &startup_phases[i];
+        fprintf(file, "%s\n{\"phase\":\"%s\",\"ns\":%llu,\"io_ns\":%llu,\"index_ns\":%llu,"
+                "\"bytes\":%ld,\"records\":%ld,\"allocs\":%llu}",
+                i > 0 ? "," : "", phase->name, (unsigned long long)phase->ns,
+                (unsigned long long)phase->io_ns, (unsigned long long)phase->index_ns,
+                phase->bytes, phase->records, (unsigned long long)phase->allocs);
+        total += phase->ns;
+    }
+    fprintf(file, "\n],\"total_ns\":%llu,\"titles\":%ld,\"hash_buckets\":%d,\"bst_height\":%d}\n",
+            (unsigned long long)total, hash_count, hash_capacity, bst_height(title_bst_root));
+    fclose(file);
+}
+
+
+// --- Memory Freeing Functions ---
+
+// Helper function to free BST nodes recursively
+void free_bst_nodes(TreeNode *root) {
+    if (root != NULL) {
+        free_bst_nodes(root->left);
+        free_bst_nodes(root->right);
+        lib_free(root); // Free the TreeNode itself
+    }
+}
+
+// Function to free all books from the hash table and BST
+void free_all_books() {
+    for (int i = 0; i < hash_capacity; i++) {
+        Book *current = hash_table[i];
+        while (current != NULL) {
+            Book *temp = current;
+            current = current->next;
+            clear_book_holds(temp); // Free queued holds
+            lib_free(temp->copies); // Free the copy array
+            lib_free(temp->cooccur); // Free the co-occurrence row
+            lib_free(temp); // Free the Book structure
+        }
+        hash_table[i] = NULL; // Reset the hash table entry
+    }
+    if (hash_table != hash_initial_buckets) {
+        lib_free(hash_table); // Back to the small built-in table
+        hash_table = hash_initial_buckets;
+        hash_capacity = HASH_TABLE_INITIAL_SIZE;
+    }
+    hash_count = 0;
+    free_bst_nodes(title_bst_root); // Free BST nodes
+    title_bst_root = NULL; // Reset BST root
+    lib_free(book_by_ordinal); // Free the ordinal index
+    book_by_ordinal = NULL;
+    book_ordinal_capacity = 0;
+    printf("All book data freed from memory.\n");
+}
+
+// Function to free the loan history
+void free_history() {
+    HistorySegment *segment = history_head;
+    while (segment != NULL) {
+        HistorySegment *next = segment->next;
+        lib_free(segment->time_deltas);
+        lib_free(segment->user_codes);
+        lib_free(segment->book_ordinals);
+        lib_free(segment->event_types);
+        lib_free(segment->user_dict);
+        lib_free(segment->user_dict_slots);
+        lib_free(segment->wide_times);
+        lib_free(segment);
+        segment = next;
+    }
+    history_head = NULL;
+    history_tail = NULL;
+    history_event_count = 0;
+}
+
+// Function to free all users from the linked list
+void free_all_users() {
+    User *current = user_list;
+    while (current != NULL) {
+        User *temp = current;
+        current = current->next;
+        for (int i = 0; i < temp->borrowed_count; i++) {
+            cancel_loan(temp->loans[i]); // Free outstanding loan records
+        }
+        lib_free(temp->read_history); // Free the reading history
+        lib_free(temp->read_filter);
+        lib_free(temp); // Free the User structure
+    }
+    user_list = NULL; // Reset the user list head
+    registered_users = 0;
+    printf("All user data freed from memory.\n");
+}
+
+// --- Benchmark Functions ---
+
+const char *bench_genres[] = {"Fiction", "Science", "History", "Poetry", "Mystery", "Biography", "Travel", "Art"};
+
+// xorshift64*: deterministic, so every run measures the same key sequence
+uint64_t bench_random(BenchContext *ctx) {
+    ctx->rng ^= ctx->rng >> 12;
+    ctx->rng ^= ctx->rng << 25;
+    ctx->rng ^= ctx->rng >> 27;
+    return ctx->rng * 2685821657736338717ULL;
+}
+
+// Parse a comma-separated list of catalog sizes
+int bench_parse_sizes(const char *text, long *sizes, int max_sizes) {
+    int count = 0;
+    while (*text != '\0' && count < max_sizes) {
+        char *end;
+        long size = strtol(text, &end, 10);
+        if (end == text || size <= 0) {
+            return 0;
+        }
+        sizes[count++] = size;
+        text = *end == ',' ? end + 1 : end;
+        if (*end != ',' && *end != '\0') {
+            return 0;
+        }
+    }
+    return count;
+}
+
+// Check an operation name against the --ops filter
+int bench_selected(BenchContext *ctx, const char *name) {
+    if (ctx->only_ops == NULL) {
+        return 1;
+    }
+    size_t length = strlen(name);
+    const char *p = ctx->only_ops;
+    while ((p = strstr(p, name)) != NULL) {
+        int starts = p == ctx->only_ops || p[-1] == ',';
+        int ends = p[length] == '\0' || p[length] == ',';
+        if (starts && ends) {
+            return 1;
+        }
+        p += length;
+    }
+    return 0;
+}
+
+// Build a synthetic catalog: sequential ISBNs, scattered titles, one patron per ten titles
+int bench_build_catalog(BenchContext *ctx, long size) {
+    ctx->size = size;
+    ctx->books = (Book**)lib_malloc(ALLOC_TOOLS, size * sizeof(Book*));
+    ctx->sorted_books = (Book**)lib_malloc(ALLOC_TOOLS, size * sizeof(Book*));
+    ctx->user_count = size / 10 > 0 ? size / 10 : 1;
+    ctx->user_ids = (int*)lib_malloc(ALLOC_TOOLS, ctx->user_count * sizeof(int));
+    if (ctx->books == NULL || ctx->sorted_books == NULL || ctx->user_ids == NULL) {
+        return 0;
+    }
+
+    for (long i = 0; i < size; i++) {
+        Book *book = (Book*)lib_calloc(ALLOC_CATALOG, 1, sizeof(Book));
+        if (book == NULL) {
+            return 0;
+        }
+        uint64_t mixed = (uint64_t)i * 0x9E3779B97F4A7C15ULL;
+        mixed ^= mixed >> 31;
+        snprintf(book->isbn, MAX_ISBN_LENGTH, "978%010ld", i % 10000000000L);
+        snprintf(book->title, MAX_TITLE_LENGTH, "Title %016llx", (unsigned long long)mixed);
+        snprintf(book->author, MAX_AUTHOR_LENGTH, "Author %ld", i % 5000);
+        strcpy(book->genre, bench_genres[i % 8]);
+        book->free_copy = -1;
+        if (add_copies(book, 1 + (int)(i % 3)) == 0 || !link_book(book)) {
+            lib_free(book->copies);
+            lib_free(book);
+            return 0;
+        }
+        ctx->books[i] = book;
+    }
+
+    for (long i = 0; i < ctx->user_count; i++) {
+        char name[MAX_NAME_LENGTH];
+        snprintf(name, sizeof(name), "Patron %ld", i);
+        EngineResult result;
+        if (add_user(name, &result) != ENGINE_OK) {
+            return 0;
+        }
+        ctx->user_ids[i] = result.user->id;
+    }
+
+    for (int i = 0; i < BENCH_MISS_KEYS; i++) {
+        snprintf(ctx->miss_isbns[i], MAX_ISBN_LENGTH, "979%010llu",
+                 (unsigned long long)(bench_random(ctx) % 10000000000ULL));
+        snprintf(ctx->miss_titles[i], MAX_TITLE_LENGTH, "Title %016llx?", (unsigned long long)bench_random(ctx));
+    }
+
+    long count = 0;
+    bench_collect_titles(title_bst_root, ctx->sorted_books, &count);
+    ctx->issued = 0;
+    ctx->inserted = 0;
+    return 1;
+}
+
+// Inorder walk of the title BST into an array
+void bench_collect_titles(TreeNode *root, Book **out, long *count) {
+    if (root != NULL) {
+        bench_collect_titles(root->left, out, count);
+        out[(*count)++] = root->book;
+        bench_collect_titles(root->right, out, count);
+    }
+}
+
+// Free everything a catalog size built so the next size starts clean
+void bench_reset_engine(BenchContext *ctx) {
+    free_all_books();
+    free_all_users();
+    free_history();
+    next_user_id = 1001;
+    next_book_ordinal = 1;
+    active_loan_count = 0;
+    lib_free(ctx->books);
+    lib_free(ctx->sorted_books);
+    lib_free(ctx->user_ids);
+    ctx->books = NULL;
+    ctx->sorted_books = NULL;
+    ctx->user_ids = NULL;
+}
+
+// Run an operation in doubling batches until min_time_ns has passed or max_iters ran
+void bench_run(BenchContext *ctx, const char *name, BenchOp op, long max_iters, long size_used) {
+    if (!bench_selected(ctx, name) || max_iters <= 0) {
+        return;
+    }
+
+    AllocCounters before = alloc_counters;
+    PerfSample perf_before, perf_after;
+    if (ctx->perf) {
+        perf_read(&perf_before);
+    }
+    uint64_t start = monotonic_ns();
+    uint64_t elapsed = 0;
+    long done = 0;
+    long batch = 1;
+    while (done < max_iters) {
+        long end = done + batch < max_iters ? done + batch : max_iters;
+        for (long i = done; i < end; i++) {
+            op(ctx, i);
+        }
+        done = end;
+        elapsed = monotonic_ns() - start;
+        if (elapsed >= ctx->min_time_ns) {
+            break;
+        }
+        if (batch < 65536) {
+            batch *= 2;
+        }
+    }
+
+    if (ctx->perf) {
+        perf_read(&perf_after);
+    }
+    double ns_per_op = (double)elapsed / done;
+    double ops_per_sec = elapsed > 0 ? done * 1e9 / elapsed : 0.0;
+    double allocs_per_op = (double)(alloc_counters.allocs - before.allocs) / done;
+    double bytes_per_op = (double)(alloc_counters.bytes - before.bytes) / done;
+    if (ctx->compare) {
+        if (ctx->result_count < BENCH_MAX_RESULTS) {
+            BenchResult *result = &ctx->results[ctx->result_count++];
+            result->size = ctx->size;
+            snprintf(result->op, sizeof(result->op), "%s", name);
+            result->ns_per_op = ns_per_op;
+            result->allocs_per_op = allocs_per_op;
+        }
+    } else if (ctx->csv) {
+        fprintf(ctx->out, "%ld,%s,%ld,%ld,%.1f,%.0f,%.3f,%.1f,%d",
+                ctx->size, name, size_used, done, ns_per_op, ops_per_sec, allocs_per_op, bytes_per_op, ctx->run);
+        for (int c = 0; ctx->perf && c < PERF_COUNTERS; c++) {
+            if (perf_available[c]) {
+                fprintf(ctx->out, ",%.2f", (double)(perf_after.values[c] - perf_before.values[c]) / done);
+            } else {
+                fprintf(ctx->out, ",");
+            }
+        }
+        fprintf(ctx->out, "\n");
+    } else {
+        fprintf(ctx->out, "{\"size\":%ld,\"op\":\"%s\",\"n\":%ld,\"iterations\":%ld,\"ns_per_op\":%.1f,"
+                "\"ops_per_sec\":%.0f,\"allocs_per_op\":%.3f,\"bytes_per_op\":%.1f,\"run\":%d",
+                ctx->size, name, size_used, done, ns_per_op, ops_per_sec, allocs_per_op, bytes_per_op, ctx->run);
+        for (int c = 0; ctx->perf && c < PERF_COUNTERS; c++) {
+            if (perf_available[c]) {
+                fprintf(ctx->out, ",\"%s_per_op\":%.2f", perf_counter_names[c],
+                        (double)(perf_after.values[c] - perf_before.values[c]) / done);
+            } else {
+                fprintf(ctx->out, ",\"%s_per_op\":null", perf_counter_names[c]);
+            }
+        }
+        fprintf(ctx->out, "}\n");
+    }
+    fflush(ctx->out);
+    bench_check_allocs(ctx, name, allocs_per_op);
+}
+
+// Read every result line of a previous --bench JSON output; repeated runs give several per (size, op)
+int bench_load_baseline(BenchContext *ctx, const char *filename) {
+    FILE *file = fopen(filename, "r");
+    if (file == NULL) {
+        fprintf(stderr, "Could not open benchmark baseline %s.\n", filename);
+        return 0;
+    }
+    ctx->baseline = (BenchResult*)lib_calloc(ALLOC_TOOLS, BENCH_MAX_RESULTS, sizeof(BenchResult));
+    if (ctx->baseline == NULL) {
+        fclose(file);
+        return 0;
+    }
+    char line[512];
+    while (fgets(line, sizeof(line), file) != NULL && ctx->baseline_count < BENCH_MAX_RESULTS) {
+        BenchResult *entry = &ctx->baseline[ctx->baseline_count];
+        const char *ns = strstr(line, "\"ns_per_op\":");
+        const char *allocs = strstr(line, "\"allocs_per_op\":");
+        if (ns != NULL && allocs != NULL &&
+            sscanf(line, "{\"size\":%ld,\"op\":\"%47[^\"]\"", &entry->size, entry->op) == 2 &&
+            sscanf(ns, "\"ns_per_op\":%lf", &entry->ns_per_op) == 1 &&
+            sscanf(allocs, "\"allocs_per_op\":%lf", &entry->allocs_per_op) == 1) {
+            ctx->baseline_count++;
+        }
+    }
+    fclose(file);
+    if (ctx->baseline_count == 0) {
+        fprintf(stderr, "No benchmark results found in %s.\n", filename);
+        return 0;
+    }
+    return 1;
+}
+
+// Flag an operation whose allocations per call grew past its baseline
+void bench_check_allocs(BenchContext *ctx, const char *name, double allocs_per_op) {
+    for (int i = 0; i < ctx->baseline_count; i++) {
+        BenchResult *entry = &ctx->baseline[i];
+        if (entry->size != ctx->size || strcmp(entry->op, name) != 0) {
+            continue;
+        }
+        ctx->alloc_checked++;
+        double limit = entry->allocs_per_op * (1.0 + ctx->alloc_tolerance) + BENCH_ALLOC_SLACK;
+        if (allocs_per_op > limit) {
+            fprintf(stderr, "ALLOC REGRESSION size=%ld op=%s: %.3f allocs/op, baseline %.3f\n",
+                    ctx->size, name, allocs_per_op, entry->allocs_per_op);
+            ctx->alloc_regressions++;
+        }
+        return;
+    }
+}
+
+// Mean and variance of ns_per_op over every result for one (size, op)
+void bench_samples(BenchResult *results, int count, long size, const char *op, BenchSamples *samples) {
+    double sum = 0.0, sum_squares = 0.0;
+    samples->n = 0;
+    for (int i = 0; i < count; i++) {
+        if (results[i].size == size && strcmp(results[i].op, op) == 0) {
+            sum += results[i].ns_per_op;
+            sum_squares += results[i].ns_per_op * results[i].ns_per_op;
+            samples->n++;
+        }
+    }
+    samples->mean = samples->n > 0 ? sum / samples->n : 0.0;
+    samples->variance = samples->n > 1 ? (sum_squares - sum * samples->mean) / (samples->n - 1) : 0.0;
+    if (samples->variance < 0.0) {
+        samples->variance = 0.0; // Rounding when every sample is equal
+    }
+}
+
+// Two-sided 95% Student t critical value; fractional degrees of freedom round down
+double bench_t_critical(double df) {
+    static const double table[30] = {
+        12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262, 2.228,
+        2.201, 2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093, 2.086,
+        2.080, 2.074, 2.069, 2.064, 2.060, 2.056, 2.052, 2.048, 2.045, 2.042
+    };
+    if (df < 1.0) {
+        return table[0];
+    }
+    if (df <= 30.0) {
+        return table[(int)df - 1];
+    }
+    return 1.960 + 2.372 / df; // Cornish-Fisher correction to the normal quantile
+}
+
+// Print a diff of this run against the baseline; returns how many operations slowed down.
+// An operation regresses only when the whole 95% confidence interval of its change (Welch's
+// t-test on the repeated runs) lies above the threshold, so run-to-run noise cannot fail the gate.
+int bench_compare(BenchContext *ctx, double threshold) {
+    int regressions = 0, improvements = 0, compared = 0;
+    fprintf(ctx->out, "%-8s  %-22s %12s %12s %8s  %-19s %9s  %s\n",
+            "size", "op", "base ns/op", "new ns/op", "change", "95% CI", "ops/s", "verdict");
+    for (int i = 0; i < ctx->result_count; i++) {
+        BenchResult *result = &ctx->results[i];
+        int seen = 0;
+        for (int j = 0; j < i && !seen; j++) {
+            seen = ctx->results[j].size == result->size && strcmp(ctx->results[j].op, result->op) == 0;
+        }
+        if (seen) {
+            continue; // Summarised at its first run
+        }
+
+        BenchSamples base, current;
+        bench_samples(ctx->baseline, ctx->baseline_count, result->size, result->op, &base);
+        bench_samples(ctx->results, ctx->result_count, result->size, result->op, &current);
+        if (base.n == 0 || base.mean <= 0.0) {
+            fprintf(ctx->out, "%-8ld  %-22s %12s %12.1f %8s  %-19s %9s  new\n",
+                    result->size, result->op, "-", current.mean, "", "", "");
+            continue;
+        }
+
+        double base_term = base.variance / base.n;
+        double current_term = current.variance / current.n;
+        double se = sqrt(base_term + current_term);
+        double df_denominator = (base.n > 1 ? base_term * base_term / (base.n - 1) : 0.0) +
+                                (current.n > 1 ? current_term * current_term / (current.n - 1) : 0.0);
+        double df = df_denominator > 0.0 ? (base_term + current_term) * (base_term + current_term) / df_denominator
+                                         : 1e9;
+        double margin = bench_t_critical(df) * se;
+        double delta = current.mean - base.mean;
+        double change = delta / base.mean;
+        double low = (delta - margin) / base.mean;
+        double high = (delta + margin) / base.mean;
+        double throughput = current.mean > 0.0 ? base.mean / current.mean - 1.0 : 0.0;
+
+        const char *verdict = "ok";
+        if (low > threshold) {
+            verdict = "REGRESSED";
+            regressions++;
+        } else if (high < -threshold) {
+            verdict = "improved";
+            improvements++;
+        } else if (change > threshold) {
+            verdict = "ok (noisy)"; // Slower on average, but not beyond the noise
+        }
+        compared++;
+
+        char interval[32];
+        snprintf(interval, sizeof(interval), "[%+.1f%%, %+.1f%%]", low * 100.0, high * 100.0);
+        fprintf(ctx->out, "%-8ld  %-22s %12.1f %12.1f %+7.1f%%  %-19s %+8.1f%%  %s\n",
+                result->size, result->op, base.mean, current.mean, change * 100.0, interval,
+                throughput * 100.0, verdict);
+    }
+    fprintf(ctx->out, "\n%d operations compared at a %.1f%% threshold: %d regressed, %d improved.\n",
+            compared, threshold * 100.0, regressions, improvements);
+    fflush(ctx->out);
+    return regressions;
+}
+
+// Operations under test; `i` counts iterations within one bench_run
+void bench_op_hash(BenchContext *ctx, long i) {
+    (void)i;
+    bench_sink += hash_function(ctx->books[bench_random(ctx) % ctx->size]->isbn);
+}
+
+void bench_op_isbn_hit(BenchContext *ctx, long i) {
+    (void)i;
+    bench_sink += (unsigned long)search_book_by_isbn(ctx->books[bench_random(ctx) % ctx->size]->isbn);
+}
+
+void bench_op_isbn_miss(BenchContext *ctx, long i) {
+    bench_sink += (unsigned long)search_book_by_isbn(ctx->miss_isbns[i % BENCH_MISS_KEYS]);
+}
+
+void bench_op_title_hit(BenchContext *ctx, long i) {
+    (void)i;
+    bench_sink += (unsigned long)search_by_title(title_bst_root, ctx->books[bench_random(ctx) % ctx->size]->title);
+}
+
+void bench_op_title_miss(BenchContext *ctx, long i) {
+    bench_sink += (unsigned long)search_by_title(title_bst_root, ctx->miss_titles[i % BENCH_MISS_KEYS]);
+}
+
+void bench_op_find_user_hit(BenchContext *ctx, long i) {
+    (void)i;
+    bench_sink += (unsigned long)find_user(ctx->user_ids[bench_random(ctx) % ctx->user_count]);
+}
+
+void bench_op_find_user_miss(BenchContext *ctx, long i) {
+    (void)ctx;
+    bench_sink += (unsigned long)find_user(-1 - (int)(i % 1000));
+}
+
+// Loan k goes to patron k % user_count, so nobody passes MAX_BORROWED within size loans
+void bench_op_issue(BenchContext *ctx, long i) {
+    EngineResult result;
+    bench_sink += issue_book(ctx->user_ids[i % ctx->user_count], ctx->books[i]->isbn, &result) == ENGINE_OK;
+    ctx->issued = i + 1;
+}
+
+void bench_op_return(BenchContext *ctx, long i) {
+    EngineResult result;
+    bench_sink += return_book(ctx->user_ids[i % ctx->user_count], ctx->books[i]->isbn, &result) == ENGINE_OK;
+}
+
+void bench_op_insert_book(BenchContext *ctx, long i) {
+    Book *book = (Book*)lib_calloc(ALLOC_CATALOG, 1, sizeof(Book));
+    if (book == NULL) {
+        return;
+    }
+    snprintf(book->isbn, MAX_ISBN_LENGTH, "977%010ld", i % 10000000000L);
+    snprintf(book->title, MAX_TITLE_LENGTH, "Added %016llx", (unsigned long long)bench_random(ctx));
+    strcpy(book->author, "Bench Author");
+    strcpy(book->genre, bench_genres[i % 8]);
+    book->free_copy = -1;
+    add_copies(book, 1);
+    EngineResult result;
+    insert_book(book, &result);
+    ctx->inserted = i + 1;
+}
+
+// BST inserts go into a scratch tree swapped in for title_bst_root
+void bench_op_bst_random(BenchContext *ctx, long i) {
+    insert_into_bst(ctx->books[i]);
+}
+
+void bench_op_bst_sorted(BenchContext *ctx, long i) {
+    insert_into_bst(ctx->sorted_books[i]);
+}
+
+void bench_op_report_all_books(BenchContext *ctx, long i) { (void)ctx; (void)i; list_all_books(); }
+void bench_op_report_available(BenchContext *ctx, long i) { (void)ctx; (void)i; list_available_books(); }
+void bench_op_report_borrowed(BenchContext *ctx, long i) { (void)ctx; (void)i; list_borrowed_books(); }
+void bench_op_report_most_borrowed(BenchContext *ctx, long i) { (void)ctx; (void)i; list_most_borrowed_books(); }
+void bench_op_report_active_users(BenchContext *ctx, long i) { (void)ctx; (void)i; list_active_users(); }
+void bench_op_report_overdue(BenchContext *ctx, long i) { (void)ctx; (void)i; list_overdue_loans(); }
+void bench_op_report_due_soon(BenchContext *ctx, long i) { (void)ctx; (void)i; list_loans_due_soon(); }
+void bench_op_report_trending(BenchContext *ctx, long i) { (void)ctx; (void)i; list_trending_books(7); }
+void bench_op_report_fines(BenchContext *ctx, long i) {
+    (void)ctx;
+    (void)i;
+    bench_sink += assess_overdue_fines(time(NULL));
+}
+
+void bench_op_report_monthly(BenchContext *ctx, long i) {
+    (void)ctx;
+    (void)i;
+    time_t now = time(NULL);
+    struct tm *tm_now = localtime(&now);
+    report_loans_by_month_and_genre(tm_now->tm_year + 1900, 1, tm_now->tm_year + 1900, tm_now->tm_mon + 1);
+}
+
+// Every operation for the catalog currently built
+void bench_run_suite(BenchContext *ctx) {
+    long size = ctx->size;
+    long issuable = ctx->user_count * MAX_BORROWED < size ? ctx->user_count * MAX_BORROWED : size;
+
+    bench_run(ctx, "hash_function", bench_op_hash, LONG_MAX, size);
+    bench_run(ctx, "search_isbn_hit", bench_op_isbn_hit, LONG_MAX, size);
+    bench_run(ctx, "search_isbn_miss", bench_op_isbn_miss, LONG_MAX, size);
+    bench_run(ctx, "search_title_hit", bench_op_title_hit, LONG_MAX, size);
+    bench_run(ctx, "search_title_miss", bench_op_title_miss, LONG_MAX, size);
+    bench_run(ctx, "find_user_hit", bench_op_find_user_hit, LONG_MAX, ctx->user_count);
+    bench_run(ctx, "find_user_miss", bench_op_find_user_miss, LONG_MAX, ctx->user_count);
+    bench_run(ctx, "issue_book", bench_op_issue, issuable, size);
+
+    // Reports run with the issued loans outstanding
+    bench_run(ctx, "report_all_books", bench_op_report_all_books, LONG_MAX, size);
+    bench_run(ctx, "report_available", bench_op_report_available, LONG_MAX, size);
+    bench_run(ctx, "report_borrowed", bench_op_report_borrowed, LONG_MAX, ctx->issued);
+    bench_run(ctx, "report_most_borrowed", bench_op_report_most_borrowed, LONG_MAX, size);
+    bench_run(ctx, "report_active_users", bench_op_report_active_users, LONG_MAX, ctx->user_count);
+    bench_run(ctx, "report_overdue", bench_op_report_overdue, LONG_MAX, ctx->issued);
+    bench_run(ctx, "report_due_soon", bench_op_report_due_soon, LONG_MAX, ctx->issued);
+    bench_run(ctx, "report_monthly_genre", bench_op_report_monthly, LONG_MAX, history_event_count);
+    bench_run(ctx, "report_trending", bench_op_report_trending, LONG_MAX, size);
+    bench_run(ctx, "assess_fines", bench_op_report_fines, LONG_MAX, ctx->issued);
+
+    bench_run(ctx, "return_book", bench_op_return, ctx->issued, size);
+    bench_run(ctx, "insert_book", bench_op_insert_book, size, size);
+
+    TreeNode *saved_root = title_bst_root;
+    title_bst_root = NULL;
+    bench_run(ctx, "bst_insert_random", bench_op_bst_random, size, size);
+    free_bst_nodes(title_bst_root);
+    title_bst_root = NULL;
+    long sorted_limit = size < BENCH_SORTED_BST_LIMIT ? size : BENCH_SORTED_BST_LIMIT;
+    bench_run(ctx, "bst_insert_sorted", bench_op_bst_sorted, sorted_limit, sorted_limit);
+    free_bst_nodes(title_bst_root);
+    title_bst_root = saved_root;
+}
+
+// The report operations print by design; send that to /dev/null and return a stream on the real stdout
+FILE* bench_redirect_output() {
+    int results_fd = dup(STDOUT_FILENO);
+    FILE *out = results_fd >= 0 ? fdopen(results_fd, "w") : NULL;
+    if (out == NULL || freopen("/dev/null", "w", stdout) == NULL) {
+        fprintf(stderr, "Could not redirect output for benchmarking.\n");
+        return NULL;
+    }
+    return out;
+}
+
+// Entry point for `library --bench [options]`; results go to stdout, engine output is discarded
+int run_benchmarks(int argc, char *argv[]) {
+    long sizes[BENCH_MAX_SIZES] = {1000, 100000, 1000000};
+    int size_count = 3;
+    BenchContext ctx;
+    memset(&ctx, 0, sizeof(ctx));
+    ctx.rng = 0x2545F4914F6CDD1DULL;
+    ctx.min_time_ns = (uint64_t)BENCH_DEFAULT_MIN_TIME_MS * 1000000ULL;
+    ctx.alloc_tolerance = 0.05;
+    const char *baseline_file = NULL;
+    double threshold = BENCH_DEFAULT_THRESHOLD_PCT / 100.0;
+    int runs = 0;
+
+    for (int i = 0; i < argc; i++) {
+        const char *value = i + 1 < argc ? argv[i + 1] : NULL;
+        if (strcmp(argv[i], "--sizes") == 0 && value != NULL) {
+            size_count = bench_parse_sizes(value, sizes, BENCH_MAX_SIZES);
+            i++;
+        } else if (strcmp(argv[i], "--format") == 0 && value != NULL) {
+            ctx.csv = strcmp(value, "csv") == 0;
+            i++;
+        } else if (strcmp(argv[i], "--min-time-ms") == 0 && value != NULL) {
+            ctx.min_time_ns = (uint64_t)atol(value) * 1000000ULL;
+            i++;
+        } else if (strcmp(argv[i], "--ops") == 0 && value != NULL) {
+            ctx.only_ops = value;
+            i++;
+        } else if (strcmp(argv[i], "--alloc-baseline") == 0 && value != NULL) {
+            baseline_file = value;
+            i++;
+        } else if (strcmp(argv[i], "--alloc-tolerance") == 0 && value != NULL) {
+            ctx.alloc_tolerance = atof(value) / 100.0;
+            i++;
+        } else if (strcmp(argv[i], "--compare") == 0 && value != NULL) {
+            baseline_file = value;
+            ctx.compare = 1;
+            i++;
+        } else if (strcmp(argv[i], "--threshold") == 0 && value != NULL) {
+            threshold = atof(value) / 100.0;
+            i++;
+        } else if (strcmp(argv[i], "--repeat") == 0 && value != NULL) {
+            runs = atoi(value);
+            i++;
+        } else if (strcmp(argv[i], "--perf") == 0) {
+            ctx.perf = 1;
+        } else {
+            size_count = 0;
+            break;
+        }
+    }
+    if (size_count == 0) {
+        fprintf(stderr, "Usage: library --bench [--sizes N,N,...] [--format json|csv] "
+                "[--min-time-ms N] [--ops name,name,...] [--repeat N] [--alloc-baseline FILE] "
+                "[--alloc-tolerance PCT] [--compare FILE] [--threshold PCT] [--perf]\n");
+        return 1;
+    }
+    if (runs <= 0) {
+        runs = ctx.compare ? BENCH_DEFAULT_COMPARE_RUNS : 1;
+    }
+    if (ctx.perf) {
+        ctx.perf = perf_start(); // Whole batches are measured, so per-call regions stay off
+    }
+    if (baseline_file != NULL && !bench_load_baseline(&ctx, baseline_file)) {
+        return 1;
+    }
+    if (ctx.compare) {
+        ctx.results = (BenchResult*)lib_calloc(ALLOC_TOOLS, BENCH_MAX_RESULTS, sizeof(BenchResult));
+        if (ctx.results == NULL) {
+            return 1;
+        }
+    }
+
+    ctx.out = bench_redirect_output();
+    if (ctx.out == NULL) {
+        return 1;
+    }
+    ctx.miss_isbns = lib_malloc(ALLOC_TOOLS, BENCH_MISS_KEYS * sizeof(*ctx.miss_isbns));
+    ctx.miss_titles = lib_malloc(ALLOC_TOOLS, BENCH_MISS_KEYS * sizeof(*ctx.miss_titles));
+    if (ctx.miss_isbns == NULL || ctx.miss_titles == NULL) {
+        return 1;
+    }
+
+    if (ctx.csv && !ctx.compare) {
+        fprintf(ctx.out, "size,op,n,iterations,ns_per_op,ops_per_sec,allocs_per_op,bytes_per_op,run");
+        for (int c = 0; ctx.perf && c < PERF_COUNTERS; c++) {
+            fprintf(ctx.out, ",%s_per_op", perf_counter_names[c]);
+        }
+        fprintf(ctx.out, "\n");
+    }
+
+    // Whole-suite repetitions interleave sizes, so slow drift on the machine spreads over all of them
+    int status = 0;
+    for (ctx.run = 0; ctx.run < runs; ctx.run++) {
+        for (int s = 0; s < size_count; s++) {
+            if (!bench_build_catalog(&ctx, sizes[s])) {
+                fprintf(stderr, "Could not build a catalog of %ld titles.\n", sizes[s]);
+                status = 1;
+            } else {
+                bench_run_suite(&ctx);
+            }
+            bench_reset_engine(&ctx);
+        }
+    }
+
+    if (ctx.compare && bench_compare(&ctx, threshold) > 0) {
+        status = 1;
+    }
+
+    if (ctx.baseline != NULL) {
+        fprintf(stderr, "Allocation check: %d operations compared, %d regressed.\n",
+                ctx.alloc_checked, ctx.alloc_regressions);
+        if (ctx.alloc_regressions > 0) {
+            status = 1;
+        }
+    }
+
+    lib_free(ctx.miss_isbns);
+    lib_free(ctx.miss_titles);
+    lib_free(ctx.baseline);
+    lib_free(ctx.results);
+    lib_free(active_due_times);
+    lib_free(active_daily_rates);
+    lib_free(active_user_ids);
+    lib_free(active_loans);
+    fclose(ctx.out);
+    return status;
+}
+
+
+// --- Workload Functions ---
+
+const char *workload_op_names[WORKLOAD_OP_TYPES] = {
+    "search_isbn", "search_title", "search_author", "issue", "return", "add", "remove"
+};
+const char *workload_mix_keys[WORKLOAD_OP_TYPES] = {
+    "isbn", "title", "author", "issue", "return", "add", "remove"
+};
+
+// Parse "isbn=500,title=300,..."; operations left out get weight 0
+int workload_parse_mix(const char *text, int *weights) {
+    memset(weights, 0, WORKLOAD_OP_TYPES * sizeof(int));
+    while (*text != '\0') {
+        const char *equals = strchr(text, '=');
+        if (equals == NULL) {
+            return 0;
+        }
+        int type = -1;
+        for (int t = 0; t < WORKLOAD_OP_TYPES; t++) {
+            size_t length = strlen(workload_mix_keys[t]);
+            if ((size_t)(equals - text) == length && strncmp(text, workload_mix_keys[t], length) == 0) {
+                type = t;
+            }
+        }
+        char *end;
+        long weight = strtol(equals + 1, &end, 10);
+        if (type < 0 || end == equals + 1 || weight < 0 || (*end != ',' && *end != '\0')) {
+            return 0;
+        }
+        weights[type] = (int)weight;
+        text = *end == ',' ? end + 1 : end;
+    }
+    return 1;
+}
+
+// Cumulative Zipf weights 1/rank^skew over the catalog, normalised to 1
+int workload_zipf_setup(Workload *workload, long size, double skew) {
+    workload->zipf_cdf = (double*)lib_malloc(ALLOC_TOOLS, size * sizeof(double));
+    if (workload->zipf_cdf == NULL) {
+        return 0;
+    }
+    double total = 0.0;
+    for (long rank = 0; rank < size; rank++) {
+        total += 1.0 / pow((double)(rank + 1), skew);
+        workload->zipf_cdf[rank] = total;
+    }
+    for (long rank = 0; rank < size; rank++) {
+        workload->zipf_cdf[rank] /= total;
+    }
+    workload->rank_count = size;
+    return 1;
+}
+
+// Draw a popularity rank (0 = most popular) by binary search over the CDF
+long workload_zipf_rank(Workload *workload, BenchContext *ctx) {
+    double u = (double)(bench_random(ctx) >> 11) / 9007199254740992.0; // [0, 1)
+    long low = 0;
+    long high = workload->rank_count - 1;
+    while (low < high) {
+        long mid = low + (high - low) / 2;
+        if (workload->zipf_cdf[mid] < u) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    return low;
+}
+
+void workload_record(WorkloadOpStats *stats, uint64_t ns, int ok) {
+    if (stats->count == stats->capacity) {
+        long new_capacity = stats->capacity > 0 ? stats->capacity * 2 : 4096;
+        uint32_t *grown = (uint32_t*)lib_realloc(ALLOC_TOOLS, stats->samples, new_capacity * sizeof(uint32_t));
+        if (grown == NULL) {
+            return;
+        }
+        stats->samples = grown;
+        stats->capacity = new_capacity;
+    }
+    stats->samples[stats->count++] = ns > UINT32_MAX ? UINT32_MAX : (uint32_t)ns;
+    stats->total_ns += ns;
+    stats->ok += ok != 0;
+}
+
+int workload_compare_u32(const void *a, const void *b) {
+    uint32_t x = *(const uint32_t*)a;
+    uint32_t y = *(const uint32_t*)b;
+    return (x > y) - (x < y);
+}
+
+// One line per operation type plus an "all" line for the whole run
+void workload_report(Workload *workload, BenchContext *ctx, uint64_t elapsed_ns) {
+    long total = 0;
+    for (int t = 0; t < WORKLOAD_OP_TYPES; t++) {
+        total += workload->stats[t].count;
+    }
+    if (ctx->csv) {
+        fprintf(ctx->out, "size,op,count,ok,ops_per_sec,mean_ns,p50_ns,p99_ns,p999_ns,max_ns\n");
+    }
+
+    for (int t = 0; t < WORKLOAD_OP_TYPES; t++) {
+        WorkloadOpStats *stats = &workload->stats[t];
+        if (stats->count == 0) {
+            continue;
+        }
+        qsort(stats->samples, stats->count, sizeof(uint32_t), workload_compare_u32);
+        uint32_t p50 = stats->samples[(long)(stats->count * 0.50)];
+        uint32_t p99 = stats->samples[(long)(stats->count * 0.99)];
+        uint32_t p999 = stats->samples[(long)(stats->count * 0.999)];
+        uint32_t max = stats->samples[stats->count - 1];
+        double ops_per_sec = stats->count * 1e9 / elapsed_ns;
+        double mean = (double)stats->total_ns / stats->count;
+        if (ctx->csv) {
+            fprintf(ctx->out, "%ld,%s,%ld,%ld,%.0f,%.0f,%u,%u,%u,%u\n", ctx->size, workload_op_names[t],
+                    stats->count, stats->ok, ops_per_sec, mean, p50, p99, p999, max);
+        } else {
+            fprintf(ctx->out, "{\"size\":%ld,\"op\":\"%s\",\"count\":%ld,\"ok\":%ld,\"ops_per_sec\":%.0f,"
+                    "\"mean_ns\":%.0f,\"p50_ns\":%u,\"p99_ns\":%u,\"p999_ns\":%u,\"max_ns\":%u}\n",
+                    ctx->size, workload_op_names[t], stats->count, stats->ok, ops_per_sec, mean, p50, p99, p999, max);
+        }
+    }
+
+    double ops_per_sec = total * 1e9 / elapsed_ns;
+    if (ctx->csv) {
+        fprintf(ctx->out, "%ld,all,%ld,,%.0f,,,,,\n", ctx->size, total, ops_per_sec);
+    } else {
+        fprintf(ctx->out, "{\"size\":%ld,\"op\":\"all\",\"count\":%ld,\"ops_per_sec\":%.0f,\"elapsed_ms\":%.0f}\n",
+                ctx->size, total, ops_per_sec, elapsed_ns / 1e6);
+    }
+}
+
+// Entry point for `library --workload [options]`: a timed, Zipf-skewed mix against the engine
+int run_workload(int argc, char *argv[]) {
+    BenchContext ctx;
+    Workload workload;
+    memset(&ctx, 0, sizeof(ctx));
+    memset(&workload, 0, sizeof(workload));
+    ctx.rng = 0x9E3779B97F4A7C15ULL;
+    long size = WORKLOAD_DEFAULT_SIZE;
+    long duration_ms = WORKLOAD_DEFAULT_DURATION_MS;
+    long max_ops = LONG_MAX;
+    double skew = WORKLOAD_DEFAULT_SKEW;
+    int valid = workload_parse_mix(WORKLOAD_DEFAULT_MIX, workload.weights);
+
+    for (int i = 0; i < argc && valid; i++) {
+        const char *value = i + 1 < argc ? argv[i + 1] : NULL;
+        if (value == NULL) {
+            valid = 0;
+        } else if (strcmp(argv[i], "--size") == 0) {
+            size = atol(value);
+        } else if (strcmp(argv[i], "--duration-ms") == 0) {
+            duration_ms = atol(value);
+        } else if (strcmp(argv[i], "--max-ops") == 0) {
+            max_ops = atol(value);
+        } else if (strcmp(argv[i], "--mix") == 0) {
+            valid = workload_parse_mix(value, workload.weights);
+        } else if (strcmp(argv[i], "--zipf") == 0) {
+            skew = atof(value);
+        } else if (strcmp(argv[i], "--seed") == 0) {
+            ctx.rng = strtoull(value, NULL, 10) | 1; // xorshift needs a non-zero state
+        } else if (strcmp(argv[i], "--format") == 0) {
+            ctx.csv = strcmp(value, "csv") == 0;
+        } else {
+            valid = 0;
+        }
+        i++;
+    }
+    for (int t = 0; t < WORKLOAD_OP_TYPES; t++) {
+        workload.weight_total += workload.weights[t];
+    }
+    if (!valid || size <= 0 || duration_ms <= 0 || max_ops <= 0 || skew < 0.0 || workload.weight_total == 0) {
+        fprintf(stderr, "Usage: library --workload [--size N] [--duration-ms N] [--max-ops N] [--zipf S] [--seed N]\n"
+                "                         [--mix isbn=W,title=W,author=W,issue=W,return=W,add=W,remove=W] [--format json|csv]\n");
+        return 1;
+    }
+
+    ctx.out = bench_redirect_output();
+    if (ctx.out == NULL) {
+        return 1;
+    }
+    ctx.miss_isbns = lib_malloc(ALLOC_TOOLS, BENCH_MISS_KEYS * sizeof(*ctx.miss_isbns));
+    ctx.miss_titles = lib_malloc(ALLOC_TOOLS, BENCH_MISS_KEYS * sizeof(*ctx.miss_titles));
+    workload.by_rank = (Book**)lib_malloc(ALLOC_TOOLS, size * sizeof(Book*));
+    if (ctx.miss_isbns == NULL || ctx.miss_titles == NULL || workload.by_rank == NULL ||
+        !bench_build_catalog(&ctx, size) || !workload_zipf_setup(&workload, size, skew)) {
+        fprintf(stderr, "Could not build a catalog of %ld titles.\n", size);
+        return 1;
+    }
+
+    // Shuffle so the most popular titles are scattered through the catalog
+    memcpy(workload.by_rank, ctx.books, size * sizeof(Book*));
+    for (long i = size - 1; i > 0; i--) {
+        long j = (long)(bench_random(&ctx) % (uint64_t)(i + 1));
+        Book *swap = workload.by_rank[i];
+        workload.by_rank[i] = workload.by_rank[j];
+        workload.by_rank[j] = swap;
+    }
+
+    uint64_t deadline = monotonic_ns() + (uint64_t)duration_ms * 1000000ULL;
+    uint64_t start = monotonic_ns();
+    uint64_t now = start;
+    for (long n = 0; n < max_ops && now < deadline; n++) {
+        // Pick the operation and its arguments before the clock starts
+        int pick = (int)(bench_random(&ctx) % (uint64_t)workload.weight_total);
+        int type = 0;
+        while (pick >= workload.weights[type]) {
+            pick -= workload.weights[type++];
+        }
+        Book *book = workload.by_rank[workload_zipf_rank(&workload, &ctx)];
+        int user_id = ctx.user_ids[bench_random(&ctx) % (uint64_t)ctx.user_count];
+        Loan *loan = active_loan_count > 0 ? active_loans[bench_random(&ctx) % (uint64_t)active_loan_count] : NULL;
+        char isbn[MAX_ISBN_LENGTH];
+        if (type == WORKLOAD_RETURN && loan != NULL) {
+            user_id = loan->user->id;
+            strcpy(isbn, loan->isbn);
+        } else if (type == WORKLOAD_REMOVE && workload.added_count > 0) {
+            strcpy(isbn, workload.added[workload.added_count - 1]);
+        } else if (type == WORKLOAD_ADD) {
+            snprintf(isbn, sizeof(isbn), "976%010ld", workload.next_added++ % 10000000000L);
+        } else {
+            strcpy(isbn, book->isbn);
+        }
+        if (type == WORKLOAD_ADD && workload.added_count == workload.added_capacity) {
+            long new_capacity = workload.added_capacity > 0 ? workload.added_capacity * 2 : 256;
+            void *grown = lib_realloc(ALLOC_TOOLS, workload.added, new_capacity * sizeof(*workload.added));
+            if (grown == NULL) {
+                break;
+            }
+            workload.added = grown;
+            workload.added_capacity = new_capacity;
+        }
+
+        EngineResult result;
+        uint64_t op_start = monotonic_ns();
+        int ok = 0;
+        switch (type) {
+            case WORKLOAD_SEARCH_ISBN:
+                ok = search_book_by_isbn(isbn) != NULL;
+                break;
+            case WORKLOAD_SEARCH_TITLE:
+                ok = search_by_title(title_bst_root, book->title) != NULL;
+                break;
+            case WORKLOAD_SEARCH_AUTHOR:
+                ok = list_books_by_author(book->author) > 0;
+                break;
+            case WORKLOAD_ISSUE:
+                ok = issue_book(user_id, isbn, &result) == ENGINE_OK;
+                break;
+            case WORKLOAD_RETURN:
+                ok = loan != NULL && return_book(user_id, isbn, &result) == ENGINE_OK;
+                break;
+            case WORKLOAD_ADD: {
+                Book *added = (Book*)lib_calloc(ALLOC_CATALOG, 1, sizeof(Book));
+                if (added != NULL) {
+                    strcpy(added->isbn, isbn);
+                    snprintf(added->title, MAX_TITLE_LENGTH, "Added %s", isbn);
+                    strcpy(added->author, book->author);
+                    strcpy(added->genre, book->genre);
+                    added->free_copy = -1;
+                    add_copies(added, 1);
+                    ok = insert_book(added, &result) == ENGINE_OK;
+                }
+                break;
+            }
+            case WORKLOAD_REMOVE:
+                if (workload.added_count > 0) {
+                    ok = remove_book(isbn, &result) == ENGINE_OK;
+                }
+                break;
+        }
+        now = monotonic_ns();
+        workload_record(&workload.stats[type], now - op_start, ok);
+
+        if (type == WORKLOAD_ADD && ok) {
+            strcpy(workload.added[workload.added_count++], isbn);
+        } else if (type == WORKLOAD_REMOVE && ok) {
+            workload.added_count--;
+        }
+    }
+
+    workload_report(&workload, &ctx, now - start);
+
+    for (int t = 0; t < WORKLOAD_OP_TYPES; t++) {
+        lib_free(workload.stats[t].samples);
+    }
+    lib_free(workload.zipf_cdf);
+    lib_free(workload.by_rank);
+    lib_free(workload.added);
+    bench_reset_engine(&ctx);
+    lib_free(ctx.miss_isbns);
+    lib_free(ctx.miss_titles);
+    lib_free(active_due_times);
+    lib_free(active_daily_rates);
+    lib_free(active_user_ids);
+    lib_free(active_loans);
+    fclose(ctx.out);
+    return 0;
+}
+
+
+// --- Capture and Replay Functions ---
+
+// Queue a string argument beyond the text argument for the next engine_op_begin
+void engine_op_extra(const char *text) {
+    if (capture_file != NULL && op_extra_count < CAPTURE_MAX_STRINGS - 1) {
+        op_extra_args[op_extra_count++] = text;
+    }
+}
+
+// Snapshot files sit next to the capture: FILE.books.dat, FILE.users.dat, ...
+void capture_snapshot_name(const char *capture, const char *kind, char *out, size_t size) {
+    snprintf(out, size, "%s.%s.dat", capture, kind);
+}
+
+// Start recording: header, then a snapshot of the current state for replay to start from
+int capture_start(const char *filename) {
+    capture_file = fopen(filename, "wb");
+    if (capture_file == NULL) {
+        perror("Error opening capture file");
+        return 0;
+    }
+    int64_t start_wall = (int64_t)time(NULL);
+    fwrite(CAPTURE_MAGIC, 1, 8, capture_file);
+    fwrite(&start_wall, sizeof(start_wall), 1, capture_file);
+
+    char name[512];
+    capture_snapshot_name(filename, "books", name, sizeof(name));
+    save_books_to_file(name);
+    capture_snapshot_name(filename, "users", name, sizeof(name));
+    save_users_to_file(name);
+    capture_snapshot_name(filename, "holds", name, sizeof(name));
+    save_holds_to_file(name);
+    capture_snapshot_name(filename, "history", name, sizeof(name));
+    FILE *history = fopen(name, "wb"); // The whole log, not just what history.dat still lacks
+    if (history == NULL) {
+        perror("Error opening capture history snapshot");
+    } else {
+        if (!write_history(history, 1)) {
+            printf("Memory allocation failed for the capture history snapshot.\n");
+        }
+        fclose(history);
+    }
+
+    capture_start_ns = monotonic_ns();
+    capture_count = 0;
+    return 1;
+}
+
+void capture_write_string(const char *text) {
+    size_t length = strlen(text);
+    uint8_t stored = (uint8_t)(length < CAPTURE_STRING_LENGTH ? length : CAPTURE_STRING_LENGTH);
+    fwrite(&stored, 1, 1, capture_file);
+    fwrite(text, 1, stored, capture_file);
+}
+
+// Record: offset_ns (8), number (4), op (1), string count (1), then each string as length (1) + bytes
+void capture_record(int op, const char *text, long number) {
+    uint64_t offset_ns = monotonic_ns() - capture_start_ns;
+    int32_t stored_number = (int32_t)number;
+    uint8_t stored_op = (uint8_t)op;
+    uint8_t string_count = (uint8_t)(text != NULL ? 1 + op_extra_count : 0);
+    fwrite(&offset_ns, sizeof(offset_ns), 1, capture_file);
+    fwrite(&stored_number, sizeof(stored_number), 1, capture_file);
+    fwrite(&stored_op, 1, 1, capture_file);
+    fwrite(&string_count, 1, 1, capture_file);
+    if (text != NULL) {
+        capture_write_string(text);
+        for (int i = 0; i < op_extra_count; i++) {
+            capture_write_string(op_extra_args[i]);
+        }
+    }
+    capture_count++;
+}
+
+void capture_stop() {
+    if (capture_file == NULL) {
+        return;
+    }
+    fclose(capture_file);
+    capture_file = NULL;
+    printf("Captured %ld operations.\n", capture_count);
+}
+
+// Read the next record; 0 at end of file or on a truncated record
+int capture_read_record(FILE *file, CaptureRecord *record) {
+    uint8_t string_count;
+    if (fread(&record->offset_ns, sizeof(record->offset_ns), 1, file) != 1 ||
+        fread(&record->number, sizeof(record->number), 1, file) != 1 ||
+        fread(&record->op, 1, 1, file) != 1 || fread(&string_count, 1, 1, file) != 1 ||
+        record->op >= LATENCY_OPS || string_count > CAPTURE_MAX_STRINGS) {
+        return 0;
+    }
+    record->string_count = string_count;
+    for (int i = 0; i < string_count; i++) {
+        uint8_t length;
+        if (fread(&length, 1, 1, file) != 1 || fread(record->strings[i], 1, length, file) != length) {
+            return 0;
+        }
+        record->strings[i][length] = '\0';
+    }
+    for (int i = string_count; i < CAPTURE_MAX_STRINGS; i++) {
+        record->strings[i][0] = '\0';
+    }
+
+    // The menu never accepts an ISBN this long, so the capture is damaged
+    int isbn_strings = 1;
+    if (record->op == LATENCY_KIOSK_CHECKOUT || record->op == LATENCY_KIOSK_RETURN) {
+        isbn_strings = string_count;
+    } else if (record->op == LATENCY_ADD_USER || record->op == LATENCY_REMOVE_USER ||
+               record->op == LATENCY_SEARCH_TITLE || record->op == LATENCY_SEARCH_AUTHOR) {
+        isbn_strings = 0;
+    }
+    for (int i = 0; i < isbn_strings; i++) {
+        if (strlen(record->strings[i]) >= MAX_ISBN_LENGTH) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+// Re-run one captured operation, bracketed exactly as the menu brackets it
+void replay_execute(CaptureRecord *record) {
+    int op = record->op;
+    int number = record->number;
+    char *text = record->strings[0];
+    EngineResult result;
+    uint64_t started;
+
+    switch (op) {
+        case LATENCY_ADD_BOOK: {
+            Book *book = (Book*)lib_calloc(ALLOC_CATALOG, 1, sizeof(Book));
+            if (book == NULL) {
+                return;
+            }
+            snprintf(book->isbn, MAX_ISBN_LENGTH, "%.*s", MAX_ISBN_LENGTH - 1, text);
+            snprintf(book->title, MAX_TITLE_LENGTH, "%.*s", MAX_TITLE_LENGTH - 1, record->strings[1]);
+            snprintf(book->author, MAX_AUTHOR_LENGTH, "%.*s", MAX_AUTHOR_LENGTH - 1, record->strings[2]);
+            snprintf(book->genre, MAX_GENRE_LENGTH, "%.*s", MAX_GENRE_LENGTH - 1, record->strings[3]);
+            book->free_copy = -1;
+            int copies = number > 0 ? number : 1;
+            if (add_copies(book, copies) != copies) {
+                lib_free(book->copies);
+                lib_free(book);
+                return;
+            }
+            started = engine_op_begin(op, text, number);
+            insert_book(book, &result);
+            break;
+        }
+        case LATENCY_REMOVE_BOOK:
+            started = engine_op_begin(op, text, number);
+            remove_book(text, &result);
+            break;
+        case LATENCY_ADD_COPIES:
+            started = engine_op_begin(op, text, number);
+            add_book_copies(text, number, &result);
+            break;
+        case LATENCY_ADD_USER:
+            started = engine_op_begin(op, text, number);
+            add_user(text, &result);
+            break;
+        case LATENCY_REMOVE_USER:
+            started = engine_op_begin(op, NULL, number);
+            remove_user(number, &result);
+            break;
+        case LATENCY_ISSUE:
+            started = engine_op_begin(op, text, number);
+            issue_book(number, text, &result);
+            break;
+        case LATENCY_RETURN:
+            started = engine_op_begin(op, text, number);
+            return_book(number, text, &result);
+            break;
+        case LATENCY_PLACE_HOLD:
+            started = engine_op_begin(op, text, number);
+            place_hold(number, text, &result);
+            break;
+        case LATENCY_CANCEL_HOLD:
+            started = engine_op_begin(op, text, number);
+            cancel_hold(number, text, &result);
+            break;
+        case LATENCY_KIOSK_CHECKOUT:
+        case LATENCY_KIOSK_RETURN: {
+            char isbns[MAX_BATCH_ITEMS][MAX_ISBN_LENGTH];
+            int count = record->string_count < MAX_BATCH_ITEMS ? record->string_count : MAX_BATCH_ITEMS;
+            for (int i = 0; i < count; i++) {
+                snprintf(isbns[i], MAX_ISBN_LENGTH, "%.*s", MAX_ISBN_LENGTH - 1, record->strings[i]);
+            }
+            started = engine_op_begin(op, count > 0 ? isbns[0] : NULL, number);
+            if (op == LATENCY_KIOSK_CHECKOUT) {
+                issue_books_batch(number, isbns, count, &result);
+            } else {
+                return_books_batch(number, isbns, count, &result);
+            }
+            break;
+        }
+        case LATENCY_SEARCH_ISBN:
+            started = engine_op_begin(op, text, number);
+            bench_sink += (unsigned long)search_book_by_isbn(text);
+            break;
+        case LATENCY_SEARCH_TITLE:
+            started = engine_op_begin(op, text, number);
+            bench_sink += (unsigned long)search_by_title(title_bst_root, text);
+            break;
+        case LATENCY_SEARCH_AUTHOR:
+            started = engine_op_begin(op, text, number);
+            list_books_by_author(text);
+            break;
+        default:
+            return;
+    }
+    engine_op_end(op, started);
+}
+
+// --replay FILE [--speed recorded|max] [--format text|json]: load the capture's snapshot,
+// re-run every operation and report latency and throughput
+int run_replay(int argc, char *argv[]) {
+    const char *filename = argc > 0 ? argv[0] : NULL;
+    int recorded_speed = 0;
+    int json = 0;
+    for (int i = 1; i < argc; i++) {
+        const char *value = i + 1 < argc ? argv[i + 1] : NULL;
+        if (strcmp(argv[i], "--speed") == 0 && value != NULL) {
+            recorded_speed = strcmp(value, "recorded") == 0;
+            i++;
+        } else if (strcmp(argv[i], "--format") == 0 && value != NULL) {
+            json = strcmp(value, "json") == 0;
+            i++;
+        } else {
+            filename = NULL;
+            break;
+        }
+    }
+    if (filename == NULL) {
+        fprintf(stderr, "Usage: library --replay FILE [--speed recorded|max] [--format text|json]\n");
+        return 1;
+    }
+
+    FILE *file = fopen(filename, "rb");
+    char magic[8];
+    int64_t start_wall = 0;
+    if (file == NULL || fread(magic, 1, 8, file) != 8 || memcmp(magic, CAPTURE_MAGIC, 8) != 0 ||
+        fread(&start_wall, sizeof(start_wall), 1, file) != 1) {
+        fprintf(stderr, "%s is not a capture file.\n", filename);
+        if (file != NULL) {
+            fclose(file);
+        }
+        return 1;
+    }
+    FILE *out = bench_redirect_output();
+    if (out == NULL) {
+        fclose(file);
+        return 1;
+    }
+
+    // Start from the state the capture began with
+    char name[512];
+    capture_snapshot_name(filename, "books", name, sizeof(name));
+    if (access(name, R_OK) != 0) {
+        fprintf(stderr, "Snapshot %s is missing; replaying against an empty catalog.\n", name);
+    }
+    load_books_from_file(name);
+    capture_snapshot_name(filename, "users", name, sizeof(name));
+    load_users_from_file(name);
+    capture_snapshot_name(filename, "holds", name, sizeof(name));
+    load_holds_from_file(name);
+    capture_snapshot_name(filename, "history", name, sizeof(name));
+    load_history_from_file(name);
+    rebuild_trending_from_history();
+    rebuild_reading_histories();
+    rebuild_cooccurrence();
+
+    CaptureRecord *record = (CaptureRecord*)lib_malloc(ALLOC_TOOLS, sizeof(CaptureRecord));
+    if (record == NULL) {
+        fclose(file);
+        fclose(out);
+        return 1;
+    }
+    long replayed = 0;
+    uint64_t max_lag_ns = 0; // How far behind the recorded schedule replay fell
+    uint64_t start = monotonic_ns();
+    while (capture_read_record(file, record)) {
+        if (recorded_speed) {
+            uint64_t target = start + record->offset_ns;
+            uint64_t now = monotonic_ns();
+            if (now < target) {
+                struct timespec pause = {(time_t)((target - now) / 1000000000ULL),
+                                         (long)((target - now) % 1000000000ULL)};
+                nanosleep(&pause, NULL);
+            } else if (now - target > max_lag_ns) {
+                max_lag_ns = now - target;
+            }
+        }
+        engine_clock_pin = (time_t)(start_wall + (int64_t)(record->offset_ns / 1000000000ULL));
+        replay_execute(record);
+        replayed++;
+    }
+    uint64_t elapsed = monotonic_ns() - start;
+    engine_clock_pin = 0;
+    if (!feof(file)) {
+        fprintf(stderr, "Capture is truncated or damaged after %ld operations.\n", replayed);
+    }
+    fclose(file);
+
+    double seconds = elapsed / 1e9;
+    double throughput = seconds > 0.0 ? replayed / seconds : 0.0;
+    LatencySummary summary;
+    if (json) {
+        fprintf(out, "{\"capture\":\"%s\",\"speed\":\"%s\",\"operations\":%ld,\"elapsed_s\":%.6f,"
+                "\"ops_per_sec\":%.0f,\"max_lag_ms\":%.3f}\n", filename, recorded_speed ? "recorded" : "max",
+                replayed, seconds, throughput, max_lag_ns / 1e6);
+    } else {
+        fprintf(out, "Replayed %ld operations from %s in %.3f s (%s speed): %.0f ops/s",
+                replayed, filename, seconds, recorded_speed ? "recorded" : "max", throughput);
+        if (recorded_speed) {
+            fprintf(out, ", fell behind by up to %.3f ms", max_lag_ns / 1e6);
+        }
+        fprintf(out, "\n\n%-15s | %8s | %9s | %9s | %9s | %9s | %9s\n",
+                "Operation", "Count", "Mean us", "p50 us", "p99 us", "p99.9 us", "Max us");
+        fprintf(out, "-------------------------------------------------------------------------------------\n");
+    }
+    for (int op = 0; op < LATENCY_OPS; op++) {
+        latency_merge(op, &summary);
+        if (summary.count == 0) {
+            continue;
+        }
+        if (json) {
+            fprintf(out, "{\"op\":\"%s\",\"count\":%llu,\"mean_ns\":%.0f,\"p50_ns\":%llu,\"p99_ns\":%llu,"
+                    "\"p999_ns\":%llu,\"max_ns\":%llu}\n", latency_op_names[op], (unsigned long long)summary.count,
+                    (double)summary.total_ns / summary.count,
+                    (unsigned long long)latency_percentile(&summary, 0.50),
+                    (unsigned long long)latency_percentile(&summary, 0.99),
+                    (unsigned long long)latency_percentile(&summary, 0.999), (unsigned long long)summary.max_ns);
+        } else {
+            fprintf(out, "%-15s | %8llu | %9.2f | %9.2f | %9.2f | %9.2f | %9.2f\n", latency_op_names[op],
+                    (unsigned long long)summary.count, summary.total_ns / 1e3 / summary.count,
+                    latency_percentile(&summary, 0.50) / 1e3, latency_percentile(&summary, 0.99) / 1e3,
+                    latency_percentile(&summary, 0.999) / 1e3, summary.max_ns / 1e3);
+        }
+    }
+
+    lib_free(record);
+    free_all_books();
+    free_all_users();
+    free_history();
+    free_latency_recorders();
+    fclose(out);
+    return 0;
+}
+
+
+// --- Bulk Import Functions ---
+
+// Validate an ISBN-10 or ISBN-13 (hyphens and spaces allowed) and write it as 13 digits; 0 if invalid
+int isbn_normalize(const char *raw, char *out) {
+    char digits[13];
+    int n = 0;
+    for (const char *c = raw; *c != '\0'; c++) {
+        if (*c == '-' || *c == ' ') {
+            continue;
+        }
+        if (n == 13) {
+            return 0;
+        }
+        if (*c >= '0' && *c <= '9') {
+            digits[n++] = *c;
+        } else if ((*c == 'X' || *c == 'x') && n == 9) {
+            digits[n++] = 'X'; // ISBN-10 check digit for 10
+        } else {
+            return 0;
+        }
+    }
+
+    if (n == 10) {
+        int sum = 0;
+        for (int i = 0; i < 10; i++) {
+            sum += (10 - i) * (digits[i] == 'X' ? 10 : digits[i] - '0');
+        }
+        if (sum % 11 != 0) {
+            return 0;
+        }
+        memcpy(out, "978", 3);
+        memcpy(out + 3, digits, 9);
+    } else if (n == 13 && digits[9] != 'X' &&
+               (memcmp(digits, "978", 3) == 0 || memcmp(digits, "979", 3) == 0)) {
+        memcpy(out, digits, 12);
+    } else {
+        return 0;
+    }
+
+    // ISBN-13 check digit: weights alternate 1 and 3
+    int sum = 0;
+    for (int i = 0; i < 12; i++) {
+        sum += (out[i] - '0') * (i % 2 ? 3 : 1);
+    }
+    char check = (char)('0' + (10 - sum % 10) % 10);
+    if (n == 13 && digits[12] != check) {
+        return 0;
+    }
+    out[12] = check;
+    out[13] = '\0';
+    return 1;
+}
+
+// Split one CSV or TSV line in place; CSV fields may be quoted, with "" for a literal quote
+int import_split_fields(char *line, char separator, char **fields, int max) {
+    int count = 0;
+    char *read = line;
+    while (count < max) {
+        char *write = read;
+        fields[count++] = write;
+        if (separator == ',' && *read == '"') {
+            read++;
+            while (*read != '\0') {
+                if (*read == '"') {
+                    if (read[1] != '"') {
+                        read++;
+                        break;
+                    }
+                    read++; // Doubled quote
+                }
+                *write++ = *read++;
+            }
+            while (*read != '\0' && *read != separator) {
+                read++; // Anything after the closing quote is dropped
+            }
+        } else {
+            while (*read != '\0' && *read != separator) {
+                *write++ = *read++;
+            }
+        }
+        int more = *read == separator;
+        *write = '\0';
+        if (!more) {
+            break;
+        }
+        read++;
+    }
+    return count;
+}
+
+// Copy a text field into a record, truncated to fit; '|' would split the books.dat line, so it becomes '/'
+void import_copy_field(char *dest, const char *src, int size, const char *fallback) {
+    if (src[0] == '\0' && fallback != NULL) {
+        src = fallback;
+    }
+    int i = 0;
+    for (; i < size - 1 && src[i] != '\0'; i++) {
+        dest[i] = src[i] == '|' ? '/' : src[i];
+    }
+    dest[i] = '\0';
+}
+
+// Keep the first few rejected lines (numbered within the worker's slice) for the report
+void import_reject(ImportWorker *worker, const char *reason) {
+    if (worker->error_count < IMPORT_ERRORS_SHOWN) {
+        worker->error_lines[worker->error_count] = worker->lines;
+        worker->error_reasons[worker->error_count++] = reason;
+    }
+}
+
+// Parse one slice into fully built records: validated, normalized and with their copies.
+// Touches no shared state but the allocator, so slices run in parallel.
+void* import_worker_run(void *arg) {
+    ImportWorker *worker = (ImportWorker*)arg;
+    worker->count = 0;
+    worker->lines = 0;
+    worker->malformed = 0;
+    worker->bad_isbn = 0;
+    worker->no_memory = 0;
+    worker->error_count = 0;
+
+    char *cursor = worker->begin;
+    while (cursor < worker->end) {
+        char *line = cursor;
+        char *newline = (char*)memchr(cursor, '\n', worker->end - cursor);
+        char *line_end = newline != NULL ? newline : worker->end;
+        cursor = line_end + 1;
+        *line_end = '\0';
+        if (line_end > line && line_end[-1] == '\r') {
+            line_end[-1] = '\0';
+        }
+        worker->lines++;
+        if (line[0] == '\0') {
+            continue;
+        }
+
+        char *fields[IMPORT_MAX_FIELDS];
+        int n = import_split_fields(line, worker->separator, fields, IMPORT_MAX_FIELDS);
+        if (n < 2 || fields[1][0] == '\0') {
+            worker->malformed++;
+            import_reject(worker, "expected at least ISBN and title");
+            continue;
+        }
+        char isbn[MAX_ISBN_LENGTH];
+        if (!isbn_normalize(fields[0], isbn)) {
+            worker->bad_isbn++;
+            import_reject(worker, "invalid ISBN");
+            continue;
+        }
+        int copies = worker->default_copies;
+        if (n > 4 && fields[4][0] != '\0') {
+            char *end;
+            long value = strtol(fields[4], &end, 10);
+            if (*end != '\0' || value < 1 || value > IMPORT_MAX_COPIES) {
+                worker->malformed++;
+                import_reject(worker, "invalid copy count");
+                continue;
+            }
+            copies = (int)value;
+        }
+
+        if (worker->count == worker->capacity) {
+            long new_capacity = worker->capacity > 0 ? worker->capacity * 2 : 4096;
+            ImportRecord *grown = (ImportRecord*)lib_realloc(ALLOC_LOADING, worker->records,
+                                                             new_capacity * sizeof(ImportRecord));
+            if (grown == NULL) {
+                worker->no_memory++;
+                continue;
+            }
+            worker->records = grown;
+            worker->capacity = new_capacity;
+        }
+        Book *book = (Book*)lib_calloc(ALLOC_CATALOG, 1, sizeof(Book)); // Zeroed: no holds queued
+        if (book == NULL) {
+            worker->no_memory++;
+            continue;
+        }
+        strcpy(book->isbn, isbn);
+        import_copy_field(book->title, fields[1], MAX_TITLE_LENGTH, NULL);
+        import_copy_field(book->author, n > 2 ? fields[2] : "", MAX_AUTHOR_LENGTH, "Unknown");
+        import_copy_field(book->genre, n > 3 ? fields[3] : "", MAX_GENRE_LENGTH, "Unknown");
+        book->free_copy = -1;
+        if (add_copies(book, copies) != copies) {
+            lib_free(book->copies);
+            lib_free(book);
+            worker->no_memory++;
+            continue;
+        }
+        ImportRecord *record = &worker->records[worker->count++];
+        record->book = book;
+        record->hash = hash_isbn(book->isbn);
+        record->title_key = title_prefix_key(book->title);
+    }
+    return NULL;
+}
+
+// Cut [data, end) at line boundaries into one slice per thread and parse the slices in parallel
+void import_parse_chunk(ImportWorker *workers, int threads, char *data, char *end) {
+    size_t length = end - data;
+    char *slice_start = data;
+    for (int t = 0; t < threads; t++) {
+        char *slice_end = t == threads - 1 ? end : data + length * (t + 1) / threads;
+        if (slice_end < slice_start) {
+            slice_end = slice_start;
+        }
+        if (slice_end < end) {
+            char *newline = (char*)memchr(slice_end, '\n', end - slice_end); // Finish the line the cut landed in
+            slice_end = newline != NULL ? newline + 1 : end;
+        }
+        workers[t].begin = slice_start;
+        workers[t].end = slice_end;
+        slice_start = slice_end;
+    }
+
+    // Worker 0 runs on the calling thread
+    pthread_t thread_ids[IMPORT_MAX_THREADS];
+    int started = 1;
+    for (int t = 1; t < threads; t++) {
+        if (pthread_create(&thread_ids[t], NULL, import_worker_run, &workers[t]) != 0) {
+            break;
+        }
+        started++;
+    }
+    import_worker_run(&workers[0]);
+    for (int t = 1; t < started; t++) {
+        pthread_join(thread_ids[t], NULL);
+    }
+    for (int t = started; t < threads; t++) {
+        import_worker_run(&workers[t]); // Thread creation failed; finish inline
+    }
+}
+
+// Link a parsed chunk into the ISBN and ordinal indexes in file order. The chain walk that
+// finds the slot also catches ISBNs already in the catalog or earlier in the file.
+// Buckets are random, so each one is prefetched a few records ahead.
+void import_merge(ImportRun *run, ImportWorker *workers, int threads) {
+    long incoming = 0;
+    for (int t = 0; t < threads; t++) {
+        incoming += workers[t].count;
+    }
+    hash_table_reserve(hash_count + incoming);
+    if (run->added_count + incoming > run->added_capacity) {
+        long new_capacity = run->added_capacity > 0 ? run->added_capacity : 4096;
+        while (new_capacity < run->added_count + incoming) {
+            new_capacity *= 2;
+        }
+        TitleSortKey *grown = (TitleSortKey*)lib_realloc(ALLOC_LOADING, run->added, new_capacity * sizeof(TitleSortKey));
+        if (grown == NULL) {
+            incoming = -1; // Nothing from this chunk can be kept
+        } else {
+            run->added = grown;
+            run->added_capacity = new_capacity;
+        }
+    }
+
+    for (int t = 0; t < threads; t++) {
+        ImportWorker *worker = &workers[t];
+        for (int e = 0; e < worker->error_count && run->errors_shown < IMPORT_ERRORS_SHOWN; e++) {
+            fprintf(stderr, "  line %ld: %s\n", run->lines + worker->error_lines[e], worker->error_reasons[e]);
+            run->errors_shown++;
+        }
+        run->lines += worker->lines;
+        run->malformed += worker->malformed;
+        run->bad_isbn += worker->bad_isbn;
+        run->no_memory += worker->no_memory;
+
+        uint64_t mask = (uint64_t)(hash_capacity - 1);
+        for (long i = 0; i < worker->count; i++) {
+            if (i + IMPORT_PREFETCH_DISTANCE < worker->count) {
+                __builtin_prefetch(&hash_table[worker->records[i + IMPORT_PREFETCH_DISTANCE].hash & mask], 1);
+            }
+            Book *book = worker->records[i].book;
+            unsigned int index = (unsigned int)(worker->records[i].hash & mask);
+            Book *existing = hash_table[index];
+            while (existing != NULL && strcmp(existing->isbn, book->isbn) != 0) {
+                existing = existing->next;
+            }
+            if (existing != NULL || incoming < 0 || !register_book_ordinal(book)) {
+                if (existing == NULL) {
+                    run->no_memory++;
+                } else if (existing->ordinal >= run->first_ordinal) {
+                    run->repeated++;
+                } else {
+                    run->duplicates++;
+                }
+                lib_free(book->copies);
+                lib_free(book);
+                continue;
+            }
+            book->next = hash_table[index];
+            hash_table[index] = book;
+            hash_count++;
+            run->added[run->added_count].key = worker->records[i].title_key;
+            run->added[run->added_count++].book = book;
+        }
+    }
+}
+
+// First 8 bytes of a title as a big-endian integer: sorts the same way strcmp does
+uint64_t title_prefix_key(const char *title) {
+    uint64_t key = 0;
+    int position = 0;
+    for (int i = 0; i < 8; i++) {
+        unsigned char c = (unsigned char)title[position];
+        key = (key << 8) | c;
+        if (c != '\0') {
+            position++;
+        }
+    }
+    return key;
+}
+
+int title_key_compare(const void *a, const void *b) {
+    uint64_t left = ((const TitleSortKey*)a)->key;
+    uint64_t right = ((const TitleSortKey*)b)->key;
+    return (left > right) - (left < right);
+}
+
+// Order a run of titles that agree on their first `depth` bytes, 8 more bytes per level.
+// A key ending in NUL covers the rest of the title, so such runs are already equal.
+void title_sort_run(TitleSortKey *keys, long count, int depth) {
+    for (long i = 0; i < count; i++) {
+        keys[i].key = title_prefix_key(keys[i].book->title + depth);
+    }
+    qsort(keys, count, sizeof(TitleSortKey), title_key_compare);
+    for (long i = 0; i < count; ) {
+        long j = i + 1;
+        while (j < count && keys[j].key == keys[i].key) {
+            j++;
+        }
+        if (j - i > 1 && (keys[i].key & 0xff) != 0 && depth + 8 < MAX_TITLE_LENGTH) {
+            title_sort_run(keys + i, j - i, depth + 8);
+        }
+        i = j;
+    }
+}
+
+// Sort titles whose keys hold their first 8 bytes: LSD radix sort on the key, then refine ties
+int title_sort(TitleSortKey *keys, long count) {
+    TitleSortKey *scratch = (TitleSortKey*)lib_malloc(ALLOC_LOADING, (count > 0 ? count : 1) * sizeof(TitleSortKey));
+    if (scratch == NULL) {
+        return 0;
+    }
+    TitleSortKey *sorted = keys;
+    for (int shift = 0; shift < 64 && count > 0; shift += 8) {
+        long offsets[256] = {0};
+        for (long i = 0; i < count; i++) {
+            offsets[(sorted[i].key >> shift) & 0xff]++;
+        }
+        if (offsets[(sorted[0].key >> shift) & 0xff] == count) {
+            continue; // Every key has the same byte here
+        }
+        long offset = 0;
+        for (int b = 0; b < 256; b++) {
+            long bucket = offsets[b];
+            offsets[b] = offset;
+            offset += bucket;
+        }
+        for (long i = 0; i < count; i++) {
+            scratch[offsets[(sorted[i].key >> shift) & 0xff]++] = sorted[i];
+        }
+        TitleSortKey *swap = sorted;
+        sorted = scratch;
+        scratch = swap;
+    }
+    if (sorted != keys) {
+        memcpy(keys, sorted, count * sizeof(TitleSortKey));
+        scratch = sorted;
+    }
+    lib_free(scratch);
+
+    for (long i = 0; i < count; ) {
+        long j = i + 1;
+        while (j < count && keys[j].key == keys[i].key) {
+            j++;
+        }
+        if (j - i > 1 && (keys[i].key & 0xff) != 0) {
+            title_sort_run(keys + i, j - i, 8);
+        }
+        i = j;
+    }
+    return 1;
+}
+
+// For each node sorted by title, the index where its run of equal titles begins
+void bst_run_starts(TreeNode **nodes, long count, long *run_start) {
+    for (long k = 0; k < count; k++) {
+        run_start[k] = k > 0 && strcmp(nodes[k - 1]->book->title, nodes[k]->book->title) == 0 ? run_start[k - 1] : k;
+    }
+}
+
+// Balanced BST over nodes[lo, hi) sorted by title. The root of each range is the first of its run
+// of equal titles, so left subtrees stay strictly smaller (remove_from_bst relies on that).
+// Right ranges are handled by the loop, so recursion depth stays logarithmic.
+TreeNode* bst_build_balanced(TreeNode **nodes, const long *run_start, long lo, long hi) {
+    TreeNode *root = NULL;
+    TreeNode **link = &root;
+    while (lo < hi) {
+        long mid = lo + (hi - lo) / 2;
+        mid = run_start[mid] > lo ? run_start[mid] : lo;
+        TreeNode *node = nodes[mid];
+        node->left = bst_build_balanced(nodes, run_start, lo, mid);
+        *link = node;
+        link = &node->right;
+        lo = mid + 1;
+    }
+    *link = NULL;
+    return root;
+}
+
+// Add many titles to the title BST at once: merge them into the existing in-order sequence
+// and rebuild the tree balanced, instead of one descent per title
+int title_bst_bulk_insert(TitleSortKey *books, long count) {
+    if (count * IMPORT_REBUILD_RATIO < hash_count - count) {
+        for (long i = 0; i < count; i++) {
+            if (!insert_into_bst(books[i].book)) { // A few titles: cheaper than rebuilding the whole tree
+                return 0;
+            }
+        }
+        return 1;
+    }
+    if (!title_sort(books, count)) {
+        return 0;
+    }
+
+    // Allocate the new nodes before the tree is touched, chained through their right
+    // links in merge order (last title first), so running out leaves the tree as it was
+    TreeNode *fresh = NULL;
+    for (long j = 0; j < count; j++) {
+        TreeNode *node = create_tree_node(books[j].book);
+        if (node == NULL) {
+            bst_free_chain(fresh);
+            return 0;
+        }
+        node->right = fresh;
+        fresh = node;
+    }
+
+    long capacity = hash_count > count ? hash_count : count; // Every linked title has a node
+    TreeNode **nodes = (TreeNode**)lib_malloc(ALLOC_LOADING, capacity * sizeof(TreeNode*));
+    long *run_start = (long*)lib_malloc(ALLOC_LOADING, capacity * sizeof(long));
+    if (nodes == NULL || run_start == NULL) {
+        lib_free(nodes);
+        lib_free(run_start);
+        bst_free_chain(fresh);
+        return 0;
+    }
+
+    // Flatten the current tree in order by right rotations (no stack, however deep it is)
+    long existing = 0;
+    TreeNode *current = title_bst_root;
+    while (current != NULL) {
+        if (current->left != NULL) {
+            TreeNode *left = current->left;
+            current->left = left->right;
+            left->right = current;
+            current = left;
+        } else {
+            if (existing + count < capacity) {
+                nodes[existing] = current;
+            }
+            existing++;
+            current = current->right;
+        }
+    }
+    if (existing + count > capacity) {
+        fprintf(stderr, "Title index holds more nodes than titles; rebuilt without the imported titles.\n");
+        bst_run_starts(nodes, capacity - count, run_start);
+        title_bst_root = bst_build_balanced(nodes, run_start, 0, capacity - count);
+        lib_free(nodes);
+        lib_free(run_start);
+        bst_free_chain(fresh);
+        return 0;
+    }
+
+    // Merge from the back; equal titles keep existing nodes first, as single inserts would
+    long i = existing - 1;
+    long j = count - 1;
+    for (long k = existing + count - 1; j >= 0; k--) {
+        if (i >= 0 && strcmp(nodes[i]->book->title, books[j].book->title) > 0) {
+            nodes[k] = nodes[i--];
+        } else {
+            nodes[k] = fresh;
+            fresh = fresh->right;
+            j--;
+        }
+    }
+    bst_run_starts(nodes, existing + count, run_start);
+    title_bst_root = bst_build_balanced(nodes, run_start, 0, existing + count);
+    lib_free(nodes);
+    lib_free(run_start);
+    return 1;
+}
+
+// --import FILE [--format csv|tsv] [--copies N] [--threads N] [--dry-run]: bulk-add titles from a
+// CSV or TSV file (ISBN, title, author, genre, optional copies) to the catalog in books.dat
+int run_import(int argc, char *argv[]) {
+    const char *filename = argc > 0 ? argv[0] : NULL;
+    char separator = 0; // Detected from the first line unless --format is given
+    int default_copies = 1;
+    int threads = 0;
+    int dry_run = 0;
+    for (int i = 1; i < argc && filename != NULL; i++) {
+        const char *value = i + 1 < argc ? argv[i + 1] : NULL;
+        if (strcmp(argv[i], "--format") == 0 && value != NULL &&
+            (strcmp(value, "csv") == 0 || strcmp(value, "tsv") == 0)) {
+            separator = value[0] == 'c' ? ',' : '\t';
+            i++;
+        } else if (strcmp(argv[i], "--copies") == 0 && value != NULL && atoi(value) >= 1 &&
+                   atoi(value) <= IMPORT_MAX_COPIES) {
+            default_copies = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--threads") == 0 && value != NULL && atoi(value) >= 1) {
+            threads = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--dry-run") == 0) {
+            dry_run = 1;
+        } else {
+            filename = NULL;
+        }
+    }
+    if (filename == NULL) {
+        fprintf(stderr, "Usage: library --import FILE [--format csv|tsv] [--copies N] [--threads N] [--dry-run]\n");
+        return 1;
+    }
+    if (threads == 0) {
+        long cores = sysconf(_SC_NPROCESSORS_ONLN);
+        threads = cores > 0 ? (int)cores : 1;
+    }
+    if (threads > IMPORT_MAX_THREADS) {
+        threads = IMPORT_MAX_THREADS;
+    }
+
+    FILE *file = fopen(filename, "rb");
+    char *buffer = (char*)lib_malloc(ALLOC_LOADING, IMPORT_CHUNK_BYTES + 1);
+    if (file == NULL || buffer == NULL) {
+        fprintf(stderr, "Could not open %s.\n", filename);
+        if (file != NULL) {
+            fclose(file);
+        }
+        lib_free(buffer);
+        return 1;
+    }
+
+    // The existing catalog catches duplicates, and the save at the end writes everything back
+    load_books_from_file("books.dat");
+    load_users_from_file("users.dat");
+    load_holds_from_file("holds.dat");
+    load_history_from_file("history.dat");
+    long titles_before = hash_count;
+
+    ImportWorker workers[IMPORT_MAX_THREADS];
+    memset(workers, 0, sizeof(workers));
+    ImportRun run;
+    memset(&run, 0, sizeof(run));
+    run.first_ordinal = next_book_ordinal;
+
+    long file_size = 0;
+    if (fseek(file, 0, SEEK_END) == 0) {
+        file_size = ftell(file);
+    }
+    rewind(file);
+
+    uint64_t started = monotonic_ns();
+    size_t carried = 0;
+    int first_chunk = 1;
+    for (;;) {
+        uint64_t phase_start = monotonic_ns();
+        size_t got = fread(buffer + carried, 1, IMPORT_CHUNK_BYTES - carried, file);
+        size_t length = carried + got;
+        int at_end = length < IMPORT_CHUNK_BYTES;
+        buffer[length] = '\0';
+        run.bytes += got;
+        run.read_ns += monotonic_ns() - phase_start;
+        if (length == 0) {
+            break;
+        }
+
+        char *data = buffer;
+        if (first_chunk) {
+            first_chunk = 0;
+            char *newline = strchr(data, '\n');
+            if (separator == 0) {
+                char *tab = strchr(data, '\t');
+                separator = tab != NULL && (newline == NULL || tab < newline) ? '\t' : ',';
+            }
+            if (strncasecmp(data, "isbn", 4) == 0 && (data[4] == separator || data[4] == '\r' || data[4] == '\n')) {
+                data = newline != NULL ? newline + 1 : buffer + length; // Header row
+                run.lines++;
+            }
+            for (int t = 0; t < threads; t++) {
+                workers[t].separator = separator;
+                workers[t].default_copies = default_copies;
+            }
+        }
+
+        // Parse whole lines only; a partial last line waits for the next read
+        size_t usable = length;
+        if (!at_end) {
+            while (usable > (size_t)(data - buffer) && buffer[usable - 1] != '\n') {
+                usable--;
+            }
+            if (usable == (size_t)(data - buffer)) {
+                usable = length; // One line fills the buffer; it is cut and will be rejected
+            }
+        }
+
+        phase_start = monotonic_ns();
+        import_parse_chunk(workers, threads, data, buffer + usable);
+        uint64_t parsed = monotonic_ns();
+        run.parse_ns += parsed - phase_start;
+        if (run.bytes == (long)got && !at_end && file_size > 0) {
+            // Size the ISBN index for the whole file from the first chunk's record density
+            long first_records = 0;
+            for (int t = 0; t < threads; t++) {
+                first_records += workers[t].count;
+            }
+            hash_table_reserve(hash_count + (long)((double)first_records * file_size / usable));
+        }
+        import_merge(&run, workers, threads);
+        run.merge_ns += monotonic_ns() - parsed;
+
+        carried = length - usable;
+        memmove(buffer, buffer + usable, carried);
+        if (at_end) {
+            break;
+        }
+    }
+    int read_failed = ferror(file);
+    fclose(file);
+    lib_free(buffer);
+    for (int t = 0; t < threads; t++) {
+        lib_free(workers[t].records);
+    }
+
+    uint64_t index_start = monotonic_ns();
+    if (!title_bst_bulk_insert(run.added, run.added_count)) {
+        fprintf(stderr, "Not enough memory to rebuild the title index; nothing was saved.\n");
+        dry_run = 1;
+    }
+    run.index_ns = monotonic_ns() - index_start;
+    uint64_t elapsed = monotonic_ns() - started;
+    lib_free(run.added);
+
+    long records = run.added_count + run.malformed + run.bad_isbn + run.duplicates + run.repeated + run.no_memory;
+    printf("Imported %ld of %ld records from %s in %.3f s: %.0f records/s (%d thread%s)\n",
+           run.added_count, records, filename, elapsed / 1e9, elapsed > 0 ? records / (elapsed / 1e9) : 0.0,
+           threads, threads == 1 ? "" : "s");
+    printf("  %-12s %8.3f s  (%.1f MB)\n", "Read", run.read_ns / 1e9, run.bytes / 1e6);
+    printf("  %-12s %8.3f s\n", "Parse", run.parse_ns / 1e9);
+    printf("  %-12s %8.3f s\n", "Merge", run.merge_ns / 1e9);
+    printf("  %-12s %8.3f s  (BST height %d)\n", "Title index", run.index_ns / 1e9, bst_height(title_bst_root));
+    printf("Skipped: %ld malformed, %ld invalid ISBN, %ld already in catalog, %ld repeated in file, %ld out of memory\n",
+           run.malformed, run.bad_isbn, run.duplicates, run.repeated, run.no_memory);
+    if (read_failed) {
+        fprintf(stderr, "Reading %s failed part way; only the records before the error were imported.\n", filename);
+    }
+
+    if (dry_run) {
+        printf("Dry run: catalog not saved (%ld titles before, %ld after).\n", titles_before, hash_count);
+    } else if (run.added_count > 0) {
+        uint64_t save_start = monotonic_ns();
+        save_all_data();
+        printf("Saved %ld titles in %.3f s.\n", hash_count, (monotonic_ns() - save_start) / 1e9);
+    }
+
+    free_all_books();
+    free_all_users();
+    free_history();
+    return read_failed ? 1 : 0;
+}